@@ -44,18 +44,12 @@ int main(ImageWrite *param, Evaluation *evaluation, void *context)
 	if (!evaluation->forcedDirty)
 		return EVAL_OK;
 	
-	image.bits = 0;
-	if (Evaluate(context, evaluation->inputIndices[0], param->width, param->height, &image) == EVAL_OK)
+	// saved images are logged by the writer: pipelined frames (animation bake) are written later
+	// and their failures are returned by the next call
+	if (EvaluateToFile(context, evaluation->inputIndices[0], param->width, param->height, param->filename, param->format, param->quality) == EVAL_OK)
 	{
-		if (WriteImage(context, param->filename, &image, param->format, param->quality) == EVAL_OK)
-		{	
-			FreeImage(&image);
-			Log("Image %s saved.\n", param->filename);
-			return EVAL_OK;
-		}
-		else
-			Log("Unable to write image : %s\n", param->filename);
+		return EVAL_OK;
 	}
-
+	Log("Unable to write image : %s\n", param->filename);
 	return EVAL_ERR;
 }
\ No newline at end of file
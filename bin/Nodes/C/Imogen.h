@@ -1,9 +1,19 @@
-int Log(const char *szFormat, ...);
+#ifdef IMOGEN_NATIVE
+// native nodes are built with the host compiler as shared libraries.
+// Imogen functions are pointers set by the host when the library is loaded.
+#include <math.h>
+#include <string.h>
+#define IMOGEN_API(ret, name, args) ret (*name) args __asm__("imogen_" #name)
+#else
+#define IMOGEN_API(ret, name, args) ret name args
 char * strcpy (char * destination, const char * source);
 int strcmp(char *str1, char *str2);
 int strlen (const char * str);
 float fabsf(float value);
 float log2(float);
+#endif
+
+IMOGEN_API(int, Log, (const char *szFormat, ...));
 
 typedef struct Image_t
 {
@@ -49,6 +59,10 @@ typedef struct Evaluation_t
 	
     int mipmapNumber;
     int mipmapCount;
+	
+	int padding[2];
+	float uvWindow[4];
+	float viewRots[16 * 6];
 } Evaluation;
 
 enum BlendOp
@@ -105,65 +119,99 @@ int vertexSpace_UV = 0;
 int vertexSpace_World = 1;
 
 // call FreeImage when done
-int ReadImage(void* context, char *filename, Image *image);
+IMOGEN_API(int, ReadImage, (void* context, char *filename, Image *image));
 // writes an allocated image
-int WriteImage(void* context, char *filename, Image *image, int format, int quality);
+IMOGEN_API(int, WriteImage, (void* context, char *filename, Image *image, int format, int quality));
 // call FreeImage when done
-int GetEvaluationImage(void* context, int target, Image *image);
+IMOGEN_API(int, GetEvaluationImage, (void* context, int target, Image *image));
 // 
-int SetEvaluationImage(void* context, int target, Image *image);
-int SetEvaluationImageCube(void* context, int target, Image *image, int cubeFace);
+IMOGEN_API(int, SetEvaluationImage, (void* context, int target, Image *image));
+IMOGEN_API(int, SetEvaluationImageCube, (void* context, int target, Image *image, int cubeFace));
 // call FreeImage when done
 // set the bits pointer with an allocated memory
-int AllocateImage(Image *image);
-int FreeImage(Image *image);
-int LoadSVG(const char *filename, Image *image, float dpi);
+IMOGEN_API(int, AllocateImage, (Image *image));
+IMOGEN_API(int, FreeImage, (Image *image));
+// images returned by the API may share their bits (cache, other images).
+// destination shares source bits, no copy. Call FreeImage when done
+IMOGEN_API(int, AcquireImage, (Image *source, Image *destination));
+// call before writing to bits: they are copied when shared
+IMOGEN_API(int, MakeImageWritable, (Image *image));
+IMOGEN_API(int, LoadSVG, (const char *filename, Image *image, float dpi));
 
 // Image resize
 // Image thumbnail
-int SetThumbnailImage(void *context, Image *image);
+IMOGEN_API(int, SetThumbnailImage, (void *context, Image *image));
 
 // force evaluation of a target with a specified size
 // no guarantee that the resulting Image will have that size.
-int Evaluate(void *context, int target, int width, int height, Image *image);
+IMOGEN_API(int, Evaluate, (void *context, int target, int width, int height, Image *image));
+// evaluate a target with a specified size and write it.
+// big images are evaluated by tiles and streamed to the file (png, tga, bmp)
+// animation bake frames are written later: a failed write is returned by the next call
+IMOGEN_API(int, EvaluateToFile, (void *context, int target, int width, int height, char *filename, int format, int quality));
 
-void SetBlendingMode(void *context, int target, int blendSrc, int blendDst);
-void EnableDepthBuffer(void *context, int target, int enable);
-void EnableFrameClear(void *context, int target, int enable);
+IMOGEN_API(void, SetBlendingMode, (void *context, int target, int blendSrc, int blendDst));
+IMOGEN_API(void, EnableDepthBuffer, (void *context, int target, int enable));
+IMOGEN_API(void, EnableFrameClear, (void *context, int target, int enable));
 
-void SetVertexSpace(void *context, int target, int vertexMode);
+IMOGEN_API(void, SetVertexSpace, (void *context, int target, int vertexMode));
 
-int GetEvaluationSize(void *context, int target, int *imageWidth, int *imageHeight);
-int SetEvaluationSize(void *context, int target, int imageWidth, int imageHeight);
-int SetEvaluationCubeSize(void *context, int target, int faceWidth, int mipmapCount);
+IMOGEN_API(int, GetEvaluationSize, (void *context, int target, int *imageWidth, int *imageHeight));
+IMOGEN_API(int, SetEvaluationSize, (void *context, int target, int imageWidth, int imageHeight));
+IMOGEN_API(int, SetEvaluationCubeSize, (void *context, int target, int faceWidth, int mipmapCount));
 
-int OverrideInput(void *context, int target, int inputIndex, int newInputTarget);
-int CubemapFilter(Image *image, int faceSize, int lightingModel, int excludeBase, int glossScale, int glossBias);
+IMOGEN_API(int, OverrideInput, (void *context, int target, int inputIndex, int newInputTarget));
+IMOGEN_API(int, CubemapFilter, (Image *image, int faceSize, int lightingModel, int excludeBase, int glossScale, int glossBias));
 
-int Job(void *context, int(*jobFunction)(void*), void *ptr, unsigned int size);
-int JobMain(void *context, int(*jobMainFunction)(void*), void *ptr, unsigned int size);
+IMOGEN_API(int, Job, (void *context, int(*jobFunction)(void*), void *ptr, unsigned int size));
+IMOGEN_API(int, JobMain, (void *context, int(*jobMainFunction)(void*), void *ptr, unsigned int size));
 // processing values:
 // 0 : no more processing, display node as normal
 // 1 : processing with an animation for node display
 // 2 : display node as normal despite it processing 
-void SetProcessing(void *context, int target, int processing);
+IMOGEN_API(void, SetProcessing, (void *context, int target, int processing));
 
 // compute shader memory allocation
-int AllocateComputeBuffer(void *context, int target, int elementCount, int elementSize);
+IMOGEN_API(int, AllocateComputeBuffer, (void *context, int target, int elementCount, int elementSize));
+
+IMOGEN_API(int, LoadScene, (const char *filename, void **scene));
+IMOGEN_API(int, SetEvaluationScene, (void *context, int target, void *scene));
+IMOGEN_API(int, GetEvaluationScene, (void *context, int target, void **scene));
 
-int LoadScene(const char *filename, void **scene);
-int SetEvaluationScene(void *context, int target, void *scene);
-int GetEvaluationScene(void *context, int target, void **scene);
+IMOGEN_API(int, SetEvaluationRTScene, (void *context, int target, void *scene));
+IMOGEN_API(int, GetEvaluationRTScene, (void *context, int target, void **scene));
 
-int SetEvaluationRTScene(void *context, int target, void *scene);
-int GetEvaluationRTScene(void *context, int target, void **scene);
+IMOGEN_API(char*, GetEvaluationSceneName, (void *context, int target));
+IMOGEN_API(int, GetEvaluationRenderer, (void *context, int target, void **renderer));
+IMOGEN_API(int, InitRenderer, (void *context, int target, int mode, void *scene));
+IMOGEN_API(int, UpdateRenderer, (void *context, int target));
 
-char* GetEvaluationSceneName(void *context, int target);
-int GetEvaluationRenderer(void *context, int target, void **renderer);
-int InitRenderer(void *context, int target, int mode, void *scene);
-int UpdateRenderer(void *context, int target);
+IMOGEN_API(int, ReadGLTF, (void *evaluationContext, char *filename, void **scene));
 
-int ReadGLTF(void *evaluationContext, char *filename, void **scene);
+// native image kernels. Resize and convolution use the first face and mip, the others every pixel.
+enum ResizeFilter
+{
+	RESIZE_BOX,
+	RESIZE_BILINEAR,
+	RESIZE_LANCZOS,
+};
+// SwizzleImage source channel: 0 to 3 or one of these
+int SWIZZLE_ZERO = 4;
+int SWIZZLE_ONE = 5;
+
+// destination is allocated, call FreeImage when done
+IMOGEN_API(int, ResizeImage, (Image *source, Image *destination, int width, int height, int filter));
+// separable: kernel has 2 * radius + 1 weights
+IMOGEN_API(int, ConvolveImage, (Image *image, float *kernel, int radius));
+// destination is allocated with the format, call FreeImage when done
+IMOGEN_API(int, ConvertImage, (Image *source, Image *destination, int format));
+IMOGEN_API(int, PremultiplyImage, (Image *image));
+IMOGEN_API(int, UnpremultiplyImage, (Image *image));
+IMOGEN_API(int, SwizzleImage, (Image *image, int red, int green, int blue, int alpha));
+// binCount bins over [0, 1]
+IMOGEN_API(int, ImageHistogram, (Image *image, int channel, int binCount, unsigned int *bins));
+// 4 floats each
+IMOGEN_API(int, ImageMinMax, (Image *image, float *minimum, float *maximum));
 
 	
 #define EVAL_OK 0
@@ -29,8 +29,17 @@ layout (std140) uniform EvaluationBlock
 	
     int mipmapNumber;
     int mipmapCount;
+	
+	vec4 uvWindow; // tiled evaluation: uv offset in xy, uv scale in zw. 0 when not tiled
+	
+	mat4 viewRots[6]; // cubemap face rotations, for layered cubemap rendering
 } EvaluationParam;
 
+vec4 UVWindow()
+{
+	return (EvaluationParam.uvWindow.z > 0.0) ? EvaluationParam.uvWindow : vec4(0.0, 0.0, 1.0, 1.0);
+}
+
 #ifdef VERTEX_SHADER
 
 layout(location = 0)in vec2 inUV;
@@ -53,7 +62,15 @@ void main()
 		gl_Position = vec4(inUV.xy*2.0-1.0,0.5,1.0); 
 	}
 	
-	vUV = inUV;
+	if (EvaluationParam.mVertexSpace == 1)
+	{
+		vUV = inUV;
+	}
+	else
+	{
+		vec4 window = UVWindow();
+		vUV = window.xy + inUV * window.zw;
+	}
 	vColor = inColor;
 	vWorldNormal = (EvaluationParam.model * vec4(inNormal, 0.0)).xyz;
 	vWorldPosition = (EvaluationParam.model * vec4(inPosition, 1.0)).xyz;
@@ -73,6 +90,16 @@ struct Camera
 };
 
 layout(location=0) out vec4 outPixDiffuse;
+#ifdef LAYERED_CUBE
+// the 6 faces of a cubemap mip are rendered at once, face i goes to draw buffer i
+layout(location=1) out vec4 outPixFace1;
+layout(location=2) out vec4 outPixFace2;
+layout(location=3) out vec4 outPixFace3;
+layout(location=4) out vec4 outPixFace4;
+layout(location=5) out vec4 outPixFace5;
+int gCubeFace;
+#define viewRot viewRots[gCubeFace]
+#endif
 in vec2 vUV;
 in vec3 vWorldPosition;
 in vec3 vWorldNormal;
@@ -95,6 +122,77 @@ uniform samplerCube CubeSampler5;
 uniform samplerCube CubeSampler6;
 uniform samplerCube CubeSampler7;
 
+// nodes sample their inputs with image uvs and texel coordinates. When tiling, inputs only cover the tile window
+vec2 TileUV(vec2 uv)
+{
+	vec4 window = UVWindow();
+	return (uv - window.xy) / window.zw;
+}
+
+// size of the whole image the tile is cut from
+ivec2 TileTextureSize(sampler2D tex, int lod)
+{
+	return ivec2(vec2(textureSize(tex, lod)) / UVWindow().zw + 0.5);
+}
+
+ivec2 TileTextureSize(samplerCube tex, int lod)
+{
+	return textureSize(tex, lod);
+}
+
+vec4 TileTexture(sampler2D tex, vec2 uv)
+{
+	return texture(tex, TileUV(uv));
+}
+
+vec4 TileTexture(sampler2D tex, vec2 uv, float bias)
+{
+	return texture(tex, TileUV(uv), bias);
+}
+
+vec4 TileTexture(samplerCube tex, vec3 dir)
+{
+	return texture(tex, dir);
+}
+
+vec4 TileTexture(samplerCube tex, vec3 dir, float bias)
+{
+	return texture(tex, dir, bias);
+}
+
+vec4 TileTextureLod(sampler2D tex, vec2 uv, float lod)
+{
+	return textureLod(tex, TileUV(uv), lod);
+}
+
+vec4 TileTextureLod(samplerCube tex, vec3 dir, float lod)
+{
+	return textureLod(tex, dir, lod);
+}
+
+vec4 TileTextureGrad(sampler2D tex, vec2 uv, vec2 dPdx, vec2 dPdy)
+{
+	vec4 window = UVWindow();
+	return textureGrad(tex, TileUV(uv), dPdx / window.zw, dPdy / window.zw);
+}
+
+vec4 TileTextureGrad(samplerCube tex, vec3 dir, vec3 dPdx, vec3 dPdy)
+{
+	return textureGrad(tex, dir, dPdx, dPdy);
+}
+
+vec4 TileTexelFetch(sampler2D tex, ivec2 texel, int lod)
+{
+	ivec2 tileOrigin = ivec2(floor(UVWindow().xy * vec2(TileTextureSize(tex, lod)) + 0.5));
+	return texelFetch(tex, texel - tileOrigin, lod);
+}
+
+#define texture TileTexture
+#define textureLod TileTextureLod
+#define textureGrad TileTextureGrad
+#define texelFetch TileTexelFetch
+#define textureSize TileTextureSize
+
 vec2 Rotate2D(vec2 v, float a) 
 {
 	float s = sin(a);
@@ -308,7 +406,16 @@ __NODE__
 
 void main() 
 { 
+#ifdef LAYERED_CUBE
+	gCubeFace = 0; outPixDiffuse = vec4(__FUNCTION__);
+	gCubeFace = 1; outPixFace1 = vec4(__FUNCTION__);
+	gCubeFace = 2; outPixFace2 = vec4(__FUNCTION__);
+	gCubeFace = 3; outPixFace3 = vec4(__FUNCTION__);
+	gCubeFace = 4; outPixFace4 = vec4(__FUNCTION__);
+	gCubeFace = 5; outPixFace5 = vec4(__FUNCTION__);
+#else
 	outPixDiffuse = vec4(__FUNCTION__);
+#endif
 }
 
 #endif
@@ -0,0 +1,32 @@
+#ifdef VERTEX_SHADER
+
+layout(location = 0)in vec2 inUV;
+out vec2 vUV;
+void main()
+{ 
+	gl_Position = vec4(inUV.xy*2.0 - 1.0,0.5,1.0);
+	vUV = inUV; 
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+// only texels that still change pass: counted by an occlusion query
+uniform sampler2D currentSampler;
+uniform sampler2D previousSampler;
+uniform float epsilon;
+layout(location = 0) out vec4 outPixDiffuse;
+in vec2 vUV;
+
+void main() 
+{
+	vec4 difference = abs(texture(currentSampler, vUV) - texture(previousSampler, vUV));
+	if (all(lessThanEqual(difference, vec4(epsilon))))
+	{
+		discard;
+	}
+	outPixDiffuse = difference;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <Camera.h>
 #include <iostream>
+#include <string.h>
 
 namespace GLSLPathTracer
 {
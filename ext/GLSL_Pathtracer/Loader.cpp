@@ -39,7 +39,7 @@ freely, subject to the following restrictions:
 namespace GLSLPathTracer
 {
 
-    static const float M_PI = 3.14159265358979323846f;
+    static const float PI = 3.14159265358979323846f;
 
     static const int kMaxLineLength = 2048;
     int(*Log)(const char* szFormat, ...) = printf;
@@ -132,8 +132,7 @@ namespace GLSLPathTracer
 
     Scene* LoadScene(const std::string &filename)
     {
-        FILE* file;
-        fopen_s(&file, filename.c_str(), "r");
+        FILE* file = fopen(filename.c_str(), "r");
 
         if (!file)
         {
@@ -298,7 +297,7 @@ namespace GLSLPathTracer
                 else if (strcmp(light_type, "Sphere") == 0)
                 {
                     light.radiusAreaType.z = 1;
-                    light.radiusAreaType.y = 4.0f * M_PI * light.radiusAreaType.x * light.radiusAreaType.x;
+                    light.radiusAreaType.y = 4.0f * PI * light.radiusAreaType.x * light.radiusAreaType.x;
                 }
 
                 scene->lightData.push_back(light);
@@ -401,7 +400,7 @@ namespace GLSLPathTracer
                     Log("Loading Model: %s\n", meshPath.c_str());
                     if (!LoadModel(scene, meshPath, materialId))
                     {
-                        return false;
+                        return nullptr;
                     }
                 }
             }
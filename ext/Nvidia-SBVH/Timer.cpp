@@ -27,7 +27,11 @@
 
 #include "Timer.h"
 #include <iostream>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <chrono>
+#endif
 
 using namespace FW;
 
@@ -40,6 +44,9 @@ S64 Timer::s_prevTicks          = 0;
 #define max(x,y) ((x>y)?x:y)
 void Timer::staticInit(void)
 {
+#ifndef _WIN32
+    s_ticksToSecsCoef = 1.0e-9;
+#else
     LARGE_INTEGER freq;
 	if (!QueryPerformanceFrequency(&freq))
 	{
@@ -47,15 +54,24 @@ void Timer::staticInit(void)
 		exit(0);
 	}
     s_ticksToSecsCoef = max(1.0 / (F64)freq.QuadPart, 0.0);
+#endif
  }
 
 S64 Timer::queryTicks(void)
 {
+#ifndef _WIN32
+	S64 ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	ticks = max(s_prevTicks, ticks);
+	s_prevTicks = ticks;
+	return ticks;
+#else
 	LARGE_INTEGER ticks;
 	QueryPerformanceCounter(&ticks);
 	ticks.QuadPart = max(s_prevTicks, ticks.QuadPart);
 	s_prevTicks = ticks.QuadPart; // increasing little endian => thread-safe
 	return ticks.QuadPart;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -0,0 +1,376 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// imogen-bake : headless batch baker.
+// Loads a library, evaluates every output node of every material (or of the materials given on the command line)
+// and writes the results to disk. No window, no ImGui, no SDL video : GL runs on a surfaceless EGL context.
+// Must be run from the bin directory so Nodes/ and Stock/ are found.
+
+#include "Platform.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+#include <algorithm>
+#include "EvaluationContext.h"
+#include "Evaluators.h"
+#include "NodeGraph.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+Builder* gBuilder = nullptr;
+Library library;
+UndoRedoHandler gUndoRedoHandler;
+TaskScheduler g_TS;
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLConfig eglConfig;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+static EGLContext eglThreadContext = EGL_NO_CONTEXT;
+
+static const EGLint eglContextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                              4,
+                                              EGL_CONTEXT_MINOR_VERSION,
+                                              3,
+                                              EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                              EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                              EGL_NONE};
+
+// used by Builder workers. a single shared context: the bake tool does not run a Builder
+int gThreadContextCount = 1;
+void MakeThreadContext(int)
+{
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglThreadContext);
+}
+
+// only referenced by the python module
+void RenderImogenFrame()
+{
+}
+
+static bool InitHeadlessContext()
+{
+    eglDisplay = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+#endif
+    if (eglDisplay == EGL_NO_DISPLAY)
+    {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        Log("Unable to initialize EGL display.\n");
+        return false;
+    }
+    Log("EGL %d.%d (%s)\n", major, minor, eglQueryString(eglDisplay, EGL_VENDOR));
+
+    static const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &eglConfig, 1, &configCount) || !configCount)
+    {
+        Log("No suitable EGL config.\n");
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        Log("Unable to bind OpenGL API.\n");
+        return false;
+    }
+
+    eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, eglContextAttributes);
+    if (eglContext == EGL_NO_CONTEXT)
+    {
+        Log("Unable to create GL 4.3 core context.\n");
+        return false;
+    }
+    eglThreadContext = eglCreateContext(eglDisplay, eglConfig, eglContext, eglContextAttributes);
+
+    // EGL_KHR_surfaceless_context : no pbuffer needed, every draw goes to FBOs
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        Log("Surfaceless context not supported.\n");
+        return false;
+    }
+
+    if (gl3wInit() != 0)
+    {
+        Log("Failed to initialize OpenGL loader!\n");
+        return false;
+    }
+    Log("GL %s / %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+    return true;
+}
+
+static void FinishHeadlessContext()
+{
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (eglThreadContext != EGL_NO_CONTEXT)
+        eglDestroyContext(eglDisplay, eglThreadContext);
+    if (eglContext != EGL_NO_CONTEXT)
+        eglDestroyContext(eglDisplay, eglContext);
+    eglTerminate(eglDisplay);
+}
+
+struct BakeOptions
+{
+    const char* mLibraryFilename = "library.dat";
+    const char* mOutputDirectory = ".";
+    int mWidth = 1024;
+    int mHeight = 1024;
+    int mFormat = 1; // png
+    int mQuality = 90;
+    int mShardIndex = 0;
+    int mShardCount = 1;
+    bool mbBenchmarkEvaluationOrder = false;
+    std::vector<std::string> mMaterials;
+};
+
+static const char* formatExtensions[] = {"jpg", "png", "tga", "bmp", "hdr", "dds", "ktx"};
+static const int formatExtensionCount = sizeof(formatExtensions) / sizeof(formatExtensions[0]);
+
+static void PrintUsage()
+{
+    printf("imogen-bake [options] [material ...]\n");
+    printf("  -l <file>     library file (default library.dat)\n");
+    printf("  -o <dir>      output directory (default .)\n");
+    printf("  -s <w> <h>    evaluation size (default 1024 1024)\n");
+    printf("  -f <format>   jpg, png, tga, bmp, hdr, dds or ktx (default png)\n");
+    printf("  -q <quality>  jpg quality (default 90)\n");
+    printf("  -shard <i> <n> only bake materials where index %% n == i\n");
+    printf("  -benchorder   time evaluation order updates on 100, 1k and 10k nodes graphs and exit\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BakeOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasOne = (i + 1) < argc;
+        bool hasTwo = (i + 2) < argc;
+        if (!strcmp(arg, "-l") && hasOne)
+        {
+            options.mLibraryFilename = argv[++i];
+        }
+        else if (!strcmp(arg, "-o") && hasOne)
+        {
+            options.mOutputDirectory = argv[++i];
+        }
+        else if (!strcmp(arg, "-s") && hasTwo)
+        {
+            options.mWidth = atoi(argv[++i]);
+            options.mHeight = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "-q") && hasOne)
+        {
+            options.mQuality = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "-shard") && hasTwo)
+        {
+            options.mShardIndex = atoi(argv[++i]);
+            options.mShardCount = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "-benchorder"))
+        {
+            options.mbBenchmarkEvaluationOrder = true;
+        }
+        else if (!strcmp(arg, "-f") && hasOne)
+        {
+            const char* format = argv[++i];
+            options.mFormat = -1;
+            for (int j = 0; j < formatExtensionCount; j++)
+            {
+                if (!strcmp(format, formatExtensions[j]))
+                {
+                    options.mFormat = j;
+                }
+            }
+            if (options.mFormat == -1)
+            {
+                return false;
+            }
+        }
+        else if (arg[0] == '-')
+        {
+            return false;
+        }
+        else
+        {
+            options.mMaterials.push_back(arg);
+        }
+    }
+    return options.mWidth > 0 && options.mHeight > 0 && options.mShardCount > 0;
+}
+
+static bool HasForceEvaluate(const EvaluationStage& stage)
+{
+    const MetaNode& currentMeta = gMetaNodes[stage.mType];
+    for (auto& param : currentMeta.mParams)
+    {
+        if (param.mType == Con_ForceEvaluate)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// returns the number of files written
+static int BakeMaterial(Material& material, const BakeOptions& options)
+{
+    EvaluationStages evaluationStages = BuildEvaluationFromMaterial(material);
+    EvaluationContext context(evaluationStages, true, options.mWidth, options.mHeight);
+    context.EnableParallelJobs(true);
+
+    int frame = material.mFrameMin;
+    context.SetCurrentTime(frame);
+    evaluationStages.SetTime(&context, frame, false);
+    evaluationStages.ApplyAnimation(&context, frame);
+
+    int written = 0;
+    for (size_t i = 0; i < evaluationStages.mStages.size(); i++)
+    {
+        const auto& stage = evaluationStages.mStages[i];
+        bool forceEval = HasForceEvaluate(stage);
+        // output nodes are the ones nobody reads from. ImageWrite like nodes write their own files.
+        if (stage.mUseCountByOthers && !forceEval)
+        {
+            continue;
+        }
+
+        context.DirtyAll();
+        while (context.RunBackward(i))
+        {
+            // jobs pinned to the main thread need to be pumped until the node is done
+            g_TS.RunPinnedTasks();
+        }
+
+        if (forceEval)
+        {
+            continue;
+        }
+
+        Image image;
+        if (EvaluationAPI::GetEvaluationImage(&context, int(i), &image) != EVAL_OK || !image.GetBits())
+        {
+            Log("%s : unable to read back node %d (%s).\n", material.mName.c_str(), int(i), stage.mTypename.c_str());
+            continue;
+        }
+
+        // png/jpg/... can't hold a cubemap
+        int format = options.mFormat;
+        if (image.mNumFaces == 6 && format < 5)
+        {
+            format = 5;
+        }
+        char filename[1024];
+        snprintf(filename,
+                 sizeof(filename),
+                 "%s/%s_%d_%s.%s",
+                 options.mOutputDirectory,
+                 material.mName.c_str(),
+                 int(i),
+                 stage.mTypename.c_str(),
+                 formatExtensions[format]);
+        if (Image::Write(filename, &image, format, options.mQuality) == EVAL_OK)
+        {
+            Log("Wrote %s\n", filename);
+            written++;
+        }
+        else
+        {
+            Log("Unable to write %s\n", filename);
+        }
+    }
+    context.Clear();
+    return written;
+}
+
+int main(int argc, char** argv)
+{
+    BakeOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+    if (options.mbBenchmarkEvaluationOrder)
+    {
+        NodeGraphBenchmarkEvaluationOrder();
+        return 0;
+    }
+
+    if (!InitHeadlessContext())
+    {
+        return 1;
+    }
+    TagTime("EGL Init");
+
+    g_TS.Initialize();
+    LoadMetaNodes();
+    stbi_set_flip_vertically_on_load(1);
+    stbi_flip_vertically_on_write(1);
+
+    LoadLib(&library, options.mLibraryFilename);
+    TagTime("Library loaded");
+
+    std::vector<EvaluatorFile> evaluatorFiles;
+    Imogen::DiscoverNodes("glsl", "Nodes/GLSL/", EVALUATOR_GLSL, evaluatorFiles);
+    gDefaultShader.Init();
+    gEvaluators.SetEvaluators(evaluatorFiles);
+
+    int materialCount = 0;
+    int fileCount = 0;
+    for (size_t i = 0; i < library.mMaterials.size(); i++)
+    {
+        Material& material = library.mMaterials[i];
+        if (!options.mMaterials.empty() &&
+            std::find(options.mMaterials.begin(), options.mMaterials.end(), material.mName) == options.mMaterials.end())
+        {
+            continue;
+        }
+        if ((int(i) % options.mShardCount) != options.mShardIndex)
+        {
+            continue;
+        }
+        fileCount += BakeMaterial(material, options);
+        materialCount++;
+        TagTime(material.mName.c_str());
+    }
+    Log("Baked %d materials, %d files.\n", materialCount, fileCount);
+
+    g_TS.WaitforAllAndShutdown();
+    gEvaluators.ClearEvaluators();
+    FinishHeadlessContext();
+    return 0;
+}
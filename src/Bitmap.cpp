@@ -25,8 +25,12 @@
 
 #include "Platform.h"
 #include <fstream>
+#include <sys/stat.h>
+#include <algorithm>
 #include "Bitmap.h"
 #include "Utils.h"
+#include "PixelOps.h"
+#include "TextureContainer.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -45,22 +49,6 @@
 ImageCache gImageCache;
 DefaultShaders gDefaultShader;
 #ifdef GL_BGR
-const unsigned int glInputFormats[] = {
-    GL_BGR,
-    GL_RGB,
-    GL_RGB16,
-    GL_RGB16F,
-    GL_RGB32F,
-    GL_RGBA, // RGBE
-
-    GL_BGRA,
-    GL_RGBA,
-    GL_RGBA16,
-    GL_RGBA16F,
-    GL_RGBA32F,
-
-    GL_RGBA, // RGBM
-};
 const unsigned int glInternalFormats[] = {
     GL_RGB,
     GL_RGB,
@@ -78,40 +66,55 @@ const unsigned int glInternalFormats[] = {
     GL_RGBA, // RGBM
 };
 #else
-const unsigned int glInputFormats[] = {
-    GL_RGB,
-    GL_RGB,
-    GL_RGB,
-    GL_RGB,
-    GL_RGB,
-    GL_RGBA, // RGBE
-
-    GL_RGBA,
-    GL_RGBA,
-    GL_RGBA,
-    GL_RGBA,
-    GL_RGBA,
-
-    GL_RGBA, // RGBM
-};
+// float textures need a sized internal format in GLES 3
 const unsigned int glInternalFormats[] = {
     GL_RGB,
     GL_RGB,
     GL_RGB,
-    GL_RGB,
-    GL_RGB,
+    GL_RGB16F,
+    GL_RGB32F,
     GL_RGBA, // RGBE
 
     GL_RGBA,
     GL_RGBA,
     GL_RGBA,
-    GL_RGBA,
-    GL_RGBA,
+    GL_RGBA16F,
+    GL_RGBA32F,
 
     GL_RGBA, // RGBM
 };
 
 #endif
+
+void GetGLPixelFormat(int format, unsigned int& glFormat, unsigned int& glType)
+{
+    glFormat = (textureComponentCount[format] == 3) ? GL_RGB : GL_RGBA;
+#ifdef GL_BGR
+    if (format == TextureFormat::BGR8)
+        glFormat = GL_BGR;
+    else if (format == TextureFormat::BGRA8)
+        glFormat = GL_BGRA;
+#endif
+    switch (format)
+    {
+        case TextureFormat::RGB16:
+        case TextureFormat::RGBA16:
+            glType = GL_UNSIGNED_SHORT;
+            break;
+        case TextureFormat::RGB16F:
+        case TextureFormat::RGBA16F:
+            glType = GL_HALF_FLOAT;
+            break;
+        case TextureFormat::RGB32F:
+        case TextureFormat::RGBA32F:
+            glType = GL_FLOAT;
+            break;
+        default:
+            glType = GL_UNSIGNED_BYTE;
+            break;
+    }
+}
+
 const unsigned int glCubeFace[] = {
     GL_TEXTURE_CUBE_MAP_POSITIVE_X,
     GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
@@ -120,8 +123,6 @@ const unsigned int glCubeFace[] = {
     GL_TEXTURE_CUBE_MAP_POSITIVE_Z,
     GL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
 };
-const unsigned int textureFormatSize[] = {3, 3, 6, 6, 12, 4, 4, 4, 8, 8, 16, 4};
-const unsigned int textureComponentCount[] = {3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4};
 
 void SaveCapture(const std::string& filemane, int x, int y, int w, int h)
 {
@@ -147,22 +148,22 @@ Image Image::DecodeImage(FFMPEGCodec::Decoder* decoder, int frame)
     image.mDecoder = decoder;
     image.mNumMips = 1;
     image.mNumFaces = 1;
-    image.mFormat = TextureFormat::BGR8;
+    image.mFormat = TextureFormat::RGBA8;
     image.mWidth = int(decoder->mWidth);
     image.mHeight = int(decoder->mHeight);
-    size_t lineSize = image.mWidth * 3;
-    size_t imgDataSize = lineSize * image.mHeight;
-    image.Allocate(imgDataSize);
+    image.Allocate(image.mWidth * image.mHeight * 4);
 
-    unsigned char* pdst = image.GetBits();
-    unsigned char* psrc = (unsigned char*)decoder->GetRGBData();
+    // BGR frames, flipped and expanded to RGBA8 row by row
+    unsigned char* pdst = image.GetWritableBits();
+    const unsigned char* psrc = (const unsigned char*)decoder->GetRGBData();
     if (psrc && pdst)
     {
-        psrc += imgDataSize - lineSize;
+        const size_t lineSize = image.mWidth * 3;
+        psrc += lineSize * (image.mHeight - 1);
         for (int j = 0; j < image.mHeight; j++)
         {
-            memcpy(pdst, psrc, lineSize);
-            pdst += lineSize;
+            PixelOps::ExpandRGBToRGBA(psrc, pdst, image.mWidth, true);
+            pdst += image.mWidth * 4;
             psrc -= lineSize;
         }
     }
@@ -182,14 +183,11 @@ int Image::LoadSVG(const char* filename, Image* image, float dpi)
     // Create rasterizer (can be used to render multiple images).
     NSVGrasterizer* rast = nsvgCreateRasterizer();
 
-    // Allocate memory for image
-    size_t imgSize = width * height * 4;
-    unsigned char* img = (unsigned char*)malloc(imgSize);
-
-    // Rasterize
-    nsvgRasterize(rast, svgImage, 0, 0, 1, img, width, height, width * 4);
+    // Rasterize in the image
+    image->DoFree();
+    image->Allocate(width * height * 4);
+    nsvgRasterize(rast, svgImage, 0, 0, 1, image->GetWritableBits(), width, height, width * 4);
 
-    image->SetBits(img, imgSize);
     image->mWidth = width;
     image->mHeight = height;
     image->mNumMips = 1;
@@ -197,25 +195,55 @@ int Image::LoadSVG(const char* filename, Image* image, float dpi)
     image->mFormat = TextureFormat::RGBA8;
     image->mDecoder = NULL;
 
-    Image::VFlip(image);
+    PixelOps::VFlip(image);
     nsvgDelete(svgImage);
     nsvgDeleteRasterizer(rast);
     return EVAL_OK;
 }
 
+// stb images keep their RGB8 or RGBA8 format, grey is expanded as there is no matching format
+static void SetStbiBits(Image* image, const unsigned char* bits, int components)
+{
+    const size_t texelCount = size_t(image->mWidth) * image->mHeight;
+    const int texelSize = (components == 1 || components == 3) ? 3 : 4;
+    image->DoFree();
+    image->Allocate(texelCount * texelSize);
+    unsigned char* pixels = image->GetWritableBits();
+    if (components == texelSize)
+    {
+        memcpy(pixels, bits, texelCount * texelSize);
+    }
+    else
+    {
+        for (size_t i = 0; i < texelCount; i++, bits += components, pixels += texelSize)
+        {
+            pixels[0] = pixels[1] = pixels[2] = bits[0];
+            if (components == 2)
+                pixels[3] = bits[1];
+        }
+    }
+    image->mNumMips = 1;
+    image->mNumFaces = 1;
+    image->mFormat = (texelSize == 3) ? TextureFormat::RGB8 : TextureFormat::RGBA8;
+}
+
 int Image::Read(const char* filename, Image* image)
 {
     std::string filenameStr(filename);
-    Image* cacheImage = gImageCache.GetImage(filenameStr);
-    if (cacheImage)
+    ImageCache::FileStamp stamp;
+    if (!ImageCache::GetFileStamp(filenameStr, stamp))
+        return EVAL_ERR;
+    if (gImageCache.GetImage(filenameStr, stamp, image))
     {
-        *image = *cacheImage;
         return EVAL_OK;
     }
-    FILE* fp = fopen(filename, "rb");
-    if (!fp)
-        return EVAL_ERR;
-    fclose(fp);
+    if (filenameStr.size() > 5 && !strcmp(filenameStr.c_str() + filenameStr.size() - 5, ".imtx"))
+    {
+        if (TextureContainer::Read(filename, image) != EVAL_OK)
+            return EVAL_ERR;
+        gImageCache.AddImage(filenameStr, stamp, image);
+        return EVAL_OK;
+    }
 
     int components;
     unsigned char* bits = stbi_load(filename, &image->mWidth, &image->mHeight, &components, 0);
@@ -234,17 +262,14 @@ int Image::Read(const char* filename, Image* image)
         image->mNumFaces = img.m_numFaces;
         image->mFormat = img.m_format;
         image->mDecoder = NULL;
-        gImageCache.AddImage(filenameStr, image);
+        gImageCache.AddImage(filenameStr, stamp, image);
         return EVAL_OK;
     }
 
-    image->SetBits(bits, image->mWidth * image->mHeight * components);
-    image->mNumMips = 1;
-    image->mNumFaces = 1;
-    image->mFormat = (components == 3) ? TextureFormat::RGB8 : TextureFormat::RGBA8;
+    SetStbiBits(image, bits, components);
     image->mDecoder = NULL;
     stbi_image_free(bits);
-    gImageCache.AddImage(filenameStr, image);
+    gImageCache.AddImage(filenameStr, stamp, image);
     return EVAL_OK;
 }
 
@@ -254,6 +279,22 @@ int Image::Free(Image* image)
     return EVAL_OK;
 }
 
+int Image::Acquire(Image* source, Image* destination)
+{
+    if (!source || !destination)
+        return EVAL_ERR;
+    *destination = *source;
+    return EVAL_OK;
+}
+
+int Image::MakeWritable(Image* image)
+{
+    if (!image || !image->GetBits())
+        return EVAL_ERR;
+    image->GetWritableBits();
+    return EVAL_OK;
+}
+
 unsigned int Image::Upload(Image* image, unsigned int textureId, int cubeFace)
 {
     if (!textureId)
@@ -262,7 +303,17 @@ unsigned int Image::Upload(Image* image, unsigned int textureId, int cubeFace)
     unsigned int targetType = (cubeFace == -1) ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
     glBindTexture(targetType, textureId);
 
-    unsigned int inputFormat = glInputFormats[image->mFormat];
+    // 3 bytes texels rows are not 4 bytes aligned: expanded on a copy, the image keeps its format
+    Image expanded;
+    if (image->mFormat == TextureFormat::RGB8 || image->mFormat == TextureFormat::BGR8)
+    {
+        expanded = *image;
+        PixelOps::ExpandRGBToRGBA(&expanded);
+        image = &expanded;
+    }
+
+    unsigned int inputFormat, inputType;
+    GetGLPixelFormat(image->mFormat, inputFormat, inputType);
     unsigned int internalFormat = glInternalFormats[image->mFormat];
     glTexImage2D((cubeFace == -1) ? GL_TEXTURE_2D : glCubeFace[cubeFace],
                  0,
@@ -271,7 +322,7 @@ unsigned int Image::Upload(Image* image, unsigned int textureId, int cubeFace)
                  image->mHeight,
                  0,
                  inputFormat,
-                 GL_UNSIGNED_BYTE,
+                 inputType,
                  image->GetBits());
     TexParam(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, targetType);
 
@@ -285,29 +336,29 @@ int Image::ReadMem(unsigned char* data, size_t dataSize, Image* image)
     unsigned char* bits = stbi_load_from_memory(data, int(dataSize), &image->mWidth, &image->mHeight, &components, 0);
     if (!bits)
         return EVAL_ERR;
-    image->SetBits(bits, image->mWidth * image->mHeight * components);
+    SetStbiBits(image, bits, components);
+    image->mDecoder = NULL;
     stbi_image_free(bits);
     return EVAL_OK;
 }
 
 void Image::VFlip(Image* image)
 {
-    int pixelSize = (image->mFormat == TextureFormat::RGB8) ? 3 : 4;
-    int stride = image->mWidth * pixelSize;
-    for (int y = 0; y < image->mHeight / 2; y++)
-    {
-        for (int x = 0; x < stride; x++)
-        {
-            unsigned char* p1 = &image->GetBits()[y * stride + x];
-            unsigned char* p2 = &image->GetBits()[(image->mHeight - 1 - y) * stride + x];
-            Swap(*p1, *p2);
-        }
-    }
+    PixelOps::VFlip(image);
 }
 
 int Image::Write(const char* filename, Image* image, int format, int quality)
 {
     int components = textureComponentCount[image->mFormat];
+    // stb writers take RGB8 or RGBA8
+    Image converted;
+    if (format <= 3 && image->mFormat != TextureFormat::RGB8 && image->mFormat != TextureFormat::RGBA8)
+    {
+        converted = *image;
+        if (PixelOps::Convert(&converted, (components == 3) ? TextureFormat::RGB8 : TextureFormat::RGBA8) != EVAL_OK)
+            return EVAL_ERR;
+        image = &converted;
+    }
     switch (format)
     {
         case 0:
@@ -339,13 +390,17 @@ int Image::Write(const char* filename, Image* image, int format, int quality)
             img.m_height = image->mHeight;
             img.m_numFaces = image->mNumFaces;
             img.m_numMips = image->mNumMips;
-            img.m_data = image->GetBits();
+            img.m_data = (void*)image->GetBits();
             img.m_dataSize = image->mDataSize;
-            if (img.m_format == cmft::TextureFormat::RGBA8)
-                cmft::imageConvert(img, cmft::TextureFormat::BGRA8);
-            else if (img.m_format == cmft::TextureFormat::RGB8)
-                cmft::imageConvert(img, cmft::TextureFormat::BGR8);
-            image->SetBits((unsigned char*)img.m_data, img.m_dataSize);
+            // DDS is written BGR, on a copy so the image keeps its bits
+            if (image->mFormat == TextureFormat::RGBA8 || image->mFormat == TextureFormat::RGB8)
+            {
+                converted = *image;
+                PixelOps::Convert(&converted,
+                                  (image->mFormat == TextureFormat::RGBA8) ? TextureFormat::BGRA8 : TextureFormat::BGR8);
+                img.m_format = (cmft::TextureFormat::Enum)converted.mFormat;
+                img.m_data = (void*)converted.GetBits();
+            }
             if (!cmft::imageSave(img, filename, cmft::ImageFileType::DDS))
                 return EVAL_ERR;
         }
@@ -358,7 +413,7 @@ int Image::Write(const char* filename, Image* image, int format, int quality)
             img.m_height = image->mHeight;
             img.m_numFaces = image->mNumFaces;
             img.m_numMips = image->mNumMips;
-            img.m_data = image->GetBits();
+            img.m_data = (void*)image->GetBits();
             img.m_dataSize = image->mDataSize;
             if (!cmft::imageSave(img, filename, cmft::ImageFileType::KTX))
                 return EVAL_ERR;
@@ -378,7 +433,7 @@ int Image::EncodePng(Image* image, std::vector<unsigned char>& pngImage)
     int outlen;
     int components = 4; // TODO
     unsigned char* bits = stbi_write_png_to_mem(
-        image->GetBits(), image->mWidth * components, image->mWidth, image->mHeight, components, &outlen);
+        (unsigned char*)image->GetBits(), image->mWidth * components, image->mWidth, image->mHeight, components, &outlen);
     if (!bits)
         return EVAL_ERR;
     pngImage.resize(outlen);
@@ -388,11 +443,280 @@ int Image::EncodePng(Image* image, std::vector<unsigned char>& pngImage)
     return EVAL_OK;
 }
 
+static void PutLE16(unsigned char* ptr, uint32_t value)
+{
+    ptr[0] = value & 0xFF;
+    ptr[1] = (value >> 8) & 0xFF;
+}
+
+static void PutLE32(unsigned char* ptr, uint32_t value)
+{
+    PutLE16(ptr, value & 0xFFFF);
+    PutLE16(ptr + 2, value >> 16);
+}
+
+static void PutBE32(unsigned char* ptr, uint32_t value)
+{
+    ptr[0] = (value >> 24) & 0xFF;
+    ptr[1] = (value >> 16) & 0xFF;
+    ptr[2] = (value >> 8) & 0xFF;
+    ptr[3] = value & 0xFF;
+}
+
+static uint32_t Adler32(uint32_t adler, const unsigned char* data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size)
+    {
+        // largest run before the sums can overflow
+        size_t count = std::min(size, size_t(5552));
+        size -= count;
+        for (; count; count--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+ImageBandWriter::~ImageBandWriter()
+{
+    if (mFile)
+    {
+        fclose(mFile);
+    }
+}
+
+int ImageBandWriter::Open(const char* filename, int format, int quality, int width, int height)
+{
+    mFilename = filename;
+    mFormat = format;
+    mQuality = quality;
+    mWidth = width;
+    mHeight = height;
+    mRowsWritten = 0;
+    mAdler = 1;
+
+    if (format < 1 || format > 3)
+    {
+        // not streamable, keep the whole image until Close
+        mImage.mWidth = width;
+        mImage.mHeight = height;
+        mImage.mNumMips = 1;
+        mImage.mNumFaces = 1;
+        mImage.mFormat = TextureFormat::RGBA8;
+        mImage.Allocate(size_t(width) * height * 4);
+        return mImage.GetBits() ? EVAL_OK : EVAL_ERR;
+    }
+    if (format == 2 && (width > 0xFFFF || height > 0xFFFF))
+    {
+        Log("Image too big for TGA format (%d x %d).\n", width, height);
+        return EVAL_ERR;
+    }
+
+    mFile = fopen(filename, "wb");
+    if (!mFile)
+    {
+        return EVAL_ERR;
+    }
+
+    switch (format)
+    {
+        case 1:
+        {
+            static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+            fwrite(signature, sizeof(signature), 1, mFile);
+            unsigned char header[4 + 13] = {'I', 'H', 'D', 'R'};
+            PutBE32(header + 4, width);
+            PutBE32(header + 8, height);
+            header[12] = 8; // bit depth
+            header[13] = 6; // RGBA
+            WritePNGChunk(header, sizeof(header));
+            // zlib stream without compression: rows are written in stored blocks
+            unsigned char zlibHeader[4 + 2] = {'I', 'D', 'A', 'T', 0x78, 0x01};
+            WritePNGChunk(zlibHeader, sizeof(zlibHeader));
+        }
+        break;
+        case 2:
+        {
+            unsigned char header[18] = {0};
+            header[2] = 2; // uncompressed true color
+            PutLE16(header + 12, width);
+            PutLE16(header + 14, height);
+            header[16] = 32;
+            header[17] = 0x28; // 8 alpha bits, top-left origin
+            fwrite(header, sizeof(header), 1, mFile);
+        }
+        break;
+        case 3:
+        {
+            // 24 bits top-down bitmap
+            const uint64_t pitch = (uint64_t(width) * 3 + 3) & ~3;
+            unsigned char header[54] = {'B', 'M'};
+            PutLE32(header + 2, uint32_t(std::min(uint64_t(54) + pitch * height, uint64_t(0xFFFFFFFF))));
+            PutLE32(header + 10, 54);
+            PutLE32(header + 14, 40);
+            PutLE32(header + 18, width);
+            PutLE32(header + 22, uint32_t(-height));
+            PutLE16(header + 26, 1);
+            PutLE16(header + 28, 24);
+            fwrite(header, sizeof(header), 1, mFile);
+        }
+        break;
+    }
+    return ferror(mFile) ? EVAL_ERR : EVAL_OK;
+}
+
+int ImageBandWriter::WriteRows(const unsigned char* rows, int rowCount)
+{
+    if (mRowsWritten + rowCount > mHeight)
+    {
+        return EVAL_ERR;
+    }
+    const size_t rowSize = size_t(mWidth) * 4;
+    if (!mFile)
+    {
+        if (!mImage.GetBits())
+        {
+            return EVAL_ERR;
+        }
+        memcpy(mImage.GetWritableBits() + rowSize * mRowsWritten, rows, rowSize * rowCount);
+        mRowsWritten += rowCount;
+        return EVAL_OK;
+    }
+
+    switch (mFormat)
+    {
+        case 1:
+        {
+            // filter type 0 then the row. split in stored deflate blocks
+            const size_t filteredSize = (rowSize + 1) * rowCount;
+            const size_t maxBlockSize = 0xFFFF;
+            const size_t blockCount = (filteredSize + maxBlockSize - 1) / maxBlockSize;
+            mScratch.resize(4 + filteredSize + blockCount * 5);
+            memcpy(mScratch.data(), "IDAT", 4);
+            unsigned char* ptr = mScratch.data() + 4;
+            size_t blockRemaining = 0;
+            size_t payloadRemaining = filteredSize;
+            auto put = [&](const unsigned char* data, size_t size) {
+                while (size)
+                {
+                    if (!blockRemaining)
+                    {
+                        blockRemaining = std::min(maxBlockSize, payloadRemaining);
+                        payloadRemaining -= blockRemaining;
+                        ptr[0] = 0;
+                        PutLE16(ptr + 1, uint32_t(blockRemaining));
+                        PutLE16(ptr + 3, uint32_t(~blockRemaining & 0xFFFF));
+                        ptr += 5;
+                    }
+                    size_t count = std::min(size, blockRemaining);
+                    memcpy(ptr, data, count);
+                    mAdler = Adler32(mAdler, data, count);
+                    ptr += count;
+                    data += count;
+                    size -= count;
+                    blockRemaining -= count;
+                }
+            };
+            static const unsigned char filterType = 0;
+            for (int row = 0; row < rowCount; row++)
+            {
+                put(&filterType, 1);
+                put(rows + row * rowSize, rowSize);
+            }
+            WritePNGChunk(mScratch.data(), mScratch.size());
+        }
+        break;
+        case 2:
+        {
+            mScratch.resize(rowSize * rowCount);
+            for (size_t i = 0; i < mScratch.size(); i += 4)
+            {
+                mScratch[i] = rows[i + 2];
+                mScratch[i + 1] = rows[i + 1];
+                mScratch[i + 2] = rows[i];
+                mScratch[i + 3] = rows[i + 3];
+            }
+            fwrite(mScratch.data(), mScratch.size(), 1, mFile);
+        }
+        break;
+        case 3:
+        {
+            const size_t pitch = (size_t(mWidth) * 3 + 3) & ~3;
+            mScratch.resize(pitch * rowCount);
+            memset(mScratch.data(), 0, mScratch.size());
+            for (int row = 0; row < rowCount; row++)
+            {
+                const unsigned char* src = rows + row * rowSize;
+                unsigned char* dst = mScratch.data() + row * pitch;
+                for (int x = 0; x < mWidth; x++, src += 4, dst += 3)
+                {
+                    dst[0] = src[2];
+                    dst[1] = src[1];
+                    dst[2] = src[0];
+                }
+            }
+            fwrite(mScratch.data(), mScratch.size(), 1, mFile);
+        }
+        break;
+    }
+    mRowsWritten += rowCount;
+    return ferror(mFile) ? EVAL_ERR : EVAL_OK;
+}
+
+int ImageBandWriter::Close()
+{
+    int res = (mRowsWritten == mHeight) ? EVAL_OK : EVAL_ERR;
+    if (!mFile)
+    {
+        if (res == EVAL_OK)
+        {
+            res = Image::Write(mFilename.c_str(), &mImage, mFormat, mQuality);
+        }
+        mImage.DoFree();
+        return res;
+    }
+    if (mFormat == 1)
+    {
+        // empty final block and stream checksum
+        unsigned char end[4 + 9] = {'I', 'D', 'A', 'T', 1, 0, 0, 0xFF, 0xFF};
+        PutBE32(end + 9, mAdler);
+        WritePNGChunk(end, sizeof(end));
+        unsigned char iend[4] = {'I', 'E', 'N', 'D'};
+        WritePNGChunk(iend, sizeof(iend));
+    }
+    if (ferror(mFile))
+    {
+        res = EVAL_ERR;
+    }
+    fclose(mFile);
+    mFile = NULL;
+    mScratch = std::vector<unsigned char>();
+    return res;
+}
+
+void ImageBandWriter::WritePNGChunk(const unsigned char* typeAndData, size_t size)
+{
+    unsigned char length[4];
+    unsigned char crc[4];
+    PutBE32(length, uint32_t(size - 4));
+    PutBE32(crc, stbiw__crc32(const_cast<unsigned char*>(typeAndData), int(size)));
+    fwrite(length, sizeof(length), 1, mFile);
+    fwrite(typeAndData, size, 1, mFile);
+    fwrite(crc, sizeof(crc), 1, mFile);
+}
+
 void DefaultShaders::Init()
 {
     std::ifstream prgStr("Stock/ProgressingNode.glsl");
     std::ifstream cubStr("Stock/DisplayCubemap.glsl");
     std::ifstream nodeErrStr("Stock/NodeError.glsl");
+    std::ifstream convergenceStr("Stock/Convergence.glsl");
 
     mProgressShader =
         prgStr.good()
@@ -409,48 +733,269 @@ void DefaultShaders::Init()
             ? LoadShader(std::string(std::istreambuf_iterator<char>(nodeErrStr), std::istreambuf_iterator<char>()),
                          "nodeError")
             : 0;
+    mConvergenceShader =
+        convergenceStr.good()
+            ? LoadShader(std::string(std::istreambuf_iterator<char>(convergenceStr), std::istreambuf_iterator<char>()),
+                         "convergence")
+            : 0;
+
+    // uniforms that don't change or are set every frame
+    mProgressTimeLocation = mProgressShader ? glGetUniformLocation(mProgressShader, "time") : -1;
+    if (mDisplayCubemapShader)
+    {
+        glUseProgram(mDisplayCubemapShader);
+        glUniform1i(glGetUniformLocation(mDisplayCubemapShader, "samplerCubemap"), 0);
+        glUseProgram(0);
+    }
+    mConvergenceEpsilonLocation = mConvergenceShader ? glGetUniformLocation(mConvergenceShader, "epsilon") : -1;
+    if (mConvergenceShader)
+    {
+        glUseProgram(mConvergenceShader);
+        glUniform1i(glGetUniformLocation(mConvergenceShader, "currentSampler"), 0);
+        glUniform1i(glGetUniformLocation(mConvergenceShader, "previousSampler"), 1);
+        glUseProgram(0);
+    }
+}
+
+ImageCache::ImageCache()
+    : mCPUUsage(0)
+    , mCPUBudget(512 * 1024 * 1024)
+    , mGPUUsage(0)
+    , mGPUBudget(256 * 1024 * 1024)
+    , mFrame(0)
+    , mAccessCounter(0)
+    , mHitCount(0)
+    , mMissCount(0)
+    , mEvictionCount(0)
+    , mInvalidationCount(0)
+{
+}
+
+bool ImageCache::GetFileStamp(const std::string& filepath, FileStamp& stamp)
+{
+    struct stat status;
+    if (stat(filepath.c_str(), &status) != 0)
+        return false;
+    stamp.mSize = uint64_t(status.st_size);
+    stamp.mTime = int64_t(status.st_mtime);
+    return true;
 }
 
-unsigned int ImageCache::GetTexture(const std::string& filename)
+unsigned int ImageCache::GetTexture(const std::string& filename, bool pinned)
 {
-    auto iter = mSynchronousTextureCache.find(filename);
-    if (iter != mSynchronousTextureCache.end())
-        return iter->second;
+    FileStamp stamp = {0, 0};
+    auto iter = mTextures.find(filename);
+    if (iter != mTextures.end())
+    {
+        // UI asks for the same textures every frame, the file is not stat'ed each time
+        TextureEntry& entry = iter->second;
+        bool changed = false;
+        if (mFrame >= entry.mStampFrame + StampCheckFrames)
+        {
+            entry.mStampFrame = mFrame;
+            // missing files keep their texture
+            changed = GetFileStamp(filename, stamp) && !(entry.mStamp == stamp);
+        }
+        if (!changed)
+        {
+            entry.mLastFrame = mFrame;
+            entry.mbPinned |= pinned;
+            return entry.mTextureId;
+        }
+        mInvalidationCount++;
+        RemoveTexture(iter);
+    }
+    else
+    {
+        GetFileStamp(filename, stamp);
+    }
 
     Image image;
     unsigned int textureId = 0;
+    size_t size = 0;
     if (Image::Read(filename.c_str(), &image) == EVAL_OK)
     {
         textureId = Image::Upload(&image, 0);
+        size = image.mDataSize;
         Image::Free(&image);
     }
 
-    mSynchronousTextureCache[filename] = textureId;
+    mTextures[filename] = {textureId, stamp, size, mFrame, mFrame, pinned};
+    mGPUUsage += size;
     return textureId;
 }
 
-Image* ImageCache::GetImage(const std::string& filepath)
+bool ImageCache::GetImage(const std::string& filepath, const FileStamp& stamp, Image* image)
+{
+    Shard& shard = GetShard(filepath);
+    std::lock_guard<std::mutex> lock(shard.mAccess);
+    auto iter = shard.mImages.find(filepath);
+    if (iter != shard.mImages.end())
+    {
+        if (iter->second.mStamp == stamp)
+        {
+            // shares the cached bits
+            *image = iter->second.mImage;
+            iter->second.mLastAccess = ++mAccessCounter;
+            shard.mLRU.splice(shard.mLRU.begin(), shard.mLRU, iter->second.mLRU);
+            mHitCount++;
+            return true;
+        }
+        RemoveImage(shard, iter);
+        mInvalidationCount++;
+    }
+    mMissCount++;
+    return false;
+}
+
+void ImageCache::AddImage(const std::string& filepath, const FileStamp& stamp, Image* image)
+{
+    if (image->mDataSize > mCPUBudget)
+        return;
+    {
+        Shard& shard = GetShard(filepath);
+        std::lock_guard<std::mutex> lock(shard.mAccess);
+        auto iter = shard.mImages.find(filepath);
+        if (iter != shard.mImages.end())
+        {
+            // read by another job meanwhile
+            if (iter->second.mStamp == stamp)
+                return;
+            RemoveImage(shard, iter);
+        }
+        shard.mLRU.push_front(filepath);
+        ImageEntry& entry = shard.mImages[filepath];
+        entry.mImage = *image;
+        entry.mStamp = stamp;
+        entry.mLastAccess = ++mAccessCounter;
+        entry.mLRU = shard.mLRU.begin();
+        mCPUUsage += image->mDataSize;
+    }
+    EvictImages();
+}
+
+ImageCache::Shard& ImageCache::GetShard(const std::string& filepath)
+{
+    return mShards[std::hash<std::string>()(filepath) % ShardCount];
+}
+
+void ImageCache::RemoveImage(Shard& shard, std::map<std::string, ImageEntry>::iterator iter)
+{
+    mCPUUsage -= iter->second.mImage.mDataSize;
+    shard.mLRU.erase(iter->second.mLRU);
+    shard.mImages.erase(iter);
+}
+
+void ImageCache::EvictImages()
+{
+    // shards are locked one at a time: find the shard with the oldest tail then evict it if still the oldest
+    while (mCPUUsage > mCPUBudget)
+    {
+        Shard* oldestShard = NULL;
+        uint64_t oldestAccess = UINT64_MAX;
+        for (auto& shard : mShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mAccess);
+            if (shard.mLRU.empty())
+                continue;
+            const ImageEntry& tail = shard.mImages.find(shard.mLRU.back())->second;
+            if (tail.mLastAccess < oldestAccess)
+            {
+                oldestAccess = tail.mLastAccess;
+                oldestShard = &shard;
+            }
+        }
+        if (!oldestShard)
+            return;
+        std::lock_guard<std::mutex> lock(oldestShard->mAccess);
+        if (oldestShard->mLRU.empty())
+            continue;
+        auto iter = oldestShard->mImages.find(oldestShard->mLRU.back());
+        if (iter->second.mLastAccess == oldestAccess)
+        {
+            RemoveImage(*oldestShard, iter);
+            mEvictionCount++;
+        }
+    }
+}
+
+void ImageCache::Update()
+{
+    EvictTextures(mGPUBudget, mFrame);
+    mFrame++;
+}
+
+void ImageCache::EvictTextures(size_t budget, uint64_t usedFrame)
 {
-    Image* ret = NULL;
-    mCacheAccess.lock();
-    auto iter = mImageCache.find(filepath);
-    if (iter != mImageCache.end())
+    while (mGPUUsage > budget)
     {
-        ret = &iter->second;
+        auto oldest = mTextures.end();
+        for (auto iter = mTextures.begin(); iter != mTextures.end(); ++iter)
+        {
+            if (iter->second.mbPinned || iter->second.mLastFrame >= usedFrame)
+                continue;
+            if (oldest == mTextures.end() || iter->second.mLastFrame < oldest->second.mLastFrame)
+                oldest = iter;
+        }
+        if (oldest == mTextures.end())
+            return;
+        RemoveTexture(oldest);
+        mEvictionCount++;
     }
-    mCacheAccess.unlock();
-    return ret;
 }
 
-void ImageCache::AddImage(const std::string& filepath, Image* image)
+void ImageCache::RemoveTexture(std::map<std::string, TextureEntry>::iterator iter)
 {
-    mCacheAccess.lock();
-    auto iter = mImageCache.find(filepath);
-    if (iter == mImageCache.end())
+    if (iter->second.mTextureId)
+        glDeleteTextures(1, &iter->second.mTextureId);
+    mGPUUsage -= iter->second.mSize;
+    mTextures.erase(iter);
+}
+
+void ImageCache::Clear()
+{
+    for (auto& shard : mShards)
     {
-        mImageCache.insert(std::make_pair(filepath, *image));
+        std::lock_guard<std::mutex> lock(shard.mAccess);
+        for (auto& image : shard.mImages)
+            mCPUUsage -= image.second.mImage.mDataSize;
+        shard.mImages.clear();
+        shard.mLRU.clear();
     }
-    mCacheAccess.unlock();
+    // textures used during this frame can still be drawn
+    EvictTextures(0, mFrame);
+}
+
+void ImageCache::SetCPUBudget(size_t budget)
+{
+    mCPUBudget = budget;
+    EvictImages();
+}
+
+void ImageCache::SetGPUBudget(size_t budget)
+{
+    mGPUBudget = budget;
+}
+
+ImageCacheStats ImageCache::GetStats()
+{
+    ImageCacheStats stats;
+    stats.mImageCount = 0;
+    for (auto& shard : mShards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mAccess);
+        stats.mImageCount += shard.mImages.size();
+    }
+    stats.mCPUUsage = mCPUUsage;
+    stats.mCPUBudget = mCPUBudget;
+    stats.mTextureCount = mTextures.size();
+    stats.mGPUUsage = mGPUUsage;
+    stats.mGPUBudget = mGPUBudget;
+    stats.mHitCount = mHitCount;
+    stats.mMissCount = mMissCount;
+    stats.mEvictionCount = mEvictionCount;
+    stats.mInvalidationCount = mInvalidationCount;
+    return stats;
 }
 
 void RenderTarget::BindAsTarget() const
@@ -472,6 +1017,37 @@ void RenderTarget::BindCubeFace(size_t face, int mipmap, int faceWidth)
     glViewport(0, 0, faceWidth >> mipmap, faceWidth >> mipmap);
 }
 
+static const GLenum cubeFaceDrawBuffers[] = {GL_COLOR_ATTACHMENT0,
+                                             GL_COLOR_ATTACHMENT1,
+                                             GL_COLOR_ATTACHMENT2,
+                                             GL_COLOR_ATTACHMENT3,
+                                             GL_COLOR_ATTACHMENT4,
+                                             GL_COLOR_ATTACHMENT5};
+
+void RenderTarget::BindCubeFaces(int mipmap, int faceWidth)
+{
+    for (int face = 0; face < 6; face++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER,
+                               GLenum(GL_COLOR_ATTACHMENT0 + face),
+                               GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face),
+                               mGLTexID,
+                               mipmap);
+    }
+    glDrawBuffers(6, cubeFaceDrawBuffers);
+    glViewport(0, 0, faceWidth >> mipmap, faceWidth >> mipmap);
+}
+
+void RenderTarget::UnbindCubeFaces()
+{
+    // back to the single face binding of BindCubeFace
+    for (int face = 1; face < 6; face++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GLenum(GL_COLOR_ATTACHMENT0 + face), GL_TEXTURE_2D, 0, 0);
+    }
+    glDrawBuffers(1, cubeFaceDrawBuffers);
+}
+
 void RenderTarget::Destroy()
 {
     if (mGLTexID)
@@ -26,11 +26,15 @@
 #pragma once
 #include <string>
 #include <map>
+#include <list>
 #include <vector>
 #include <string.h>
 #include <mutex>
 #include <memory>
+#include <atomic>
+#include <new>
 #include <stdlib.h>
+#include <stdio.h>
 
 #if USE_FFMPEG
 namespace FFMPEGCodec
@@ -62,6 +66,13 @@ struct TextureFormat
     };
 };
 
+// pixels are preceded by this header. Image copies share the pixels, they are duplicated on write
+struct PixelBufferHeader
+{
+    std::atomic<uint32_t> mRefCount;
+    uint32_t mPadding[3]; // pixels stay 16 bytes aligned
+};
+
 struct Image
 {
     Image() : mDecoder(NULL), mWidth(0), mHeight(0), mNumMips(0), mNumFaces(0), mBits(NULL), mDataSize(0)
@@ -73,7 +84,7 @@ struct Image
     }
     ~Image()
     {
-        free(mBits);
+        DoFree();
     }
 
     void* mDecoder;
@@ -90,35 +101,103 @@ struct Image
         mNumMips = other.mNumMips;
         mNumFaces = other.mNumFaces;
         mFormat = other.mFormat;
-        SetBits(other.mBits, other.mDataSize);
+        ShareBits(other);
         return *this;
     }
-    unsigned char* GetBits() const
+    // read only, the pixels may be shared with other images
+    const unsigned char* GetBits() const
     {
         return mBits;
     }
-    void SetBits(unsigned char* bits, size_t size)
+    // makes the pixels unique to this image
+    unsigned char* GetWritableBits()
+    {
+        if (mBits && IsShared())
+        {
+            unsigned char* bits = mBits;
+            mBits = AllocateBuffer(mDataSize);
+            memcpy(mBits, bits, mDataSize);
+            ReleaseBuffer(bits);
+        }
+        return mBits;
+    }
+    bool IsShared() const
+    {
+        return mBits && GetHeader(mBits)->mRefCount.load(std::memory_order_acquire) > 1;
+    }
+    void SetBits(const unsigned char* bits, size_t size)
     {
         Allocate(size);
         memcpy(mBits, bits, size);
     }
+    // pixels are undefined
     void Allocate(size_t size)
     {
-        if (mBits && mDataSize != size)
-            free(mBits);
+        if (mBits && mDataSize == size && !IsShared())
+            return;
+        DoFree();
         if (size)
-            mBits = (unsigned char*)malloc(size);
+            mBits = AllocateBuffer(size);
+        mDataSize = uint32_t(size);
+    }
+    // keeps the pixels up to the new size
+    void Reallocate(size_t size)
+    {
+        if (mBits && !IsShared())
+        {
+            PixelBufferHeader* header = (PixelBufferHeader*)realloc(GetHeader(mBits), sizeof(PixelBufferHeader) + size);
+            mBits = (unsigned char*)(header + 1);
+        }
+        else
+        {
+            unsigned char* bits = mBits;
+            mBits = AllocateBuffer(size);
+            if (bits)
+            {
+                memcpy(mBits, bits, (size < mDataSize) ? size : mDataSize);
+                ReleaseBuffer(bits);
+            }
+        }
         mDataSize = uint32_t(size);
     }
+    // O(1), both images use the same pixels
+    void ShareBits(const Image& other)
+    {
+        if (other.mBits == mBits)
+            return;
+        if (other.mBits)
+            GetHeader(other.mBits)->mRefCount.fetch_add(1, std::memory_order_relaxed);
+        DoFree();
+        mBits = other.mBits;
+        mDataSize = other.mDataSize;
+    }
     void DoFree()
     {
-        free(mBits);
+        if (mBits)
+            ReleaseBuffer(mBits);
         mBits = NULL;
         mDataSize = 0;
     }
+    // pixels owned by the caller (python buffer), not ref counted: the image must not be copied
+    // and the pixels are Released before the image is destroyed
+    void Attach(unsigned char* bits, size_t size)
+    {
+        DoFree();
+        mBits = bits;
+        mDataSize = uint32_t(size);
+    }
+    unsigned char* Release()
+    {
+        unsigned char* bits = mBits;
+        mBits = NULL;
+        mDataSize = 0;
+        return bits;
+    }
 
     static int Read(const char* filename, Image* image);
     static int Free(Image* image);
+    static int Acquire(Image* source, Image* destination);
+    static int MakeWritable(Image* image);
     static unsigned int Upload(Image* image, unsigned int textureId, int cubeFace = -1);
     static int LoadSVG(const char* filename, Image* image, float dpi);
     static int ReadMem(unsigned char* data, size_t dataSize, Image* image);
@@ -129,25 +208,156 @@ struct Image
     static Image DecodeImage(FFMPEGCodec::Decoder* decoder, int frame);
 #endif
 protected:
+    static PixelBufferHeader* GetHeader(unsigned char* bits)
+    {
+        return ((PixelBufferHeader*)bits) - 1;
+    }
+    static unsigned char* AllocateBuffer(size_t size)
+    {
+        PixelBufferHeader* header = (PixelBufferHeader*)malloc(sizeof(PixelBufferHeader) + size);
+        new (&header->mRefCount) std::atomic<uint32_t>(1);
+        return (unsigned char*)(header + 1);
+    }
+    static void ReleaseBuffer(unsigned char* bits)
+    {
+        PixelBufferHeader* header = GetHeader(bits);
+        if (header->mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            free(header);
+    }
+
     unsigned char* mBits;
 };
+static_assert(sizeof(PixelBufferHeader) == 16, "pixels must stay 16 bytes aligned");
+
+// writes RGBA8 images row band by row band, for images too big to be held in memory.
+// tga, bmp and png (uncompressed) are streamed, other formats are written when closing
+struct ImageBandWriter
+{
+    ImageBandWriter() : mFile(NULL), mFormat(0), mQuality(0), mWidth(0), mHeight(0), mRowsWritten(0), mAdler(1)
+    {
+    }
+    ~ImageBandWriter();
+
+    int Open(const char* filename, int format, int quality, int width, int height);
+    int WriteRows(const unsigned char* rows, int rowCount);
+    int Close();
+
+protected:
+    // typeAndData starts with the 4 characters chunk type
+    void WritePNGChunk(const unsigned char* typeAndData, size_t size);
+
+    FILE* mFile;
+    std::string mFilename;
+    int mFormat;
+    int mQuality;
+    int mWidth;
+    int mHeight;
+    int mRowsWritten;
+    uint32_t mAdler;
+    Image mImage;
+    std::vector<unsigned char> mScratch;
+};
 
 extern const unsigned int glInternalFormats[];
-extern const unsigned int glInputFormats[];
+// pixel transfer format and type of a TextureFormat, for texture uploads and readbacks
+void GetGLPixelFormat(int format, unsigned int& glFormat, unsigned int& glType);
 extern const unsigned int textureFormatSize[];
+extern const unsigned int textureComponentCount[];
+
+struct ImageCacheStats
+{
+    size_t mImageCount;
+    size_t mCPUUsage;
+    size_t mCPUBudget;
+    size_t mTextureCount;
+    size_t mGPUUsage;
+    size_t mGPUBudget;
+    uint64_t mHitCount;
+    uint64_t mMissCount;
+    uint64_t mEvictionCount;
+    // entries dropped because their file changed
+    uint64_t mInvalidationCount;
+};
 
+// Cache of images read from files and of their textures, least recently used entries are evicted
+// over the CPU and GPU budgets. Entries are checked against the file size and modification time,
+// at most once every StampCheckFrames frames for textures.
+// Images are sharded by path so parallel reads don't wait on each other. Textures are main thread only.
 struct ImageCache
 {
+    ImageCache();
+
+    struct FileStamp
+    {
+        uint64_t mSize;
+        int64_t mTime;
+        bool operator==(const FileStamp& other) const
+        {
+            return mSize == other.mSize && mTime == other.mTime;
+        }
+    };
+    static bool GetFileStamp(const std::string& filepath, FileStamp& stamp);
+
     // synchronous texture cache
     // use for simple textures(stock) or to replace with a more efficient one
-    unsigned int GetTexture(const std::string& filename);
-    Image* GetImage(const std::string& filepath);
-    void AddImage(const std::string& filepath, Image* image);
+    // pinned textures are never evicted, for texture ids kept across frames
+    unsigned int GetTexture(const std::string& filename, bool pinned = false);
+    // image shares the cached pixels
+    bool GetImage(const std::string& filepath, const FileStamp& stamp, Image* image);
+    void AddImage(const std::string& filepath, const FileStamp& stamp, Image* image);
+    // once per frame, after rendering: textures over the budget and not used during the frame are deleted
+    void Update();
+    void Clear();
+
+    void SetCPUBudget(size_t budget);
+    void SetGPUBudget(size_t budget);
+    ImageCacheStats GetStats();
 
 protected:
-    std::map<std::string, unsigned int> mSynchronousTextureCache;
-    std::map<std::string, Image> mImageCache;
-    std::mutex mCacheAccess;
+    struct ImageEntry
+    {
+        Image mImage;
+        FileStamp mStamp;
+        uint64_t mLastAccess;
+        std::list<std::string>::iterator mLRU;
+    };
+    struct Shard
+    {
+        std::mutex mAccess;
+        std::map<std::string, ImageEntry> mImages;
+        // paths, most recently used first
+        std::list<std::string> mLRU;
+    };
+    struct TextureEntry
+    {
+        unsigned int mTextureId;
+        FileStamp mStamp;
+        size_t mSize;
+        uint64_t mLastFrame;
+        uint64_t mStampFrame;
+        bool mbPinned;
+    };
+    static const size_t ShardCount = 16;
+    static const uint64_t StampCheckFrames = 60;
+
+    Shard& GetShard(const std::string& filepath);
+    void RemoveImage(Shard& shard, std::map<std::string, ImageEntry>::iterator iter);
+    void EvictImages();
+    void EvictTextures(size_t budget, uint64_t usedFrame);
+    void RemoveTexture(std::map<std::string, TextureEntry>::iterator iter);
+
+    Shard mShards[ShardCount];
+    std::map<std::string, TextureEntry> mTextures;
+    std::atomic<size_t> mCPUUsage;
+    std::atomic<size_t> mCPUBudget;
+    size_t mGPUUsage;
+    size_t mGPUBudget;
+    uint64_t mFrame;
+    std::atomic<uint64_t> mAccessCounter;
+    std::atomic<uint64_t> mHitCount;
+    std::atomic<uint64_t> mMissCount;
+    std::atomic<uint64_t> mEvictionCount;
+    std::atomic<uint64_t> mInvalidationCount;
 };
 extern ImageCache gImageCache;
 
@@ -155,9 +365,13 @@ struct DefaultShaders
 {
     // ui callback shaders
     unsigned int mProgressShader;
+    int mProgressTimeLocation;
     unsigned int mDisplayCubemapShader;
     // error shader
     unsigned int mNodeErrorShader;
+    // multi-pass convergence test
+    unsigned int mConvergenceShader;
+    int mConvergenceEpsilonLocation;
 
     void Init();
 };
@@ -178,6 +392,9 @@ public:
     void BindAsTarget() const;
     void BindAsCubeTarget() const;
     void BindCubeFace(size_t face, int mipmap, int faceWidth);
+    // the 6 faces of a mip as draw buffers 0 to 5
+    void BindCubeFaces(int mipmap, int faceWidth);
+    void UnbindCubeFaces();
     void Destroy();
     void CheckFBO();
     void Clone(const RenderTarget& other);
@@ -25,9 +25,12 @@
 
 #include "Platform.h"
 #include <memory>
+#include <algorithm>
 #include "EvaluationContext.h"
 #include "Evaluators.h"
 #include "NodeGraphControler.h"
+#include "ResultCache.h"
+#include "FramePipeline.h"
 
 #ifdef GL_CLAMP_TO_BORDER
 static const unsigned int wrap[] = {GL_REPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_MIRRORED_REPEAT};
@@ -35,16 +38,6 @@ static const unsigned int wrap[] = {GL_REPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BOR
 static const unsigned int wrap[] = {GL_REPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_MIRRORED_REPEAT};
 #endif
 static const unsigned int filter[] = {GL_LINEAR, GL_NEAREST};
-static const char* sampler2DName[] = {
-    "Sampler0", "Sampler1", "Sampler2", "Sampler3", "Sampler4", "Sampler5", "Sampler6", "Sampler7"};
-static const char* samplerCubeName[] = {"CubeSampler0",
-                                        "CubeSampler1",
-                                        "CubeSampler2",
-                                        "CubeSampler3",
-                                        "CubeSampler4",
-                                        "CubeSampler5",
-                                        "CubeSampler6",
-                                        "CubeSampler7"};
 
 static const unsigned int GLBlends[] = {GL_ZERO,
                                         GL_ONE,
@@ -87,27 +80,27 @@ EvaluationContext::EvaluationContext(EvaluationStages& evaluation,
                                      int defaultWidth,
                                      int defaultHeight)
     : mEvaluationStages(evaluation)
+    , mFramePipeline(nullptr)
+    , mbUseResultCache(false)
+    , mbProgressivePreview(false)
+    , mLastInteraction(0)
+    , mProxyDivisor(2)
+    , mPreviewDivisor(1)
+    , mbParallelJobs(false)
+    , mDefaultWidth(defaultWidth)
+    , mDefaultHeight(defaultHeight)
 #ifdef __EMSCRIPTEN
     , mbSynchronousEvaluation(true)
 #else
     , mbSynchronousEvaluation(synchronousEvaluation)
 #endif
-    , mDefaultWidth(defaultWidth)
-    , mDefaultHeight(defaultHeight)
     , mRuntimeUniqueId(-1)
 {
+    memset(mTileWindow, 0, sizeof(mTileWindow));
     mFSQuad.Init();
 
-    // evaluation statedes
-    glGenBuffers(1, &mEvaluationStateGLSLBuffer);
-    glBindBuffer(GL_UNIFORM_BUFFER, mEvaluationStateGLSLBuffer);
-
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(EvaluationInfo), NULL, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 2, mEvaluationStateGLSLBuffer);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-    // parameters
-    glGenBuffers(1, &mParametersGLSLBuffer);
+    // evaluation states and parameters
+    mUniformArena.Init();
 }
 
 EvaluationContext::~EvaluationContext()
@@ -123,8 +116,8 @@ EvaluationContext::~EvaluationContext()
 #endif
     mFSQuad.Finish();
 
-    glDeleteBuffers(1, &mEvaluationStateGLSLBuffer);
-    glDeleteBuffers(1, &mParametersGLSLBuffer);
+    mUniformArena.Finish();
+    mProfiler.Finish();
 
     Clear();
 }
@@ -144,15 +137,26 @@ static void SetKeyboardMouseInfos(EvaluationInfo& evaluationInfo, const Evaluati
 
 void EvaluationContext::Clear()
 {
+    ResetProxies();
     for (auto tgt : mStageTarget)
     {
-        if (!tgt)
+        // cached results are released by the cache
+        if (!tgt || gResultCache.Contains(tgt.get()))
         {
             continue;
         }
         tgt->Destroy();
     }
     mStageTarget.clear();
+    for (auto& passTargets : mPassTargets)
+    {
+        if (passTargets.mPingPong)
+            passTargets.mPingPong->Destroy();
+        if (passTargets.mSnapshot)
+            passTargets.mSnapshot->Destroy();
+    }
+    mPassTargets.clear();
+    mStageHashes.clear();
     for (auto& buffer : mComputeBuffers)
     {
         glDeleteBuffers(1, &buffer.mBuffer);
@@ -161,6 +165,9 @@ void EvaluationContext::Clear()
     mDirtyFlags.clear();
     mbProcessing.clear();
     mProgress.clear();
+    mProxyTargets.clear();
+    mbProxyTarget.clear();
+    mbRefine.clear();
 }
 
 unsigned int EvaluationContext::GetEvaluationTexture(size_t target)
@@ -214,7 +221,7 @@ void drawBlades(int indexCount, int instanceCount, int elementCount)
 }
 
 void EvaluationContext::BindTextures(const EvaluationStage& evaluationStage,
-                                     unsigned int program,
+                                     const ProgramReflection& reflection,
                                      std::shared_ptr<RenderTarget> reusableTarget)
 {
     const Input& input = evaluationStage.mInput;
@@ -230,15 +237,12 @@ void EvaluationContext::BindTextures(const EvaluationStage& evaluationStage,
         }
         else
         {
-            unsigned int parameter = glGetUniformLocation(program, sampler2DName[inputIndex]);
-            if (parameter == 0xFFFFFFFF)
-                parameter = glGetUniformLocation(program, samplerCubeName[inputIndex]);
-            if (parameter == 0xFFFFFFFF)
+            // sampler unit is set when the program is linked
+            if (!reflection.mSamplerTypes[inputIndex])
             {
                 glBindTexture(GL_TEXTURE_2D, 0);
                 continue;
             }
-            glUniform1i(parameter, inputIndex);
 
             std::shared_ptr<RenderTarget> tgt;
             if (inputIndex == 0 && reusableTarget)
@@ -380,22 +384,12 @@ void EvaluationContext::EvaluateGLSLCompute(const EvaluationStage& evaluationSta
     {
         glUseProgram(program);
 
-        glBindBuffer(GL_UNIFORM_BUFFER, mEvaluationStateGLSLBuffer);
         evaluationInfo.mVertexSpace = evaluationStage.mVertexSpace;
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(EvaluationInfo), &evaluationInfo, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-        glBindBuffer(GL_UNIFORM_BUFFER, mParametersGLSLBuffer);
-        glBufferData(
-            GL_UNIFORM_BUFFER, evaluationStage.mParameters.size(), evaluationStage.mParameters.data(), GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-
-        glBindBufferBase(GL_UNIFORM_BUFFER, 1, mParametersGLSLBuffer);
-        glBindBufferBase(GL_UNIFORM_BUFFER, 2, mEvaluationStateGLSLBuffer);
+        mUniformArena.Bind(2, &evaluationInfo, sizeof(EvaluationInfo));
+        mUniformArena.Bind(1, evaluationStage.mParameters.data(), evaluationStage.mParameters.size());
 
 
-        BindTextures(evaluationStage, program, std::shared_ptr<RenderTarget>());
+        BindTextures(evaluationStage, evaluator.mReflection, std::shared_ptr<RenderTarget>());
         glEnable(GL_RASTERIZER_DISCARD);
         glBindVertexArray(feedbackVertexArray);
         glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER,
@@ -430,10 +424,23 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
     auto tgt = mStageTarget[index];
 
     const Evaluator& evaluator = gEvaluators.GetEvaluator(evaluationStage.mType);
-    const unsigned int program = evaluator.mGLSLProgram;
+    unsigned int program;
     const int blendOps[] = {evaluationStage.mBlendingSrc, evaluationStage.mBlendingDst};
     unsigned int blend[] = {GL_ONE, GL_ZERO};
 
+    // program is still building: progress until it's ready, don't cache the target
+    if (!gEvaluators.GetProgram(evaluationStage.mType, false, IsSynchronous(), program))
+    {
+        StageSetProcessing(index, 1);
+        mStillDirty.push_back(uint32_t(index));
+        mStageHashes[index] = 0;
+        return;
+    }
+    if (StageIsProcessing(index))
+    {
+        StageSetProcessing(index, 0);
+    }
+
     if (!program)
     {
         glUseProgram(gDefaultShader.mNodeErrorShader);
@@ -447,16 +454,28 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
             blend[i] = GLBlends[blendOps[i]];
     }
 
-    // parameters
-    glBindBuffer(GL_UNIFORM_BUFFER, mParametersGLSLBuffer);
-
-    glBufferData(
-        GL_UNIFORM_BUFFER, evaluationStage.mParameters.size(), evaluationStage.mParameters.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, mParametersGLSLBuffer);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // parameters, written once for all passes, mips and faces
+    mUniformArena.Bind(1, evaluationStage.mParameters.data(), evaluationStage.mParameters.size());
     glEnable(GL_BLEND);
     glBlendFunc(blend[0], blend[1]);
 
+    // 1 draw per mip for the 6 faces
+    static int maxDrawBuffers = 0;
+    if (!maxDrawBuffers)
+    {
+        glGetIntegerv(GL_MAX_DRAW_BUFFERS, &maxDrawBuffers);
+    }
+    // per face draws until the layered program is built
+    unsigned int layeredCubeProgram = 0;
+    const bool layeredCube = tgt->mImage->mNumFaces == 6 && !evaluationInfo.uiPass && maxDrawBuffers >= 6 &&
+                             gEvaluators.GetProgram(evaluationStage.mType, true, IsSynchronous(), layeredCubeProgram) &&
+                             layeredCubeProgram;
+    if (layeredCube)
+    {
+        program = layeredCubeProgram;
+        memcpy(evaluationInfo.viewRots, rotMatrices, sizeof(rotMatrices));
+    }
+
     glUseProgram(program);
 
     Camera* camera = mEvaluationStages.GetCameraParameter(index);
@@ -466,14 +485,30 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
     }
 
     int passCount = mEvaluationStages.GetIntParameter(index, "passCount", 1);
-    auto transientTarget = std::make_shared<RenderTarget>(RenderTarget());
+    std::shared_ptr<RenderTarget> transientTarget;
     if (passCount > 1)
     {
-        // new transient target
-        transientTarget->Clone(*tgt);
+        // previous pass result, only reallocated when the size changes
+        auto& pingPong = GetPassTargets(index).mPingPong;
+        if (!pingPong)
+        {
+            pingPong = std::make_shared<RenderTarget>();
+        }
+        pingPong->Clone(*tgt);
+        transientTarget = pingPong;
     }
 
     uint8_t mipmapCount = tgt->mImage->mNumMips;
+    // convergence is tested every checkInterval passes, on passes in phase with the last one
+    const MetaNode& metaNode = gMetaNodes[evaluationStage.mType];
+    const int convergencePeriod = metaNode.mConvergencePeriod;
+    const bool testConvergence = convergencePeriod > 0 && passCount > 1 && !evaluationInfo.uiPass &&
+                                 gDefaultShader.mConvergenceShader && mipmapCount == 1 &&
+                                 tgt->mImage->mNumFaces == 1;
+    const int checkInterval = testConvergence ? ((16 + convergencePeriod - 1) / convergencePeriod) * convergencePeriod : 0;
+    int snapshotPass = -1;
+    // one convergence test in flight, its result is read once available
+    unsigned int convergenceQuery = 0;
     for (int passNumber = 0; passNumber < passCount; passNumber++)
     {
         for (int mip = 0; mip < mipmapCount; mip++)
@@ -490,10 +525,12 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
                 }
             }
 
-            size_t faceCount = evaluationInfo.uiPass ? 1 : tgt->mImage->mNumFaces;
+            size_t faceCount = (evaluationInfo.uiPass || layeredCube) ? 1 : tgt->mImage->mNumFaces;
             for (size_t face = 0; face < faceCount; face++)
             {
-                if (tgt->mImage->mNumFaces == 6)
+                if (layeredCube)
+                    tgt->BindCubeFaces(mip, tgt->mImage->mWidth);
+                else if (tgt->mImage->mNumFaces == 6)
                     tgt->BindCubeFace(face, mip, tgt->mImage->mWidth);
 
                 memcpy(evaluationInfo.viewRot, rotMatrices[face], sizeof(float) * 16);
@@ -505,16 +542,12 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
                 evaluationInfo.mipmapNumber = mip;
                 evaluationInfo.mipmapCount = mipmapCount;
 
-                glBindBuffer(GL_UNIFORM_BUFFER, mEvaluationStateGLSLBuffer);
                 evaluationInfo.mVertexSpace = evaluationStage.mVertexSpace;
-                glBufferData(GL_UNIFORM_BUFFER, sizeof(EvaluationInfo), &evaluationInfo, GL_DYNAMIC_DRAW);
-                glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
+                mUniformArena.Bind(2, &evaluationInfo, sizeof(EvaluationInfo));
 
-                glBindBufferBase(GL_UNIFORM_BUFFER, 1, mParametersGLSLBuffer);
-                glBindBufferBase(GL_UNIFORM_BUFFER, 2, mEvaluationStateGLSLBuffer);
-
-                BindTextures(evaluationStage, program, passNumber ? transientTarget : std::shared_ptr<RenderTarget>());
+                BindTextures(evaluationStage,
+                             evaluator.mReflection,
+                             passNumber ? transientTarget : std::shared_ptr<RenderTarget>());
 
                 glDisable(GL_CULL_FACE);
                 // glCullFace(GL_BACK);
@@ -577,7 +610,54 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
                     evaluationStage.mGScene->Draw(this, evaluationInfo);
                 }
             } // face
+            if (layeredCube)
+            {
+                tgt->UnbindCubeFaces();
+            }
         }     // mip
+        if (testConvergence)
+        {
+            const int remainingPasses = passCount - 1 - passNumber;
+            auto& snapshot = GetPassTargets(index).mSnapshot;
+            if (remainingPasses > convergencePeriod && !((remainingPasses + convergencePeriod) % checkInterval))
+            {
+                if (!snapshot)
+                {
+                    snapshot = std::make_shared<RenderTarget>();
+                }
+                snapshot->InitBuffer(tgt->mImage->mWidth, tgt->mImage->mHeight, false);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, tgt->mFbo);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, snapshot->mFbo);
+                glBlitFramebuffer(0,
+                                  0,
+                                  tgt->mImage->mWidth,
+                                  tgt->mImage->mHeight,
+                                  0,
+                                  0,
+                                  tgt->mImage->mWidth,
+                                  tgt->mImage->mHeight,
+                                  GL_COLOR_BUFFER_BIT,
+                                  GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                snapshotPass = passNumber;
+            }
+            else if (snapshotPass != -1 && passNumber - snapshotPass == convergencePeriod)
+            {
+                snapshotPass = -1;
+                if (!convergenceQuery)
+                {
+                    convergenceQuery =
+                        BeginConvergenceTest(*tgt, *snapshot, *transientTarget, metaNode.mConvergenceEpsilon);
+                    glUseProgram(program);
+                }
+            }
+            // a converged earlier pass means this one is converged too
+            bool converged = false;
+            if (convergenceQuery && GetConvergenceResult(convergenceQuery, converged) && converged)
+            {
+                break;
+            }
+        }
         // swap target for multipass
         // set previous target as source
         if (passCount > 1 && passNumber != (passCount - 1))
@@ -585,9 +665,66 @@ void EvaluationContext::EvaluateGLSL(const EvaluationStage& evaluationStage,
             transientTarget->Swap(*tgt);
         }
     } // passNumber
+    if (convergenceQuery)
+    {
+        glDeleteQueries(1, &convergenceQuery);
+    }
     glDisable(GL_BLEND);
 }
 
+EvaluationContext::PassTargets& EvaluationContext::GetPassTargets(size_t nodeIndex)
+{
+    if (mPassTargets.size() < mStageTarget.size())
+    {
+        mPassTargets.resize(mStageTarget.size());
+    }
+    return mPassTargets[nodeIndex];
+}
+
+unsigned int EvaluationContext::BeginConvergenceTest(const RenderTarget& current,
+                                                     const RenderTarget& previous,
+                                                     const RenderTarget& queryTarget,
+                                                     float epsilon)
+{
+    // differing texels are counted without being written.
+    // queryTarget has the size of the inputs but neither of them attached: no feedback loop
+    queryTarget.BindAsTarget();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(gDefaultShader.mConvergenceShader);
+    glUniform1f(gDefaultShader.mConvergenceEpsilonLocation, epsilon);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, current.mGLTexID);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, previous.mGLTexID);
+
+    unsigned int query;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+    mFSQuad.Render();
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glActiveTexture(GL_TEXTURE0);
+    return query;
+}
+
+bool EvaluationContext::GetConvergenceResult(unsigned int& query, bool& converged)
+{
+    unsigned int available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        return false;
+    }
+    unsigned int samplesPassed = 1;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samplesPassed);
+    glDeleteQueries(1, &query);
+    query = 0;
+    converged = !samplesPassed;
+    return true;
+}
+
 void EvaluationContext::EvaluateC(const EvaluationStage& evaluationStage, size_t index, EvaluationInfo& evaluationInfo)
 {
     try // todo: find a better solution than a try catch
@@ -614,8 +751,11 @@ void EvaluationContext::EvaluatePython(const EvaluationStage& evaluationStage,
 {
     try // todo: find a better solution than a try catch
     {
+        // builder workers evaluate concurrently: one python node at a time
+        static std::mutex pythonMutex;
+        std::lock_guard<std::mutex> lock(pythonMutex);
         const Evaluator& evaluator = gEvaluators.GetEvaluator(evaluationStage.mType);
-        evaluator.RunPython();
+        evaluator.RunPython(this, evaluationInfo);
     }
     catch (...)
     {
@@ -681,15 +821,135 @@ void EvaluationContext::AllocRenderTargetsForBaking(const std::vector<size_t>& n
         }
     }
 }
+void EvaluationContext::SetTileWindow(const float* window)
+{
+    mbUntileableSource = false;
+    if (window)
+    {
+        memcpy(mTileWindow, window, sizeof(mTileWindow));
+    }
+    else
+    {
+        memset(mTileWindow, 0, sizeof(mTileWindow));
+    }
+}
+
+void EvaluationContext::CropToTileWindow(size_t nodeIndex)
+{
+    auto renderTarget = mStageTarget[nodeIndex];
+    if (!renderTarget || !renderTarget->mFbo)
+    {
+        return;
+    }
+    // the window target is RGBA8: 8 bits sources only, files keep their RGB8 format
+    const int sourceFormat = renderTarget->mImage->mFormat;
+    if (renderTarget->mImage->mNumFaces != 1 ||
+        (sourceFormat != TextureFormat::RGBA8 && sourceFormat != TextureFormat::RGB8))
+    {
+        mbUntileableSource = true;
+        return;
+    }
+    const int sourceWidth = renderTarget->mImage->mWidth;
+    const int sourceHeight = renderTarget->mImage->mHeight;
+
+    RenderTarget windowTarget;
+    windowTarget.InitBuffer(mDefaultWidth, mDefaultHeight, false);
+    windowTarget.BindAsTarget();
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // part of the window inside the image
+    const float u0 = std::max(mTileWindow[0], 0.f);
+    const float v0 = std::max(mTileWindow[1], 0.f);
+    const float u1 = std::min(mTileWindow[0] + mTileWindow[2], 1.f);
+    const float v1 = std::min(mTileWindow[1] + mTileWindow[3], 1.f);
+    if (u1 > u0 && v1 > v0)
+    {
+        auto toWindow = [&](float uv, int axis, int size) {
+            return int(floorf((uv - mTileWindow[axis]) / mTileWindow[axis + 2] * size + 0.5f));
+        };
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, renderTarget->mFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, windowTarget.mFbo);
+        glBlitFramebuffer(int(u0 * sourceWidth),
+                          int(v0 * sourceHeight),
+                          int(ceilf(u1 * sourceWidth)),
+                          int(ceilf(v1 * sourceHeight)),
+                          toWindow(u0, 0, mDefaultWidth),
+                          toWindow(v0, 1, mDefaultHeight),
+                          toWindow(u1, 0, mDefaultWidth),
+                          toWindow(v1, 1, mDefaultHeight),
+                          GL_COLOR_BUFFER_BIT,
+                          GL_LINEAR);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    renderTarget->Swap(windowTarget);
+    windowTarget.Destroy();
+}
+
 void EvaluationContext::PreRun()
 {
     mDirtyFlags.resize(mEvaluationStages.GetStagesCount(), 0);
     mbProcessing.resize(mEvaluationStages.GetStagesCount(), 0);
     mProgress.resize(mEvaluationStages.GetStagesCount(), 0.f);
     mActive.resize(mEvaluationStages.GetStagesCount(), false);
+    mStageHashes.resize(mEvaluationStages.GetStagesCount(), 0);
 }
 
-void EvaluationContext::RunNode(size_t nodeIndex)
+uint64_t EvaluationContext::ComputeStageHash(size_t nodeIndex) const
+{
+    const EvaluationStage& stage = mEvaluationStages.GetEvaluationStage(nodeIndex);
+    if (stage.gEvaluationMask != EvaluationGLSL || stage.mGScene || gMetaNodes[stage.mType].mbHasUI)
+    {
+        return 0;
+    }
+    const Evaluator& evaluator = gEvaluators.GetEvaluator(stage.mType);
+    if (!evaluator.mbCacheable)
+    {
+        return 0;
+    }
+
+    uint64_t hash = Hash(&stage.mType, sizeof(stage.mType));
+    hash = Hash(stage.mParameters.data(), stage.mParameters.size(), hash);
+    hash = Hash(stage.mInputSamplers.data(), stage.mInputSamplers.size() * sizeof(InputSampler), hash);
+    hash = Hash(&stage.mParameterViewMatrix, sizeof(Mat4x4), hash);
+    hash = Hash(&stage.mVertexSpace, sizeof(stage.mVertexSpace), hash);
+    hash = Hash(&mDefaultWidth, sizeof(mDefaultWidth), hash);
+    hash = Hash(&mDefaultHeight, sizeof(mDefaultHeight), hash);
+    hash = Hash(&evaluator.mRevision, sizeof(evaluator.mRevision), hash);
+    if (evaluator.mbTimeDependent)
+    {
+        hash = Hash(&stage.mLocalTime, sizeof(stage.mLocalTime), hash);
+        hash = Hash(&mCurrentTime, sizeof(mCurrentTime), hash);
+    }
+    for (auto input : stage.mInput.mInputs)
+    {
+        uint64_t inputHash = 0;
+        if (input != -1)
+        {
+            inputHash = mStageHashes[input];
+            // input result is not content addressable, neither is this one
+            if (!inputHash)
+            {
+                return 0;
+            }
+        }
+        hash = Hash(&inputHash, sizeof(inputHash), hash);
+    }
+    return hash ? hash : 1;
+}
+
+void EvaluationContext::SetNodeEvaluationInfo(size_t nodeIndex)
+{
+    const auto& currentStage = mEvaluationStages.GetEvaluationStage(nodeIndex);
+    mEvaluationInfo.targetIndex = int(nodeIndex);
+    mEvaluationInfo.mFrame = mCurrentTime;
+    mEvaluationInfo.mDirtyFlag = mDirtyFlags[nodeIndex];
+    memcpy(mEvaluationInfo.inputIndices, currentStage.mInput.mInputs, sizeof(mEvaluationInfo.inputIndices));
+    SetKeyboardMouseInfos(mEvaluationInfo, currentStage);
+    memcpy(mEvaluationInfo.uvWindow, mTileWindow, sizeof(mTileWindow));
+}
+
+bool EvaluationContext::RunNodeCPU(size_t nodeIndex)
 {
     auto& currentStage = mEvaluationStages.GetEvaluationStage(nodeIndex);
     const Input& input = currentStage.mInput;
@@ -702,18 +962,51 @@ void EvaluationContext::RunNode(size_t nodeIndex)
         if (mbProcessing[inp])
         {
             mbProcessing[nodeIndex] = 1;
-            return;
+            mStageHashes[nodeIndex] = 0;
+            return false;
         }
     }
 
     mbProcessing[nodeIndex] = 0;
 
-    mEvaluationInfo.targetIndex = int(nodeIndex);
-    mEvaluationInfo.mFrame = mCurrentTime;
-    mEvaluationInfo.mDirtyFlag = mDirtyFlags[nodeIndex];
-    memcpy(mEvaluationInfo.inputIndices, input.mInputs, sizeof(mEvaluationInfo.inputIndices));
-    SetKeyboardMouseInfos(mEvaluationInfo, currentStage);
+    // low resolution results are not content addressable
+    const bool proxy = mPreviewDivisor > 1 && currentStage.gEvaluationMask == EvaluationGLSL;
+    if (mbProgressivePreview)
+    {
+        UseProxyTarget(nodeIndex, proxy);
+    }
+
+    uint64_t stageHash = (mbUseResultCache && !proxy) ? ComputeStageHash(nodeIndex) : 0;
+    mStageHashes[nodeIndex] = stageHash;
+    auto& stageTarget = mStageTarget[nodeIndex];
+    if (stageHash)
+    {
+        auto cachedTarget = gResultCache.Get(stageHash);
+        if (cachedTarget)
+        {
+            if (cachedTarget != stageTarget)
+            {
+                if (stageTarget && !gResultCache.Contains(stageTarget.get()) && stageTarget.use_count() == 1)
+                {
+                    stageTarget->Destroy();
+                }
+                stageTarget = cachedTarget;
+            }
+            mDirtyFlags[nodeIndex] = 0;
+            if (mbProgressivePreview)
+            {
+                UpdateRefine(nodeIndex);
+            }
+            return false;
+        }
+    }
+    // don't overwrite a cached result, even when this evaluation is not cacheable:
+    // after a hit, the target is shared with the cache and with every identical stage
+    gResultCache.Detach(stageTarget);
+
+    SetNodeEvaluationInfo(nodeIndex);
 
+    const uint64_t cpuStart = mProfiler.GetTime();
 #if USE_LIBTCC
     if (currentStage.gEvaluationMask & EvaluationC)
         EvaluateC(currentStage, nodeIndex, mEvaluationInfo);
@@ -722,36 +1015,90 @@ void EvaluationContext::RunNode(size_t nodeIndex)
     if (currentStage.gEvaluationMask & EvaluationPython)
         EvaluatePython(currentStage, nodeIndex, mEvaluationInfo);
 #endif
+    if (currentStage.gEvaluationMask & (EvaluationC | EvaluationPython))
+    {
+        mProfiler.AddCPU(nodeIndex, int(currentStage.mType), cpuStart);
+    }
+    return true;
+}
+
+void EvaluationContext::RunNodeGPU(size_t nodeIndex)
+{
+    auto& currentStage = mEvaluationStages.GetEvaluationStage(nodeIndex);
+
+    if (IsTiled() && !(currentStage.gEvaluationMask & (EvaluationGLSL | EvaluationGLSLCompute)))
+    {
+        CropToTileWindow(nodeIndex);
+    }
+
     if (currentStage.gEvaluationMask & EvaluationGLSLCompute)
     {
+        mProfiler.BeginGPU(nodeIndex, int(currentStage.mType));
         EvaluateGLSLCompute(currentStage, nodeIndex, mEvaluationInfo);
+        mProfiler.EndGPU();
     }
 
     if (currentStage.gEvaluationMask & EvaluationGLSL)
     {
-        if (!mStageTarget[nodeIndex]->mGLTexID)
+        if (mbProgressivePreview && mbProxyTarget[nodeIndex])
+            mStageTarget[nodeIndex]->InitBuffer(
+                mDefaultWidth / mPreviewDivisor, mDefaultHeight / mPreviewDivisor, currentStage.mbDepthBuffer);
+        else if (!mStageTarget[nodeIndex]->mGLTexID)
             mStageTarget[nodeIndex]->InitBuffer(mDefaultWidth, mDefaultHeight, currentStage.mbDepthBuffer);
 
+        mProfiler.BeginGPU(nodeIndex, int(currentStage.mType));
         EvaluateGLSL(currentStage, nodeIndex, mEvaluationInfo);
+        mProfiler.EndGPU();
+    }
+    if (mStageHashes[nodeIndex])
+    {
+        gResultCache.Add(mStageHashes[nodeIndex], mStageTarget[nodeIndex]);
+    }
+    if (mbProgressivePreview)
+    {
+        UpdateRefine(nodeIndex);
     }
     mDirtyFlags[nodeIndex] = 0;
 }
 
+void EvaluationContext::RunNode(size_t nodeIndex)
+{
+    if (RunNodeCPU(nodeIndex))
+    {
+        RunNodeGPU(nodeIndex);
+    }
+}
+
 bool EvaluationContext::RunNodeList(const std::vector<size_t>& nodesToEvaluate)
 {
     GLint last_viewport[4];
     glGetIntegerv(GL_VIEWPORT, last_viewport);
 
+    mProfiler.BeginEvaluation();
+
     // run C nodes
     bool anyNodeIsProcessing = false;
     for (size_t nodeIndex : nodesToEvaluate)
     {
         mActive[nodeIndex] = mCurrentTime >= mEvaluationStages.mStages[nodeIndex].mStartFrame &&
                              mCurrentTime <= mEvaluationStages.mStages[nodeIndex].mEndFrame;
-        if (!mActive[nodeIndex])
-            continue;
-        RunNode(nodeIndex);
-        anyNodeIsProcessing |= mbProcessing[nodeIndex] != 0;
+    }
+    if (mbParallelJobs && mbSynchronousEvaluation && CanRunParallelJobs())
+    {
+        RunNodeListParallel(nodesToEvaluate);
+    }
+    else
+    {
+        for (size_t nodeIndex : nodesToEvaluate)
+        {
+            if (!mActive[nodeIndex])
+                continue;
+            RunNode(nodeIndex);
+        }
+    }
+    for (size_t nodeIndex : nodesToEvaluate)
+    {
+        anyNodeIsProcessing |= mActive[nodeIndex] && mbProcessing[nodeIndex] != 0;
     }
     // set dirty nodes that tell so
     for (auto index : mStillDirty)
@@ -764,6 +1111,213 @@ bool EvaluationContext::RunNodeList(const std::vector<size_t>& nodesToEvaluate)
     return anyNodeIsProcessing;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parallel jobs
+// In synchronous contexts, Job() runs inline so independent loaders wait on each other.
+// When parallel jobs are enabled, jobs are dispatched on g_TS and attributed to the node that spawned them.
+// JobMain() calls from workers are queued and run by the thread that owns the context (GL thread).
+// A node GPU part runs once all its jobs are done, its consumers are released with dependency counters.
+
+struct JobOwner
+{
+    EvaluationContext* mContext;
+    int mNodeIndex;
+};
+static thread_local JobOwner jobOwner = {nullptr, -1};
+
+struct ParallelJobTaskSet : TaskSet
+{
+    ParallelJobTaskSet(EvaluationContext* context, int nodeIndex, int (*function)(void*), void* ptr, unsigned int size)
+        : TaskSet(), mContext(context), mNodeIndex(nodeIndex), mFunction(function), mBuffer(malloc(size))
+    {
+        memcpy(mBuffer, ptr, size);
+        gEvaluators.JobStarted();
+    }
+    virtual void ExecuteRange(TaskSetPartition range, uint32_t threadnum)
+    {
+        JobOwner previousOwner = jobOwner;
+        jobOwner = {mContext, mNodeIndex};
+        mFunction(mBuffer);
+        jobOwner = previousOwner;
+        free(mBuffer);
+        mContext->JobDone(mNodeIndex);
+        gEvaluators.JobDone();
+        delete this;
+    }
+    EvaluationContext* mContext;
+    int mNodeIndex;
+    int (*mFunction)(void*);
+    void* mBuffer;
+};
+
+bool EvaluationContext::CanRunParallelJobs() const
+{
+#ifdef EMSCRIPTEN
+    return false;
+#else
+    // the owner thread waits on workers, needs at least one
+    extern TaskScheduler g_TS;
+    return g_TS.GetNumTaskThreads() > 1;
+#endif
+}
+
+bool EvaluationContext::AddParallelJob(int (*jobFunction)(void*), void* ptr, unsigned int size)
+{
+    if (jobOwner.mContext != this || jobOwner.mNodeIndex < 0)
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        mPendingJobs[jobOwner.mNodeIndex]++;
+    }
+    extern TaskScheduler g_TS;
+    g_TS.AddTaskSetToPipe(new ParallelJobTaskSet(this, jobOwner.mNodeIndex, jobFunction, ptr, size));
+    return true;
+}
+
+bool EvaluationContext::AddParallelMainJob(int (*jobFunction)(void*), void* ptr, unsigned int size)
+{
+    // called from the owner thread : run inline like a plain synchronous context
+    if (jobOwner.mContext != this || jobOwner.mNodeIndex < 0 || std::this_thread::get_id() == mJobOwnerThread)
+    {
+        return false;
+    }
+    MainJob mainJob{jobOwner.mNodeIndex, jobFunction, malloc(size)};
+    memcpy(mainJob.mBuffer, ptr, size);
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        mPendingJobs[jobOwner.mNodeIndex]++;
+        mMainJobs.push_back(mainJob);
+    }
+    mJobCondition.notify_one();
+    return true;
+}
+
+void EvaluationContext::JobDone(int nodeIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        mPendingJobs[nodeIndex]--;
+    }
+    mJobCondition.notify_one();
+}
+
+void EvaluationContext::RunNodeListParallel(const std::vector<size_t>& nodesToEvaluate)
+{
+    size_t stageCount = mEvaluationStages.GetStagesCount();
+    std::vector<int> waitingInputs(stageCount, 0);
+    std::vector<bool> inList(stageCount, false);
+    std::vector<bool> running(stageCount, false);
+    std::vector<std::vector<size_t>> consumers(stageCount);
+    for (size_t nodeIndex : nodesToEvaluate)
+    {
+        inList[nodeIndex] = true;
+    }
+    for (size_t nodeIndex : nodesToEvaluate)
+    {
+        for (auto input : mEvaluationStages.mStages[nodeIndex].mInput.mInputs)
+        {
+            if (input < 0 || !inList[input])
+                continue;
+            waitingInputs[nodeIndex]++;
+            consumers[input].push_back(nodeIndex);
+        }
+    }
+
+    mPendingJobs.assign(stageCount, 0);
+    mJobOwnerThread = std::this_thread::get_id();
+
+    std::vector<size_t> ready;
+    for (auto iter = nodesToEvaluate.rbegin(); iter != nodesToEvaluate.rend(); ++iter)
+    {
+        if (!waitingInputs[*iter])
+            ready.push_back(*iter);
+    }
+
+    size_t remaining = nodesToEvaluate.size();
+    auto complete = [&](size_t nodeIndex) {
+        remaining--;
+        for (auto consumer : consumers[nodeIndex])
+        {
+            if (!--waitingInputs[consumer])
+                ready.push_back(consumer);
+        }
+    };
+
+    std::vector<MainJob> mainJobs;
+    while (remaining)
+    {
+        // launch every node that has its inputs available. CPU jobs go to workers.
+        while (!ready.empty())
+        {
+            size_t nodeIndex = ready.back();
+            ready.pop_back();
+            if (!mActive[nodeIndex])
+            {
+                complete(nodeIndex);
+                continue;
+            }
+            JobOwner previousOwner = jobOwner;
+            jobOwner = {this, int(nodeIndex)};
+            bool runGPU = RunNodeCPU(nodeIndex);
+            jobOwner = previousOwner;
+            if (!runGPU)
+            {
+                complete(nodeIndex);
+                continue;
+            }
+            running[nodeIndex] = true;
+        }
+        if (!remaining)
+        {
+            break;
+        }
+
+        // GPU part of nodes that have all their jobs done
+        {
+            std::unique_lock<std::mutex> lock(mJobMutex);
+            mJobCondition.wait(lock, [&]() {
+                if (!mMainJobs.empty())
+                    return true;
+                for (size_t nodeIndex : nodesToEvaluate)
+                {
+                    if (running[nodeIndex] && !mPendingJobs[nodeIndex])
+                        return true;
+                }
+                return false;
+            });
+            mainJobs.swap(mMainJobs);
+        }
+        for (auto& mainJob : mainJobs)
+        {
+            JobOwner previousOwner = jobOwner;
+            jobOwner = {this, mainJob.mNodeIndex};
+            mainJob.mFunction(mainJob.mBuffer);
+            jobOwner = previousOwner;
+            free(mainJob.mBuffer);
+            JobDone(mainJob.mNodeIndex);
+        }
+        mainJobs.clear();
+
+        for (size_t nodeIndex : nodesToEvaluate)
+        {
+            if (!running[nodeIndex])
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(mJobMutex);
+                if (mPendingJobs[nodeIndex])
+                    continue;
+            }
+            running[nodeIndex] = false;
+            SetNodeEvaluationInfo(nodeIndex);
+            RunNodeGPU(nodeIndex);
+            complete(nodeIndex);
+        }
+    }
+    mJobOwnerThread = std::thread::id();
+}
+
 void EvaluationContext::RunSingle(size_t nodeIndex, EvaluationInfo& evaluationInfo)
 {
     GLint last_viewport[4];
@@ -801,7 +1355,7 @@ void EvaluationContext::RunDirty()
 {
     PreRun();
     memset(&mEvaluationInfo, 0, sizeof(EvaluationInfo));
-    auto evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
+    const auto& evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
     std::vector<size_t> nodesToEvaluate;
     for (size_t index = 0; index < evaluationOrderList.size(); index++)
     {
@@ -810,16 +1364,126 @@ void EvaluationContext::RunDirty()
             nodesToEvaluate.push_back(currentNodeIndex);
     }
     AllocRenderTargetsForEditingPreview();
+    if (mbProgressivePreview)
+    {
+        RunProgressive(nodesToEvaluate);
+        return;
+    }
     RunNodeList(nodesToEvaluate);
 }
 
-void EvaluationContext::DirtyAll()
+// a parameter change less than this ago means the user is still editing
+static const double InteractionDelay = 150.; // ms
+// GPU time of an interactive evaluation above which proxies are 1/4 of the resolution instead of 1/2
+static const float InteractiveBudget = 8.f; // ms
+static const float RefineBudget = 12.f;     // ms
+
+void EvaluationContext::NotifyInteraction()
+{
+    mLastInteraction = SDL_GetPerformanceCounter();
+}
+
+void EvaluationContext::RunProgressive(const std::vector<size_t>& nodesToEvaluate)
+{
+    const auto& timings = mProfiler.GetNodeTimings();
+    const double sinceInteraction =
+        double(SDL_GetPerformanceCounter() - mLastInteraction) * 1000. / double(SDL_GetPerformanceFrequency());
+    if (sinceInteraction < InteractionDelay)
+    {
+        mPreviewDivisor = mProxyDivisor;
+        RunNodeList(nodesToEvaluate);
+        mPreviewDivisor = 1;
+
+        // GPU timings are from a previous evaluation at the same divisor
+        float cost = 0.f;
+        for (auto nodeIndex : nodesToEvaluate)
+        {
+            if (nodeIndex < timings.size())
+                cost += timings[nodeIndex].mGPU;
+        }
+        if (cost > InteractiveBudget)
+            mProxyDivisor = 4;
+        else if (mProxyDivisor == 4 && cost * 4.f < InteractiveBudget * 0.5f)
+            mProxyDivisor = 2;
+        return;
+    }
+
+    // edits settled: dirty and approximate nodes at full resolution, in evaluation order, as many as the budget allows
+    const auto& evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
+    std::vector<size_t> refineList;
+    float cost = 0.f;
+    for (auto nodeIndex : evaluationOrderList)
+    {
+        bool refine = nodeIndex < mbRefine.size() && mbRefine[nodeIndex];
+        if (!mDirtyFlags[nodeIndex] && !refine)
+            continue;
+        float nodeCost = 0.f;
+        if (nodeIndex < timings.size())
+            nodeCost = timings[nodeIndex].mCPUAverage + timings[nodeIndex].mGPUAverage;
+        // stopping keeps the list closed on inputs: the rest is done next frames
+        if (!refineList.empty() && cost + nodeCost > RefineBudget)
+            break;
+        cost += nodeCost;
+        refineList.push_back(nodeIndex);
+    }
+    RunNodeList(refineList);
+}
+
+void EvaluationContext::UseProxyTarget(size_t nodeIndex, bool proxy)
+{
+    if (mbProxyTarget.size() != mStageTarget.size())
+    {
+        ResetProxies();
+    }
+    if (mbProxyTarget[nodeIndex] == proxy)
+        return;
+    std::swap(mStageTarget[nodeIndex], mProxyTargets[nodeIndex]);
+    if (!mStageTarget[nodeIndex])
+        mStageTarget[nodeIndex] = std::make_shared<RenderTarget>();
+    mbProxyTarget[nodeIndex] = proxy;
+}
+
+void EvaluationContext::UpdateRefine(size_t nodeIndex)
+{
+    if (mbRefine.size() != mStageTarget.size())
+    {
+        ResetProxies();
+    }
+    bool refine = mbProxyTarget[nodeIndex];
+    for (auto input : mEvaluationStages.GetEvaluationStage(nodeIndex).mInput.mInputs)
+    {
+        refine |= input != -1 && size_t(input) < mbRefine.size() && mbRefine[input];
+    }
+    mbRefine[nodeIndex] = refine;
+}
+
+void EvaluationContext::ResetProxies()
+{
+    for (size_t i = 0; i < mbProxyTarget.size() && i < mStageTarget.size(); i++)
+    {
+        if (mbProxyTarget[i])
+            std::swap(mStageTarget[i], mProxyTargets[i]);
+        if (mbRefine[i] && i < mDirtyFlags.size())
+            mDirtyFlags[i] |= Dirty::Input;
+    }
+    // only proxies are left, never cached
+    for (auto& target : mProxyTargets)
+    {
+        if (target)
+            target->Destroy();
+    }
+    mProxyTargets.assign(mStageTarget.size(), nullptr);
+    mbProxyTarget.assign(mStageTarget.size(), false);
+    mbRefine.assign(mStageTarget.size(), false);
+}
+
+void EvaluationContext::DirtyAll(DirtyFlag dirtyFlag)
 {
     // tag all as dirty
     mDirtyFlags.resize(mEvaluationStages.GetStagesCount(), 0);
     for (auto& dirty : mDirtyFlags)
     {
-        dirty = Dirty::All;
+        dirty = dirtyFlag;
     }
 }
 
@@ -829,7 +1493,7 @@ void EvaluationContext::RunAll()
     DirtyAll();
     // get list of nodes to run
     memset(&mEvaluationInfo, 0, sizeof(EvaluationInfo));
-    auto evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
+    const auto& evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
     AllocRenderTargetsForEditingPreview();
     RunNodeList(evaluationOrderList);
 }
@@ -864,30 +1528,26 @@ FFMPEGCodec::Encoder* EvaluationContext::GetEncoder(const std::string& filename,
 #endif
 void EvaluationContext::SetTargetDirty(size_t target, DirtyFlag dirtyFlag, bool onlyChild)
 {
-    mDirtyFlags.resize(mEvaluationStages.GetStagesCount(), 0);
-    auto evaluationOrderList = mEvaluationStages.GetForwardEvaluationOrder();
+    const size_t stageCount = mEvaluationStages.GetStagesCount();
+    mDirtyFlags.resize(stageCount, 0);
     mDirtyFlags[target] = dirtyFlag;
-    for (size_t i = 0; i < evaluationOrderList.size(); i++)
-    {
-        size_t currentNodeIndex = evaluationOrderList[i];
-        if (currentNodeIndex != target)
-            continue;
 
-        for (i++; i < evaluationOrderList.size(); i++)
+    // BFS on consumers. Already dirty nodes keep their flag but their children still need to be visited.
+    mDirtyVisited.assign((stageCount + 63) / 64, 0);
+    mDirtyVisited[target >> 6] |= 1ULL << (target & 63);
+    mDirtyQueue.clear();
+    mDirtyQueue.push_back(target);
+    for (size_t i = 0; i < mDirtyQueue.size(); i++)
+    {
+        for (auto consumer : mEvaluationStages.GetConsumers(mDirtyQueue[i]))
         {
-            currentNodeIndex = evaluationOrderList[i];
-            if (currentNodeIndex >= mDirtyFlags.size() || mDirtyFlags[currentNodeIndex]) // TODOUNDO
+            uint64_t bit = 1ULL << (consumer & 63);
+            if (mDirtyVisited[consumer >> 6] & bit)
                 continue;
-
-            auto& currentEvaluation = mEvaluationStages.GetEvaluationStage(currentNodeIndex);
-            for (auto inp : currentEvaluation.mInput.mInputs)
-            {
-                if (inp >= 0 && mDirtyFlags[inp])
-                {
-                    mDirtyFlags[currentNodeIndex] = Dirty::Input;
-                    break;
-                }
-            }
+            mDirtyVisited[consumer >> 6] |= bit;
+            if (!mDirtyFlags[consumer])
+                mDirtyFlags[consumer] = Dirty::Input;
+            mDirtyQueue.push_back(consumer);
         }
     }
     if (onlyChild)
@@ -896,31 +1556,54 @@ void EvaluationContext::SetTargetDirty(size_t target, DirtyFlag dirtyFlag, bool
     }
 }
 
+void EvaluationContext::SetNodeTypeDirty(size_t nodeType)
+{
+    for (size_t i = 0; i < mEvaluationStages.GetStagesCount(); i++)
+    {
+        if (mEvaluationStages.GetEvaluationStage(i).mType == nodeType)
+        {
+            SetTargetDirty(i, Dirty::Input);
+        }
+    }
+}
+
 void EvaluationContext::UserAddStage()
 {
+    ResetProxies();
     URAdd<std::shared_ptr<RenderTarget>> undoRedoAddRenderTarget(int(mStageTarget.size()),
                                                                  [&]() { return &mStageTarget; });
     URAdd<DirtyFlag> undoRedoAddDirty(int(mDirtyFlags.size()), [&]() { return &mDirtyFlags; });
     URAdd<int> undoRedoAddProcessing(int(mbProcessing.size()), [&]() { return &mbProcessing; });
     URAdd<float> undoRedoAddProgress(int(mProgress.size()), [&]() { return &mProgress; });
+    URAdd<uint64_t> undoRedoAddHash(int(mStageHashes.size()), [&]() { return &mStageHashes; });
+    mPassTargets.resize(mStageTarget.size());
+    URAdd<PassTargets> undoRedoAddPassTargets(int(mPassTargets.size()), [&]() { return &mPassTargets; });
 
     mStageTarget.push_back(std::make_shared<RenderTarget>());
     mDirtyFlags.push_back(Dirty::All);
     mbProcessing.push_back(0);
     mProgress.push_back(0.f);
+    mStageHashes.push_back(0);
+    mPassTargets.push_back(PassTargets());
 }
 
 void EvaluationContext::UserDeleteStage(size_t index)
 {
+    ResetProxies();
     URDel<std::shared_ptr<RenderTarget>> undoRedoDelRenderTarget(int(index), [&]() { return &mStageTarget; });
     URDel<DirtyFlag> undoRedoDelDirty(int(index), [&]() { return &mDirtyFlags; });
     URDel<int> undoRedoDelProcessing(int(index), [&]() { return &mbProcessing; });
     URDel<float> undoRedoDelProgress(int(index), [&]() { return &mProgress; });
+    URDel<uint64_t> undoRedoDelHash(int(index), [&]() { return &mStageHashes; });
+    mPassTargets.resize(mStageTarget.size());
+    URDel<PassTargets> undoRedoDelPassTargets(int(index), [&]() { return &mPassTargets; });
 
     mStageTarget.erase(mStageTarget.begin() + index);
     mDirtyFlags.erase(mDirtyFlags.begin() + index);
     mbProcessing.erase(mbProcessing.begin() + index);
     mProgress.erase(mProgress.begin() + index);
+    mStageHashes.erase(mStageHashes.begin() + index);
+    mPassTargets.erase(mPassTargets.begin() + index);
 }
 
 void EvaluationContext::AllocateComputeBuffer(int target, int elementCount, int elementSize)
@@ -973,24 +1656,86 @@ void EvaluationContext::StageSetProgress(size_t target, float progress)
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Builder::Builder() : mbRunning(true)
+Builder::Builder(int workerCount) : mbRunning(true), mNextEntryId(1)
 {
-#ifndef __EMSCRIPTEN__
-    mThread = std::thread([&]() { BuildEntries(); });
+#ifndef EMSCRIPTEN
+    if (workerCount < 0)
+    {
+        workerCount = int(std::thread::hardware_concurrency());
+    }
+    workerCount = std::max(std::min(workerCount, gThreadContextCount), 1);
+    for (int i = 0; i < workerCount; i++)
+    {
+        mWorkers.emplace_back([this, i]() { BuildEntries(i); });
+    }
 #endif    
 }
 
 Builder::~Builder()
 {
-    mbRunning = false;
-    mThread.join();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mbRunning = false;
+    }
+    mCondition.notify_all();
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
 }
 
-void Builder::Add(const char* graphName, const EvaluationStages& stages)
+int Builder::Add(const char* graphName, const EvaluationStages& stages, int priority)
 {
-    mMutex.lock();
-    mEntries.push_back({graphName, 0.f, stages});
-    mMutex.unlock();
+    auto entry = std::make_unique<Entry>();
+    entry->mPriority = priority;
+    entry->mName = graphName;
+    entry->mEvaluationStages = stages;
+    entry->mProgress = 0.f;
+    entry->mbCancelled = false;
+    entry->mbStarted = false;
+
+    int entryId;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entryId = entry->mId = mNextEntryId++;
+        mEntries.push_back(std::move(entry));
+    }
+    mCondition.notify_one();
+    return entryId;
+}
+
+void Builder::Cancel(int entryId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto iter = mEntries.begin(); iter != mEntries.end(); ++iter)
+    {
+        if ((*iter)->mId != entryId)
+        {
+            continue;
+        }
+        if ((*iter)->mbStarted)
+        {
+            (*iter)->mbCancelled = true;
+        }
+        else
+        {
+            mEntries.erase(iter);
+        }
+        return;
+    }
+}
+
+void Builder::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& entry : mEntries)
+    {
+        entry->mbCancelled = true;
+    }
+    mEntries.erase(std::remove_if(mEntries.begin(),
+                                  mEntries.end(),
+                                  [](const std::unique_ptr<Entry>& entry) { return !entry->mbStarted; }),
+                   mEntries.end());
 }
 
 EvaluationStages BuildEvaluationFromMaterial(Material& material)
@@ -1020,31 +1765,36 @@ EvaluationStages BuildEvaluationFromMaterial(Material& material)
     return evaluationStages;
 }
 
-void Builder::Add(Material* material)
+int Builder::Add(Material* material, int priority)
 {
     try
     {
-        Add(material->mName.c_str(), BuildEvaluationFromMaterial(*material));
+        return Add(material->mName.c_str(), BuildEvaluationFromMaterial(*material), priority);
     }
     catch (std::exception e)
     {
         Log("Exception : %s\n", e.what());
     }
+    return -1;
 }
 
 bool Builder::UpdateBuildInfo(std::vector<BuildInfo>& buildInfo)
 {
-    if (mMutex.try_lock())
+    // workers only lock to pick or remove an entry
+    std::lock_guard<std::mutex> lock(mMutex);
+    buildInfo.clear();
+    for (auto& entry : mEntries)
     {
-        buildInfo.clear();
-        for (auto& entry : mEntries)
-        {
-            buildInfo.push_back({entry.mName, entry.mProgress});
-        }
-        mMutex.unlock();
-        return true;
+        buildInfo.push_back({entry->mId, entry->mName, entry->mProgress});
     }
-    return false;
+    return true;
+}
+
+bool Builder::IsBuilding()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return std::any_of(
+        mEntries.begin(), mEntries.end(), [](const std::unique_ptr<Entry>& entry) { return entry->mbStarted; });
 }
 
 void Builder::DoBuild(Entry& entry)
@@ -1069,7 +1819,10 @@ void Builder::DoBuild(Entry& entry)
         if (forceEval)
         {
             EvaluationContext writeContext(evaluationStages, true, 1024, 1024);
-            for (int frame = node.mStartFrame; frame <= node.mEndFrame; frame++)
+            // frame N is read back and encoded while frame N+1 renders
+            FramePipeline framePipeline;
+            writeContext.mFramePipeline = &framePipeline;
+            for (int frame = node.mStartFrame; frame <= node.mEndFrame && mbRunning && !entry.mbCancelled; frame++)
             {
                 writeContext.SetCurrentTime(frame);
                 evaluationStages.SetTime(&writeContext, frame, false);
@@ -1078,39 +1831,56 @@ void Builder::DoBuild(Entry& entry)
                 evaluationInfo.forcedDirty = 1;
                 evaluationInfo.uiPass = 0;
                 writeContext.RunSingle(i, evaluationInfo);
+                framePipeline.Update();
+            }
+            if (framePipeline.Finish() != EVAL_OK)
+            {
+                Log("%s - some frames could not be written.\n", entry.mName.c_str());
             }
         }
         entry.mProgress = float(i + 1) / float(stageCount);
-        if (!mbRunning)
+        if (!mbRunning || entry.mbCancelled)
             break;
     }
 }
 
-void MakeThreadContext();
-void Builder::BuildEntries()
+Builder::Entry* Builder::PickEntry()
 {
-    MakeThreadContext();
+    Entry* best = nullptr;
+    for (auto& entry : mEntries)
+    {
+        if (!entry->mbStarted && (!best || entry->mPriority > best->mPriority))
+        {
+            best = entry.get();
+        }
+    }
+    return best;
+}
 
-    while (mbRunning)
+void Builder::BuildEntries(int workerIndex)
+{
+    MakeThreadContext(workerIndex);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
     {
-        if (mMutex.try_lock())
+        Entry* entry = nullptr;
+        mCondition.wait(lock, [&]() { return !mbRunning || (entry = PickEntry()) != nullptr; });
+        if (!mbRunning)
         {
-            if (!mEntries.empty())
-            {
-                auto& entry = *mEntries.begin();
-                entry.mProgress = 0.01f;
-                DoBuild(entry);
-                entry.mProgress = 1.f;
-                if (entry.mProgress >= 1.f)
-                {
-                    mEntries.erase(mEntries.begin());
-                }
-            }
-            mMutex.unlock();
+            break;
         }
-#ifdef Sleep
-        Sleep(100);
-#endif
+        entry->mbStarted = true;
+        entry->mProgress = 0.01f;
+        lock.unlock();
+
+        DoBuild(*entry);
+        entry->mProgress = 1.f;
+
+        lock.lock();
+        mEntries.erase(std::find_if(mEntries.begin(), mEntries.end(), [entry](const std::unique_ptr<Entry>& other) {
+            return other.get() == entry;
+        }));
     }
 }
 
@@ -1121,8 +1891,7 @@ namespace DrawUICallbacks
     void DrawUIProgress(EvaluationContext* context, size_t nodeIndex)
     {
         glUseProgram(gDefaultShader.mProgressShader);
-        glUniform1f(glGetUniformLocation(gDefaultShader.mProgressShader, "time"),
-                    float(double(SDL_GetTicks()) / 1000.0));
+        glUniform1f(gDefaultShader.mProgressTimeLocation, float(double(SDL_GetTicks()) / 1000.0));
         context->mFSQuad.Render();
     }
 
@@ -1137,8 +1906,6 @@ namespace DrawUICallbacks
     void DrawUICubemap(EvaluationContext* context, size_t nodeIndex)
     {
         glUseProgram(gDefaultShader.mDisplayCubemapShader);
-        int tgt = glGetUniformLocation(gDefaultShader.mDisplayCubemapShader, "samplerCubemap");
-        glUniform1i(tgt, 0);
         glActiveTexture(GL_TEXTURE0);
         TexParam(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_TEXTURE_CUBE_MAP);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
@@ -27,7 +27,13 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
 #include "EvaluationStages.h"
+#include "UniformArena.h"
+#include "Profiler.h"
+
+struct ProgramReflection;
+struct FramePipeline;
 
 struct EvaluationInfo
 {
@@ -53,6 +59,10 @@ struct EvaluationInfo
 
     int mipmapNumber;
     int mipmapCount;
+
+    int mPadding[2];
+    float uvWindow[4]; // tiled evaluation: uv offset, uv scale. 0 when not tiled
+    float viewRots[16 * 6]; // cubemap face rotations, for layered cubemap rendering
 };
 
 struct Dirty
@@ -115,7 +125,30 @@ struct EvaluationContext
     {
         mbSynchronousEvaluation = synchronous;
     }
+    // editing context only: baking contexts share targets between stages
+    void EnableResultCache(bool enable)
+    {
+        mbUseResultCache = enable;
+    }
+    // synchronous contexts only: dispatch C jobs of independent nodes on the task scheduler
+    void EnableParallelJobs(bool enable)
+    {
+        mbParallelJobs = enable;
+    }
+    // editing context only: while parameters are dragged, GLSL nodes are evaluated at a fraction of the resolution.
+    // Once edits settle, approximate results are evaluated again at full resolution over a few frames.
+    void EnableProgressivePreview(bool enable)
+    {
+        mbProgressivePreview = enable;
+    }
+    void NotifyInteraction();
+    // return false when the job must run inline
+    bool AddParallelJob(int (*jobFunction)(void*), void* ptr, unsigned int size);
+    bool AddParallelMainJob(int (*jobFunction)(void*), void* ptr, unsigned int size);
+    void JobDone(int nodeIndex);
     void SetTargetDirty(size_t target, DirtyFlag dirtyflag, bool onlyChild = false);
+    // stages using an evaluator that has been reloaded
+    void SetNodeTypeDirty(size_t nodeType);
     int StageIsProcessing(size_t target) const
     {
         if (target >= mbProcessing.size())
@@ -133,6 +166,18 @@ struct EvaluationContext
 
     void AllocRenderTargetsForEditingPreview();
 
+    // tiled evaluation: uv offset and scale of the image part covered by render targets. NULL for the whole image
+    void SetTileWindow(const float* window);
+    bool IsTiled() const
+    {
+        return mTileWindow[2] > 0.f;
+    }
+    // since SetTileWindow, a source result couldn't be cropped to the window: cubemap or not RGBA8
+    bool HasUntileableSource() const
+    {
+        return mbUntileableSource;
+    }
+
     void AllocateComputeBuffer(int target, int elementCount, int elementSize);
     // edit context only
     void UserAddStage();
@@ -159,8 +204,11 @@ struct EvaluationContext
 
     EvaluationStages& mEvaluationStages;
     FullScreenTriangle mFSQuad;
-    unsigned int mEvaluationStateGLSLBuffer;
-    void DirtyAll();
+    UniformArena mUniformArena;
+    Profiler mProfiler;
+    // set while baking: file writes are pipelined with the next frames
+    FramePipeline* mFramePipeline;
+    void DirtyAll(DirtyFlag dirtyFlag = Dirty::All);
 
 protected:
     void PreRun();
@@ -170,29 +218,91 @@ protected:
     void EvaluateGLSLCompute(const EvaluationStage& evaluationStage, size_t index, EvaluationInfo& evaluationInfo);
     // return true if any node is still in processing state
     bool RunNodeList(const std::vector<size_t>& nodesToEvaluate);
+    void RunNodeListParallel(const std::vector<size_t>& nodesToEvaluate);
+    bool CanRunParallelJobs() const;
     void RunNode(size_t nodeIndex);
+    // C/Python part. return false if the GPU part must not be run
+    bool RunNodeCPU(size_t nodeIndex);
+    void RunNodeGPU(size_t nodeIndex);
+    void SetNodeEvaluationInfo(size_t nodeIndex);
 
     void RecurseBackward(size_t target, std::vector<size_t>& usedNodes);
 
     void BindTextures(const EvaluationStage& evaluationStage,
-                      unsigned int program,
+                      const ProgramReflection& reflection,
                       std::shared_ptr<RenderTarget> reusableTarget);
     void AllocRenderTargetsForBaking(const std::vector<size_t>& nodesToEvaluate);
+    // resample a node result evaluated at its own size in the tile window
+    void CropToTileWindow(size_t nodeIndex);
+    void RunProgressive(const std::vector<size_t>& nodesToEvaluate);
+    void UseProxyTarget(size_t nodeIndex, bool proxy);
+    void UpdateRefine(size_t nodeIndex);
+    // back to full resolution targets, approximate nodes are set dirty
+    void ResetProxies();
 
 
+    // multi-pass nodes keep their targets between evaluations
+    struct PassTargets
+    {
+        std::shared_ptr<RenderTarget> mPingPong;
+        // copy of the result mConvergencePeriod passes before a convergence test
+        std::shared_ptr<RenderTarget> mSnapshot;
+    };
+    PassTargets& GetPassTargets(size_t nodeIndex);
+    // returns the occlusion query of the test. queryTarget is bound for the test, its content is kept
+    unsigned int BeginConvergenceTest(const RenderTarget& current,
+                                      const RenderTarget& previous,
+                                      const RenderTarget& queryTarget,
+                                      float epsilon);
+    // false while the GPU is not done with the test, doesn't wait. The query is released once read
+    bool GetConvergenceResult(unsigned int& query, bool& converged);
+
     int GetBindedComputeBuffer(const EvaluationStage& evaluationStage) const;
+    // 0 when the stage result can't be cached
+    uint64_t ComputeStageHash(size_t nodeIndex) const;
 
 
     std::vector<std::shared_ptr<RenderTarget>> mStageTarget; // 1 per stage
+    std::vector<PassTargets> mPassTargets;                   // 1 per stage, empty for single pass nodes
     std::vector<ComputeBuffer> mComputeBuffers;
 #if USE_FFMPEG    
     std::map<std::string, FFMPEGCodec::Encoder*> mWriteStreams;
 #endif
+    // dirty state is only used by the thread that owns the context, like its GL resources
     std::vector<DirtyFlag> mDirtyFlags;
+    // scratch for dirty propagation: visited bitset and BFS queue
+    std::vector<uint64_t> mDirtyVisited;
+    std::vector<size_t> mDirtyQueue;
     std::vector<int> mbProcessing;
     std::vector<float> mProgress;
     std::vector<bool> mActive;
     EvaluationInfo mEvaluationInfo;
+    float mTileWindow[4];
+    bool mbUntileableSource = false;
+
+    std::vector<uint64_t> mStageHashes;
+    bool mbUseResultCache;
+
+    bool mbProgressivePreview;
+    uint64_t mLastInteraction;
+    int mProxyDivisor;   // 2 or 4, from the GPU cost of the last interactive evaluation
+    int mPreviewDivisor; // > 1 while evaluating proxies
+    std::vector<std::shared_ptr<RenderTarget>> mProxyTargets; // the target not in mStageTarget
+    std::vector<bool> mbProxyTarget;                          // mStageTarget is the low resolution one
+    std::vector<bool> mbRefine;                               // result computed from low resolution nodes
+
+    struct MainJob
+    {
+        int mNodeIndex;
+        int (*mFunction)(void*);
+        void* mBuffer;
+    };
+    bool mbParallelJobs;
+    std::mutex mJobMutex;
+    std::condition_variable mJobCondition;
+    std::vector<int> mPendingJobs;
+    std::vector<MainJob> mMainJobs;
+    std::thread::id mJobOwnerThread;
 
     std::vector<int> mStillDirty;
     int mDefaultWidth;
@@ -201,39 +311,62 @@ protected:
     unsigned int mRuntimeUniqueId; // material unique Id for thumbnail update
     int mCurrentTime;
 
-    unsigned int mParametersGLSLBuffer;
 };
 
+EvaluationStages BuildEvaluationFromMaterial(Material& material);
+
+// GL contexts shared with the rendering one, created by the application. 1 per builder worker
+extern int gThreadContextCount;
+void MakeThreadContext(int contextIndex);
+
 struct Builder
 {
-    Builder();
+    // workerCount -1 : 1 per hardware thread, bounded by gThreadContextCount
+    Builder(int workerCount = -1);
     ~Builder();
 
-    void Add(const char* graphName, const EvaluationStages& stages);
-    void Add(Material* material);
+    // higher priority entries are built first. return an id for Cancel
+    int Add(const char* graphName, const EvaluationStages& stages, int priority = 0);
+    int Add(Material* material, int priority = 0);
+    // pending entries are removed, running ones stop at the next node or frame
+    void Cancel(int entryId);
+    void CancelAll();
+
     struct BuildInfo
     {
+        int mId;
         std::string mName;
         float mProgress;
     };
 
     // return true if buildInfo has been updated
     bool UpdateBuildInfo(std::vector<BuildInfo>& buildInfo);
+    // true while a worker runs an entry
+    bool IsBuilding();
 
 private:
     std::mutex mMutex;
-    std::thread mThread;
+    std::condition_variable mCondition;
+    std::vector<std::thread> mWorkers;
 
     std::atomic_bool mbRunning;
 
     struct Entry
     {
+        int mId;
+        int mPriority;
         std::string mName;
-        float mProgress;
         EvaluationStages mEvaluationStages;
+        std::atomic<float> mProgress;
+        std::atomic_bool mbCancelled;
+        bool mbStarted;
     };
-    std::vector<Entry> mEntries;
-    void BuildEntries();
+    // pending and running entries, in order of addition. Guarded by mMutex
+    std::vector<std::unique_ptr<Entry>> mEntries;
+    int mNextEntryId;
+    // highest priority pending entry, nullptr if none
+    Entry* PickEntry();
+    void BuildEntries(int workerIndex);
     void DoBuild(Entry& entry);
 };
 
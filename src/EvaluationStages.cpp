@@ -153,12 +153,21 @@ void EvaluationStages::AddEvaluationInput(size_t target, int slot, int source)
 {
     if (mStages.size() <= target || mStages[target].mInput.mInputs[slot] == source)
         return;
+    if (mConsumers.size() == mStages.size())
+    {
+        RemoveConsumer(mStages[target].mInput.mInputs[slot], target);
+        mConsumers[source].push_back(target);
+    }
     mStages[target].mInput.mInputs[slot] = source;
     mStages[source].mUseCountByOthers++;
 }
 
 void EvaluationStages::DelEvaluationInput(size_t target, int slot)
 {
+    if (mConsumers.size() == mStages.size())
+    {
+        RemoveConsumer(mStages[target].mInput.mInputs[slot], target);
+    }
     mStages[mStages[target].mInput.mInputs[slot]].mUseCountByOthers--;
     mStages[target].mInput.mInputs[slot] = -1;
 }
@@ -166,12 +175,51 @@ void EvaluationStages::DelEvaluationInput(size_t target, int slot)
 void EvaluationStages::SetEvaluationOrder(const std::vector<size_t> nodeOrderList)
 {
     mEvaluationOrderList = nodeOrderList;
+    // the order is updated after any node or link change (undo/redo included). Good time to rebuild consumers.
+    BuildConsumers();
+}
+
+const std::vector<size_t>& EvaluationStages::GetConsumers(size_t index)
+{
+    if (mConsumers.size() != mStages.size())
+    {
+        BuildConsumers();
+    }
+    return mConsumers[index];
+}
+
+void EvaluationStages::BuildConsumers()
+{
+    mConsumers.resize(mStages.size());
+    for (auto& consumers : mConsumers)
+    {
+        consumers.clear();
+    }
+    for (size_t i = 0; i < mStages.size(); i++)
+    {
+        for (auto inp : mStages[i].mInput.mInputs)
+        {
+            if (inp >= 0 && inp < int(mStages.size()))
+                mConsumers[inp].push_back(i);
+        }
+    }
+}
+
+void EvaluationStages::RemoveConsumer(int source, size_t target)
+{
+    if (source < 0)
+        return;
+    auto& consumers = mConsumers[source];
+    auto iter = std::find(consumers.begin(), consumers.end(), target);
+    if (iter != consumers.end())
+        consumers.erase(iter);
 }
 
 void EvaluationStages::Clear()
 {
     mStages.clear();
     mEvaluationOrderList.clear();
+    mConsumers.clear();
     mAnimTrack.clear();
 }
 
@@ -465,8 +513,9 @@ void EvaluationStages::SetTime(EvaluationContext* evaluationContext, int time, b
                           ImClamp(time - stage.mStartFrame, 0, stage.mEndFrame - stage.mStartFrame),
                           updateDecoder);
         // bool enabled = time >= node.mStartFrame && time <= node.mEndFrame;
-        evaluationContext->SetTargetDirty(i, Dirty::Time);
     }
+    // every stage gets the time flag: no need to propagate to children
+    evaluationContext->DirtyAll(Dirty::Time);
 }
 
 bool EvaluationStages::IsIOPinned(size_t nodeIndex, size_t io, bool forOutput) const
@@ -591,11 +640,9 @@ void Scene::Draw(EvaluationContext *context, EvaluationInfo& evaluationInfo) con
         int index = mMeshIndex[i];
         if (index == -1)
             continue;
-        glBindBuffer(GL_UNIFORM_BUFFER, context->mEvaluationStateGLSLBuffer);
         memcpy(evaluationInfo.model, mWorldTransforms[i], sizeof(Mat4x4));
         FPU_MatrixF_x_MatrixF(evaluationInfo.model, evaluationInfo.viewProjection, evaluationInfo.modelViewProjection);
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(EvaluationInfo), &evaluationInfo, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        context->mUniformArena.Bind(2, &evaluationInfo, sizeof(EvaluationInfo));
         mMeshes[index].Draw();
     }
 }
@@ -221,6 +221,8 @@ struct EvaluationStages
     {
         return mEvaluationOrderList;
     }
+    // stages using index as an input
+    const std::vector<size_t>& GetConsumers(size_t index);
 
 
     const EvaluationStage& GetEvaluationStage(size_t index) const
@@ -263,6 +265,7 @@ struct EvaluationStages
     std::vector<AnimTrack> mAnimTrack;
     std::vector<EvaluationStage> mStages;
     std::vector<size_t> mEvaluationOrderList;
+    std::vector<std::vector<size_t>> mConsumers;
     std::vector<uint32_t> mPinnedParameters;
     std::vector<uint32_t> mPinnedIO; // 24bits input, 8 bits output
     int mFrameMin, mFrameMax;
@@ -271,5 +274,7 @@ protected:
 
     void StageIsAdded(int index);
     void StageIsDeleted(int index);
+    void BuildConsumers();
+    void RemoveConsumer(int source, size_t target);
     void InitDefaultParameters(EvaluationStage& stage);
 };
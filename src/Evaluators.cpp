@@ -27,6 +27,9 @@
 #include "EvaluationStages.h"
 #include "Bitmap.h"
 #include "EvaluationContext.h"
+#include "TiledEvaluation.h"
+#include "FramePipeline.h"
+#include "ImageKernels.h"
 #include <vector>
 #include <map>
 #include <string>
@@ -37,6 +40,8 @@
 #include "GPUBVH.h"
 #include "Camera.h"
 #include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
 #define CGLTF_IMPLEMENTATION
 #include "cgltf.h"
 #include "NodeGraphControler.h"
@@ -61,8 +66,11 @@ static const EValuationFunction evaluationFunctions[] = {
     {"SetEvaluationImageCube", (void*)EvaluationAPI::SetEvaluationImageCube},
     {"AllocateImage", (void*)EvaluationAPI::AllocateImage},
     {"FreeImage", (void*)Image::Free},
+    {"AcquireImage", (void*)Image::Acquire},
+    {"MakeImageWritable", (void*)Image::MakeWritable},
     {"SetThumbnailImage", (void*)EvaluationAPI::SetThumbnailImage},
     {"Evaluate", (void*)EvaluationAPI::Evaluate},
+    {"EvaluateToFile", (void*)EvaluationAPI::EvaluateToFile},
     {"SetBlendingMode", (void*)EvaluationAPI::SetBlendingMode},
     {"EnableDepthBuffer", (void*)EvaluationAPI::EnableDepthBuffer},
     {"EnableFrameClear", (void*)EvaluationAPI::EnableFrameClear},
@@ -92,6 +100,15 @@ static const EValuationFunction evaluationFunctions[] = {
     {"InitRenderer", (void*)EvaluationAPI::InitRenderer},
     {"UpdateRenderer", (void*)EvaluationAPI::UpdateRenderer},
     {"ReadGLTF", (void*)EvaluationAPI::ReadGLTF},
+
+    {"ResizeImage", (void*)ImageKernels::Resize},
+    {"ConvolveImage", (void*)ImageKernels::Convolve},
+    {"ConvertImage", (void*)ImageKernels::Convert},
+    {"PremultiplyImage", (void*)ImageKernels::Premultiply},
+    {"UnpremultiplyImage", (void*)ImageKernels::Unpremultiply},
+    {"SwizzleImage", (void*)ImageKernels::Swizzle},
+    {"ImageHistogram", (void*)ImageKernels::Histogram},
+    {"ImageMinMax", (void*)ImageKernels::MinMax},
 };
 
 static void libtccErrorFunc(void* opaque, const char* msg)
@@ -100,12 +117,66 @@ static void libtccErrorFunc(void* opaque, const char* msg)
     Log("\n");
 }
 
+#if USE_NATIVE_C
+static const char* NativeCacheDirectory = "NativeCache";
+
+static std::string GetNativeCompileCommand(const std::string& sourcePath, const std::string& libraryPath)
+{
+    const char* compiler = getenv("CC");
+    std::string command = compiler ? compiler : "cc";
+    // nodes are written for libtcc that doesn't check function pointer types
+    command += " -O3 -march=native -shared -fPIC -Wno-main -Wno-incompatible-pointer-types -DIMOGEN_NATIVE -INodes/C/";
+    return command + " -o \"" + libraryPath + "\" \"" + sourcePath + "\" -lm 2>&1";
+}
+
+// keyed by the node source, Imogen.h and the compiler command
+static std::string GetNativeLibraryPath(const std::string& filename,
+                                        const std::string& sourceText,
+                                        const std::string& headerText)
+{
+    const std::string command = GetNativeCompileCommand("", "");
+    uint64_t key = Hash(sourceText.c_str(), sourceText.size());
+    key = Hash(headerText.c_str(), headerText.size(), key);
+    key = Hash(command.c_str(), command.size(), key);
+    char path[512];
+    snprintf(path,
+             sizeof(path),
+             "%s/%s_%016llx.so",
+             NativeCacheDirectory,
+             ReplaceAll(filename, ".c", "").c_str(),
+             (unsigned long long)key);
+    return path;
+}
+
+static bool CompileNativeLibrary(const std::string& sourcePath, const std::string& libraryPath)
+{
+    mkdir(NativeCacheDirectory, 0755);
+    // an interrupted build must not leave a library in the cache
+    const std::string temporaryPath = libraryPath + ".tmp";
+    FILE* output = popen(GetNativeCompileCommand(sourcePath, temporaryPath).c_str(), "r");
+    if (!output)
+        return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), output))
+    {
+        Log(line);
+    }
+    if (pclose(output) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return rename(temporaryPath.c_str(), libraryPath.c_str()) == 0;
+}
+#endif
+
 void LogPython(const std::string& str)
 {
     Log(str.c_str());
 }
 
 #if USE_PYTHON
+#include "pybind11/numpy.h"
 PYBIND11_MAKE_OPAQUE(Image);
 
 struct PyGraph
@@ -127,11 +198,90 @@ void RenderImogenFrame();
 void NodeGraphLayout();
 void NodeGraphUpdateScrolling();
 void NodeGraphUpdateEvaluationOrder(NodeGraphControlerBase* delegate);
+void NodeGraphBenchmarkEvaluationOrder();
 
 
+// first mip of the image. Cubemap faces are the outer dimension: (faces,) height, width, components
+static pybind11::buffer_info GetImageBufferInfo(Image& image)
+{
+    if (!image.GetBits() || image.mFormat >= TextureFormat::Count)
+    {
+        throw pybind11::value_error("Image has no pixels");
+    }
+    // components are not in RGB(A) order or are not 1 per channel
+    if (image.mFormat == TextureFormat::BGR8 || image.mFormat == TextureFormat::BGRA8 ||
+        image.mFormat == TextureFormat::RGBE || image.mFormat == TextureFormat::RGBM)
+    {
+        throw pybind11::value_error("Image format has no RGB/RGBA buffer view, convert it first");
+    }
+    const ssize_t texelSize = textureFormatSize[image.mFormat];
+    const ssize_t componentCount = textureComponentCount[image.mFormat];
+    const ssize_t componentSize = texelSize / componentCount;
+    std::string format = pybind11::format_descriptor<uint8_t>::format();
+    if (image.mFormat == TextureFormat::RGB16F || image.mFormat == TextureFormat::RGBA16F)
+    {
+        format = "e";
+    }
+    else if (componentSize == 2)
+    {
+        format = pybind11::format_descriptor<uint16_t>::format();
+    }
+    else if (componentSize == 4)
+    {
+        format = pybind11::format_descriptor<float>::format();
+    }
+
+    std::vector<ssize_t> shape = {image.mHeight, image.mWidth, componentCount};
+    std::vector<ssize_t> strides = {image.mWidth * texelSize, texelSize, componentSize};
+    if (image.mNumFaces > 1)
+    {
+        // faces are stored with all their mips
+        ssize_t faceSize = 0;
+        for (int i = 0; i < std::max(int(image.mNumMips), 1); i++)
+        {
+            faceSize += (image.mWidth >> i) * (image.mHeight >> i) * texelSize;
+        }
+        shape.insert(shape.begin(), image.mNumFaces);
+        strides.insert(strides.begin(), faceSize);
+    }
+    // numpy may write the pixels
+    return pybind11::buffer_info(
+        image.GetWritableBits(), componentSize, format, ssize_t(shape.size()), std::move(shape), std::move(strides));
+}
+
+// RGB/RGBA of uint8, uint16, float16 or float32. (height, width, components) or (6, height, width, components)
+static bool GetImageFormat(const pybind11::buffer_info& info, uint8_t& textureFormat)
+{
+    if ((info.ndim != 3 && info.ndim != 4) || (info.ndim == 4 && info.shape[0] != 6))
+        return false;
+    const ssize_t componentCount = info.shape[info.ndim - 1];
+    if (componentCount != 3 && componentCount != 4)
+        return false;
+    const bool rgba = componentCount == 4;
+    if (info.format == pybind11::format_descriptor<uint8_t>::format())
+        textureFormat = rgba ? TextureFormat::RGBA8 : TextureFormat::RGB8;
+    else if (info.format == pybind11::format_descriptor<uint16_t>::format())
+        textureFormat = rgba ? TextureFormat::RGBA16 : TextureFormat::RGB16;
+    else if (info.format == "e")
+        textureFormat = rgba ? TextureFormat::RGBA16F : TextureFormat::RGB16F;
+    else if (info.format == pybind11::format_descriptor<float>::format())
+        textureFormat = rgba ? TextureFormat::RGBA32F : TextureFormat::RGB32F;
+    else
+        return false;
+    return true;
+}
+
 PYBIND11_EMBEDDED_MODULE(Imogen, m)
 {
-    pybind11::class_<Image>(m, "Image");
+    pybind11::class_<EvaluationContext>(m, "EvaluationContext");
+    pybind11::class_<Image>(m, "Image", pybind11::buffer_protocol())
+        .def(pybind11::init<>())
+        .def_readonly("width", &Image::mWidth)
+        .def_readonly("height", &Image::mHeight)
+        .def_readonly("mipCount", &Image::mNumMips)
+        .def_readonly("faceCount", &Image::mNumFaces)
+        .def_readonly("format", &Image::mFormat)
+        .def_buffer(GetImageBufferInfo);
 
     m.def("Render", []() { RenderImogenFrame(); });
     m.def("CaptureScreen", [](const std::string& filename, const std::string& content) {
@@ -158,6 +308,34 @@ PYBIND11_EMBEDDED_MODULE(Imogen, m)
         NodeGraphUpdateScrolling();
     });
     m.def("DeleteGraph", []() { Imogen::instance->DeleteCurrentMaterial(); });
+    m.def("BenchmarkEvaluationOrder", []() { NodeGraphBenchmarkEvaluationOrder(); });
+    m.def("EnableProfiler", [](bool enable) {
+        Imogen::instance->GetNodeGraphControler()->mEditingContext.mProfiler.Enable(enable);
+    });
+    m.def("ExportProfilerTrace", [](const std::string& filename) -> bool {
+        return Imogen::instance->GetNodeGraphControler()->mEditingContext.mProfiler.ExportChromeTrace(filename);
+    });
+    m.def("GetImageCacheStats", []() {
+        const ImageCacheStats stats = gImageCache.GetStats();
+        auto d = pybind11::dict();
+        d["images"] = stats.mImageCount;
+        d["cpuUsage"] = stats.mCPUUsage;
+        d["cpuBudget"] = stats.mCPUBudget;
+        d["textures"] = stats.mTextureCount;
+        d["gpuUsage"] = stats.mGPUUsage;
+        d["gpuBudget"] = stats.mGPUBudget;
+        d["hits"] = stats.mHitCount;
+        d["misses"] = stats.mMissCount;
+        d["evictions"] = stats.mEvictionCount;
+        d["reloads"] = stats.mInvalidationCount;
+        return d;
+    });
+    // budgets in bytes
+    m.def("SetImageCacheBudgets", [](size_t cpuBudget, size_t gpuBudget) {
+        gImageCache.SetCPUBudget(cpuBudget);
+        gImageCache.SetGPUBudget(gpuBudget);
+    });
+    m.def("ClearImageCache", []() { gImageCache.Clear(); });
 
 
     m.def("GetMetaNodes", []() {
@@ -397,11 +575,50 @@ PYBIND11_EMBEDDED_MODULE(Imogen, m)
     m.def("WriteImage", Image::Write);
     m.def("GetEvaluationImage", EvaluationAPI::GetEvaluationImage);
     m.def("SetEvaluationImage", EvaluationAPI::SetEvaluationImage);
+    // numpy arrays without copy: the array is a view on the image pixels
+    m.def("GetEvaluationImage", [](EvaluationContext* context, int target) -> pybind11::object {
+        std::unique_ptr<Image> image = std::make_unique<Image>();
+        int result;
+        {
+            pybind11::gil_scoped_release release;
+            result = EvaluationAPI::GetEvaluationImage(context, target, image.get());
+        }
+        if (result != EVAL_OK)
+            return pybind11::none();
+        pybind11::buffer_info info = GetImageBufferInfo(*image);
+        pybind11::object owner = pybind11::cast(image.release(), pybind11::return_value_policy::take_ownership);
+        return pybind11::array(pybind11::dtype(info), info.shape, info.strides, info.ptr, owner);
+    });
+    m.def("SetEvaluationImage", [](EvaluationContext* context, int target, pybind11::array pixels) -> int {
+        pybind11::buffer_info info = pixels.request();
+        Image image;
+        if (!(pixels.flags() & pybind11::array::c_style) || !GetImageFormat(info, image.mFormat))
+        {
+            Log("SetEvaluationImage: expecting a contiguous RGB/RGBA array of uint8, uint16, float16 or float32\n");
+            return EVAL_ERR;
+        }
+        image.mDecoder = NULL;
+        image.mNumFaces = (info.ndim == 4) ? 6 : 1;
+        image.mNumMips = 1;
+        image.mHeight = int(info.shape[info.ndim - 3]);
+        image.mWidth = int(info.shape[info.ndim - 2]);
+        image.Attach((unsigned char*)info.ptr, info.size * info.itemsize);
+        int result;
+        {
+            pybind11::gil_scoped_release release;
+            result = EvaluationAPI::SetEvaluationImage(context, target, &image);
+        }
+        image.Release();
+        return result;
+    });
     m.def("SetEvaluationImageCube", EvaluationAPI::SetEvaluationImageCube);
     m.def("AllocateImage", EvaluationAPI::AllocateImage);
     m.def("FreeImage", Image::Free);
+    m.def("AcquireImage", Image::Acquire);
+    m.def("MakeImageWritable", Image::MakeWritable);
     m.def("SetThumbnailImage", EvaluationAPI::SetThumbnailImage);
     m.def("Evaluate", EvaluationAPI::Evaluate);
+    m.def("EvaluateToFile", EvaluationAPI::EvaluateToFile);
     m.def("SetBlendingMode", EvaluationAPI::SetBlendingMode);
     m.def("GetEvaluationSize", EvaluationAPI::GetEvaluationSize);
     m.def("SetEvaluationSize", EvaluationAPI::SetEvaluationSize);
@@ -463,14 +680,201 @@ PYBIND11_EMBEDDED_MODULE(Imogen, m)
 }
 #endif
 
+static const char* sampler2DName[] = {
+    "Sampler0", "Sampler1", "Sampler2", "Sampler3", "Sampler4", "Sampler5", "Sampler6", "Sampler7"};
+static const char* samplerCubeName[] = {"CubeSampler0",
+                                        "CubeSampler1",
+                                        "CubeSampler2",
+                                        "CubeSampler3",
+                                        "CubeSampler4",
+                                        "CubeSampler5",
+                                        "CubeSampler6",
+                                        "CubeSampler7"};
+
+// bind uniform blocks and sampler units once so evaluation doesn't look them up per draw
+static void ReflectProgram(unsigned int program, const std::string& nodeName, ProgramReflection& reflection)
+{
+    reflection = ProgramReflection();
+    if (!program)
+        return;
+
+    reflection.mParameterBlockIndex = glGetUniformBlockIndex(program, (nodeName + "Block").c_str());
+    if (reflection.mParameterBlockIndex != -1)
+        glUniformBlockBinding(program, reflection.mParameterBlockIndex, 1);
+
+    reflection.mEvaluationBlockIndex = glGetUniformBlockIndex(program, "EvaluationBlock");
+    if (reflection.mEvaluationBlockIndex != -1)
+        glUniformBlockBinding(program, reflection.mEvaluationBlockIndex, 2);
+
+    glUseProgram(program);
+    for (int i = 0; i < 8; i++)
+    {
+        int location = glGetUniformLocation(program, sampler2DName[i]);
+        if (location != -1)
+        {
+            reflection.mSamplerTypes[i] = GL_SAMPLER_2D;
+        }
+        else
+        {
+            location = glGetUniformLocation(program, samplerCubeName[i]);
+            if (location == -1)
+                continue;
+            reflection.mSamplerTypes[i] = GL_SAMPLER_CUBE;
+        }
+        glUniform1i(location, i);
+    }
+    glUseProgram(0);
+}
+
 std::string Evaluators::GetEvaluator(const std::string& filename)
 {
     return mEvaluatorScripts[filename].mText;
 }
 
+bool Evaluators::ReadScript(const EvaluatorFile& file)
+{
+    std::ifstream t(file.mDirectory + file.mFilename);
+    if (!t.good())
+        return false;
+    std::string str((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+    auto iter = mEvaluatorScripts.find(file.mFilename);
+    if (iter == mEvaluatorScripts.end())
+        mEvaluatorScripts[file.mFilename] = EvaluatorScript(str);
+    else
+        iter->second.mText = str;
+    return true;
+}
+
+void Evaluators::SpliceGLSL(EvaluatorScript& shader, const std::string& filename)
+{
+    const std::string& baseShader = mEvaluatorScripts["Shader.glsl"].mText;
+    std::string shaderText = ReplaceAll(baseShader, "__NODE__", shader.mText);
+    std::string nodeName = ReplaceAll(filename, ".glsl", "");
+    shader.mShaderText = ReplaceAll(shaderText, "__FUNCTION__", nodeName + "()");
+    shader.mNodeName = nodeName;
+
+    const std::string& text = shader.mText;
+    shader.mbTimeDependent = text.find("EvaluationParam.frame") != std::string::npos ||
+                             text.find("EvaluationParam.localFrame") != std::string::npos;
+    shader.mbCacheable = text.find("EvaluationParam.mouse") == std::string::npos &&
+                         text.find("EvaluationParam.keyModifier") == std::string::npos &&
+                         text.find("EvaluationParam.dirtyFlag") == std::string::npos;
+    // nodes rendering cubemaps compute the direction from viewRot
+    shader.mbHasLayeredCube = text.find("EvaluationParam.viewRot") != std::string::npos;
+    if (shader.mType != -1)
+    {
+        Evaluator& evaluator = mEvaluatorPerNodeType[shader.mType];
+        evaluator.mbTimeDependent = shader.mbTimeDependent;
+        evaluator.mbCacheable = shader.mbCacheable;
+    }
+}
+
+unsigned int Evaluators::LoadGLSLCompute(EvaluatorScript& shader, const std::string& filename)
+{
+    // std::string shaderText = ReplaceAll(baseShader, "__NODE__", shader.mText);
+    std::string nodeName = ReplaceAll(filename, ".glslc", "");
+    // shaderText = ReplaceAll(shaderText, "__FUNCTION__", nodeName + "()");
+
+    unsigned int program = 0;
+    if (nodeName == filename)
+    {
+        // glsl in compute directory
+        nodeName = ReplaceAll(filename, ".glsl", "");
+        program = LoadShader(shader.mText, filename.c_str());
+    }
+    else
+    {
+        program = LoadShaderTransformFeedback(shader.mText, filename.c_str());
+    }
+    if (!program)
+        return 0;
+
+    ReflectProgram(program, nodeName, shader.mReflection);
+
+    shader.mProgram = program;
+    if (shader.mType != -1)
+    {
+        mEvaluatorPerNodeType[shader.mType].mGLSLProgram = program;
+        mEvaluatorPerNodeType[shader.mType].mReflection = shader.mReflection;
+    }
+    return program;
+}
+
+#if USE_LIBTCC
+bool Evaluators::LoadC(const EvaluatorFile& file, bool hotEdit)
+{
+    const std::string& filename = file.mFilename;
+    EvaluatorScript& program = mEvaluatorScripts[filename];
+    try
+    {
+#if USE_NATIVE_C
+        if (LoadNativeC(file.mDirectory, filename, program, hotEdit))
+        {
+            if (program.mType != -1)
+            {
+                mEvaluatorPerNodeType[program.mType].mCFunction = program.mCFunction;
+                mEvaluatorPerNodeType[program.mType].mMem = program.mMem;
+            }
+            return true;
+        }
+#endif
+        TCCState* s = tcc_new();
+
+        int* noLib = (int*)s;
+        noLib[2] = 1; // no stdlib
+
+        tcc_set_error_func(s, 0, libtccErrorFunc);
+        tcc_add_include_path(s, "Nodes/C/");
+        tcc_set_output_type(s, TCC_OUTPUT_MEMORY);
+
+        if (tcc_compile_string(s, program.mText.c_str()) != 0)
+        {
+            Log("%s - Compilation error!\n", filename.c_str());
+            tcc_delete(s);
+            return false;
+        }
+
+        for (auto& evaluationFunction : evaluationFunctions)
+            tcc_add_symbol(s, evaluationFunction.szFunctionName, evaluationFunction.function);
+
+        int size = tcc_relocate(s, NULL);
+        if (size == -1)
+        {
+            Log("%s - Libtcc unable to relocate program!\n", filename.c_str());
+            tcc_delete(s);
+            return false;
+        }
+        program.mMem = malloc(size);
+        tcc_relocate(s, program.mMem);
+
+        *(void**)(&program.mCFunction) = tcc_get_symbol(s, "main");
+        if (!program.mCFunction)
+        {
+            Log("%s - No main function!\n", filename.c_str());
+        }
+        tcc_delete(s);
+
+        if (program.mType != -1)
+        {
+            mEvaluatorPerNodeType[program.mType].mCFunction = program.mCFunction;
+            mEvaluatorPerNodeType[program.mType].mMem = program.mMem;
+        }
+    }
+    catch (...)
+    {
+        Log("Error at compiling %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
+
 void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilenames)
 {
     ClearEvaluators();
+    gProgramCacheStats.mHits = 0;
+    gProgramCacheStats.mMisses = 0;
+    mEvaluatorFiles = evaluatorfilenames;
 
     mEvaluatorPerNodeType.clear();
     mEvaluatorPerNodeType.resize(evaluatorfilenames.size(), Evaluator());
@@ -480,21 +884,10 @@ void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilena
     {
         if (file.mEvaluatorType != EVALUATOR_GLSL && file.mEvaluatorType != EVALUATOR_GLSLCOMPUTE)
             continue;
-        const std::string filename = file.mFilename;
-
-        std::ifstream t(file.mDirectory + filename);
-        if (t.good())
-        {
-            std::string str((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
-            if (mEvaluatorScripts.find(filename) == mEvaluatorScripts.end())
-                mEvaluatorScripts[filename] = EvaluatorScript(str);
-            else
-                mEvaluatorScripts[filename].mText = str;
-        }
+        ReadScript(file);
     }
 
     // GLSL
-    std::string baseShader = mEvaluatorScripts["Shader.glsl"].mText;
     for (auto& file : evaluatorfilenames)
     {
         if (file.mEvaluatorType != EVALUATOR_GLSL)
@@ -505,25 +898,16 @@ void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilena
             continue;
 
         EvaluatorScript& shader = mEvaluatorScripts[filename];
-        std::string shaderText = ReplaceAll(baseShader, "__NODE__", shader.mText);
-        std::string nodeName = ReplaceAll(filename, ".glsl", "");
-        shaderText = ReplaceAll(shaderText, "__FUNCTION__", nodeName + "()");
-
-        unsigned int program = LoadShader(shaderText, filename.c_str());
-        int parameterBlockIndex = glGetUniformBlockIndex(program, (nodeName + "Block").c_str());
-        if (parameterBlockIndex != -1)
-            glUniformBlockBinding(program, parameterBlockIndex, 1);
-
-        parameterBlockIndex = glGetUniformBlockIndex(program, "EvaluationBlock");
-        if (parameterBlockIndex != -1)
-            glUniformBlockBinding(program, parameterBlockIndex, 2);
+        SpliceGLSL(shader, filename);
 
-        shader.mProgram = program;
+        // built on first use or when pre-warming
+        mPrewarmQueue.push_back(&shader);
         if (shader.mType != -1)
-            mEvaluatorPerNodeType[shader.mType].mGLSLProgram = program;
+        {
+            SetGLSLScript(shader.mType, &shader);
+        }
     }
 
-
     TagTime("GLSL init");
 
     // GLSL compute
@@ -531,36 +915,7 @@ void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilena
     {
         if (file.mEvaluatorType != EVALUATOR_GLSLCOMPUTE)
             continue;
-        const std::string filename = file.mFilename;
-
-        EvaluatorScript& shader = mEvaluatorScripts[filename];
-        // std::string shaderText = ReplaceAll(baseShader, "__NODE__", shader.mText);
-        std::string nodeName = ReplaceAll(filename, ".glslc", "");
-        // shaderText = ReplaceAll(shaderText, "__FUNCTION__", nodeName + "()");
-
-        unsigned int program = 0;
-        if (nodeName == filename)
-        {
-            // glsl in compute directory
-            nodeName = ReplaceAll(filename, ".glsl", "");
-            program = LoadShader(shader.mText, filename.c_str());
-        }
-        else
-        {
-            program = LoadShaderTransformFeedback(shader.mText, filename.c_str());
-        }
-
-        int parameterBlockIndex = glGetUniformBlockIndex(program, (nodeName + "Block").c_str());
-        if (parameterBlockIndex != -1)
-            glUniformBlockBinding(program, parameterBlockIndex, 1);
-
-        parameterBlockIndex = glGetUniformBlockIndex(program, "EvaluationBlock");
-        if (parameterBlockIndex != -1)
-            glUniformBlockBinding(program, parameterBlockIndex, 2);
-
-        shader.mProgram = program;
-        if (shader.mType != -1)
-            mEvaluatorPerNodeType[shader.mType].mGLSLProgram = program;
+        LoadGLSLCompute(mEvaluatorScripts[file.mFilename], file.mFilename);
     }
     TagTime("GLSL compute init");
     #if USE_LIBTCC
@@ -570,66 +925,14 @@ void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilena
         if (file.mEvaluatorType != EVALUATOR_C)
             continue;
         const std::string filename = file.mFilename;
-        try
+        const bool hotEdit = mEvaluatorScripts.find(filename) != mEvaluatorScripts.end();
+        if (!ReadScript(file))
         {
-            std::ifstream t(file.mDirectory + filename);
-            if (!t.good())
-            {
-                Log("%s - Unable to load file.\n", filename.c_str());
-                continue;
-            }
-            Log("%s\n", filename.c_str());
-            std::string str((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
-            if (mEvaluatorScripts.find(filename) == mEvaluatorScripts.end())
-                mEvaluatorScripts[filename] = EvaluatorScript(str);
-            else
-                mEvaluatorScripts[filename].mText = str;
-
-            EvaluatorScript& program = mEvaluatorScripts[filename];
-            TCCState* s = tcc_new();
-
-            int* noLib = (int*)s;
-            noLib[2] = 1; // no stdlib
-
-            tcc_set_error_func(s, 0, libtccErrorFunc);
-            tcc_add_include_path(s, "Nodes/C/");
-            tcc_set_output_type(s, TCC_OUTPUT_MEMORY);
-
-            if (tcc_compile_string(s, program.mText.c_str()) != 0)
-            {
-                Log("%s - Compilation error!\n", filename.c_str());
-                continue;
-            }
-
-            for (auto& evaluationFunction : evaluationFunctions)
-                tcc_add_symbol(s, evaluationFunction.szFunctionName, evaluationFunction.function);
-
-            int size = tcc_relocate(s, NULL);
-            if (size == -1)
-            {
-                Log("%s - Libtcc unable to relocate program!\n", filename.c_str());
-                continue;
-            }
-            program.mMem = malloc(size);
-            tcc_relocate(s, program.mMem);
-
-            *(void**)(&program.mCFunction) = tcc_get_symbol(s, "main");
-            if (!program.mCFunction)
-            {
-                Log("%s - No main function!\n", filename.c_str());
-            }
-            tcc_delete(s);
-
-            if (program.mType != -1)
-            {
-                mEvaluatorPerNodeType[program.mType].mCFunction = program.mCFunction;
-                mEvaluatorPerNodeType[program.mType].mMem = program.mMem;
-            }
-        }
-        catch (...)
-        {
-            Log("Error at compiling %s", filename.c_str());
+            Log("%s - Unable to load file.\n", filename.c_str());
+            continue;
         }
+        Log("%s\n", filename.c_str());
+        LoadC(file, hotEdit);
     }
     TagTime("C init");
     #endif
@@ -660,13 +963,375 @@ void Evaluators::SetEvaluators(const std::vector<EvaluatorFile>& evaluatorfilena
 void Evaluators::ClearEvaluators()
 {
     // clear
+    std::lock_guard<std::mutex> lock(mProgramMutex);
+    for (auto& script : mEvaluatorScripts)
+    {
+        EvaluatorScript& shader = script.second;
+        for (int variant = 0; variant < 2; variant++)
+        {
+            if (shader.mBuildState[variant] == EvaluatorScript::Building)
+            {
+                EndBuild(shader, variant);
+            }
+            shader.mBuildState[variant] = EvaluatorScript::NotBuilt;
+        }
+        if (shader.mProgram)
+            glDeleteProgram(shader.mProgram);
+        if (shader.mLayeredCubeProgram)
+            glDeleteProgram(shader.mLayeredCubeProgram);
+        shader.mProgram = 0;
+        shader.mLayeredCubeProgram = 0;
+    }
+    mPrewarmQueue.clear();
+    mGLSLScriptPerNodeType.clear();
+#if USE_NATIVE_C
+    for (auto& script : mEvaluatorScripts)
+    {
+        EvaluatorScript& program = script.second;
+        if (program.mNativeLibrary)
+        {
+            dlclose(program.mNativeLibrary);
+            program.mNativeLibrary = NULL;
+            program.mCFunction = NULL;
+        }
+    }
+#endif
     for (auto& program : mEvaluatorPerNodeType)
     {
-        if (program.mGLSLProgram)
-            glDeleteProgram(program.mGLSLProgram);
         if (program.mMem)
             free(program.mMem);
     }
+    ReleaseRetiredCode(true);
+}
+
+#if USE_NATIVE_C
+bool Evaluators::LoadNativeC(const std::string& directory,
+                             const std::string& filename,
+                             EvaluatorScript& script,
+                             bool hotEdit)
+{
+    std::ifstream header(directory + "Imogen.h");
+    std::string headerText((std::istreambuf_iterator<char>(header)), std::istreambuf_iterator<char>());
+    const std::string sourcePath = directory + filename;
+    const std::string libraryPath = GetNativeLibraryPath(filename, script.mText, headerText);
+
+    FILE* fp = fopen(libraryPath.c_str(), "rb");
+    if (fp)
+    {
+        fclose(fp);
+    }
+    else
+    {
+        auto build = mNativeBuilds.find(libraryPath);
+        if (build != mNativeBuilds.end() && build->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            // failed, try again with this edit
+            mNativeBuilds.erase(build);
+            build = mNativeBuilds.end();
+        }
+        if (hotEdit)
+        {
+            // libtcc while iterating, the native library is used from the next reload
+            if (build == mNativeBuilds.end())
+            {
+                mNativeBuilds[libraryPath] = std::async(std::launch::async, CompileNativeLibrary, sourcePath, libraryPath);
+            }
+            return false;
+        }
+        if (!CompileNativeLibrary(sourcePath, libraryPath))
+        {
+            Log("%s - Native compilation failed, using libtcc.\n", filename.c_str());
+            return false;
+        }
+    }
+
+    void* library = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+        Log("%s - %s\n", filename.c_str(), dlerror());
+        return false;
+    }
+    // Imogen functions are pointers in the library
+    for (auto& evaluationFunction : evaluationFunctions)
+    {
+        const std::string symbol = std::string("imogen_") + evaluationFunction.szFunctionName;
+        void** function = (void**)dlsym(library, symbol.c_str());
+        if (function)
+        {
+            *function = evaluationFunction.function;
+        }
+    }
+    *(void**)(&script.mCFunction) = dlsym(library, "main");
+    if (!script.mCFunction)
+    {
+        Log("%s - No main function!\n", filename.c_str());
+        dlclose(library);
+        return false;
+    }
+    script.mNativeLibrary = library;
+    script.mMem = NULL;
+    return true;
+}
+#endif
+
+void Evaluators::SetGLSLScript(size_t nodeType, EvaluatorScript* script)
+{
+    if (mGLSLScriptPerNodeType.size() <= nodeType)
+        mGLSLScriptPerNodeType.resize(nodeType + 1, nullptr);
+    mGLSLScriptPerNodeType[nodeType] = script;
+}
+
+void Evaluators::StartBuild(EvaluatorScript& script, int variant)
+{
+    const std::string shaderText = variant ? "#define LAYERED_CUBE\n" + script.mShaderText : script.mShaderText;
+    const std::string filename = script.mNodeName + ".glsl";
+    if (BeginLoadShader(shaderText, filename.c_str(), script.mBuilds[variant]))
+    {
+        script.mBuildState[variant] = EvaluatorScript::Building;
+    }
+    else
+    {
+        script.mBuildState[variant] = EvaluatorScript::Built;
+    }
+}
+
+void Evaluators::EndBuild(EvaluatorScript& script, int variant)
+{
+    unsigned int program = EndLoadShader(script.mBuilds[variant]);
+    script.mBuildState[variant] = EvaluatorScript::Built;
+    if (variant)
+    {
+        ProgramReflection layeredCubeReflection;
+        ReflectProgram(program, script.mNodeName, layeredCubeReflection);
+        script.mLayeredCubeProgram = program;
+    }
+    else
+    {
+        ReflectProgram(program, script.mNodeName, script.mReflection);
+        script.mProgram = program;
+    }
+    if (script.mType != -1)
+    {
+        Evaluator& evaluator = mEvaluatorPerNodeType[script.mType];
+        evaluator.mGLSLProgram = script.mProgram;
+        evaluator.mGLSLLayeredCubeProgram = script.mLayeredCubeProgram;
+        evaluator.mReflection = script.mReflection;
+    }
+}
+
+int Evaluators::ReloadEvaluator(const EvaluatorFile& file)
+{
+    const std::string& filename = file.mFilename;
+    EvaluatorScript& script = mEvaluatorScripts[filename];
+    if (file.mEvaluatorType == EVALUATOR_GLSL)
+    {
+        std::lock_guard<std::mutex> lock(mProgramMutex);
+        for (int variant = 0; variant < 2; variant++)
+        {
+            if (script.mBuildState[variant] == EvaluatorScript::Building)
+                EndBuild(script, variant);
+        }
+        SpliceGLSL(script, filename);
+        unsigned int program = LoadShader(script.mShaderText, filename.c_str());
+        if (!program)
+        {
+            Log("%s - Keeping the previous program.\n", filename.c_str());
+            return -1;
+        }
+        if (script.mProgram)
+            glDeleteProgram(script.mProgram);
+        if (script.mLayeredCubeProgram)
+            glDeleteProgram(script.mLayeredCubeProgram);
+        script.mLayeredCubeProgram = 0;
+        script.mBuildState[0] = EvaluatorScript::Built;
+        script.mBuildState[1] = EvaluatorScript::NotBuilt;
+        script.mProgram = program;
+        ReflectProgram(program, script.mNodeName, script.mReflection);
+        if (script.mType != -1)
+        {
+            Evaluator& evaluator = mEvaluatorPerNodeType[script.mType];
+            evaluator.mGLSLProgram = program;
+            evaluator.mGLSLLayeredCubeProgram = 0;
+            evaluator.mReflection = script.mReflection;
+        }
+    }
+    else if (file.mEvaluatorType == EVALUATOR_GLSLCOMPUTE)
+    {
+        unsigned int previousProgram = script.mProgram;
+        if (!LoadGLSLCompute(script, filename))
+        {
+            Log("%s - Keeping the previous program.\n", filename.c_str());
+            return -1;
+        }
+        if (previousProgram)
+            glDeleteProgram(previousProgram);
+    }
+#if USE_LIBTCC
+    else if (file.mEvaluatorType == EVALUATOR_C)
+    {
+        // the previous code is retired once the new one is loaded
+        void* previousMem = script.mMem;
+        void* previousLibrary = script.mNativeLibrary;
+        auto previousFunction = script.mCFunction;
+        script.mMem = NULL;
+        script.mNativeLibrary = NULL;
+        if (!LoadC(file, true) || !script.mCFunction)
+        {
+            free(script.mMem);
+            script.mMem = previousMem;
+            script.mNativeLibrary = previousLibrary;
+            script.mCFunction = previousFunction;
+            if (script.mType != -1)
+            {
+                mEvaluatorPerNodeType[script.mType].mCFunction = previousFunction;
+                mEvaluatorPerNodeType[script.mType].mMem = previousMem;
+            }
+            return -1;
+        }
+        mRetiredCode.push_back({previousMem, previousLibrary});
+    }
+#endif
+    else
+    {
+        return -1;
+    }
+    if (script.mType != -1)
+    {
+        mEvaluatorPerNodeType[script.mType].mRevision++;
+    }
+    return script.mType;
+}
+
+void Evaluators::ReleaseRetiredCode(bool force)
+{
+    if (mRetiredCode.empty())
+        return;
+    extern Builder* gBuilder;
+    if (!force && (mRunningJobs > 0 || (gBuilder && gBuilder->IsBuilding())))
+        return;
+    for (auto& code : mRetiredCode)
+    {
+        free(code.mMem);
+#if USE_NATIVE_C
+        if (code.mNativeLibrary)
+            dlclose(code.mNativeLibrary);
+#endif
+    }
+    mRetiredCode.clear();
+}
+
+void Evaluators::ReloadChangedEvaluators(std::vector<size_t>& nodeTypes)
+{
+    nodeTypes.clear();
+    ReleaseRetiredCode(false);
+    if (!mbWatchingFiles)
+    {
+        for (auto& file : mEvaluatorFiles)
+            mFileWatcher.Watch(file.mDirectory);
+        mbWatchingFiles = true;
+    }
+    std::vector<std::string> changedFiles;
+    mFileWatcher.Poll(changedFiles);
+    if (changedFiles.empty())
+        return;
+
+    // texts first: Shader.glsl and Imogen.h are used by every node of their directory
+    std::vector<const EvaluatorFile*> reloads;
+    for (auto& file : mEvaluatorFiles)
+    {
+        const std::string path = file.mDirectory + file.mFilename;
+        if (std::find(changedFiles.begin(), changedFiles.end(), path) != changedFiles.end())
+        {
+            if (!ReadScript(file))
+                continue;
+            Log("Reloading %s\n", file.mFilename.c_str());
+            reloads.push_back(&file);
+        }
+    }
+    for (auto& file : mEvaluatorFiles)
+    {
+        const bool sharedChanged =
+            (file.mEvaluatorType == EVALUATOR_GLSL &&
+             std::find(changedFiles.begin(), changedFiles.end(), file.mDirectory + "Shader.glsl") != changedFiles.end()) ||
+            (file.mEvaluatorType == EVALUATOR_C &&
+             std::find(changedFiles.begin(), changedFiles.end(), file.mDirectory + "Imogen.h") != changedFiles.end());
+        if (sharedChanged && std::find(reloads.begin(), reloads.end(), &file) == reloads.end())
+            reloads.push_back(&file);
+    }
+
+    for (auto file : reloads)
+    {
+        if (file->mFilename == "Shader.glsl")
+            continue;
+        int nodeType = ReloadEvaluator(*file);
+        if (nodeType != -1)
+            nodeTypes.push_back(size_t(nodeType));
+    }
+}
+
+bool Evaluators::GetProgram(size_t nodeType, bool layeredCube, bool wait, unsigned int& program)
+{
+    std::lock_guard<std::mutex> lock(mProgramMutex);
+    EvaluatorScript* script = (nodeType < mGLSLScriptPerNodeType.size()) ? mGLSLScriptPerNodeType[nodeType] : nullptr;
+    if (!script || (layeredCube && !script->mbHasLayeredCube))
+    {
+        program = layeredCube ? 0 : mEvaluatorPerNodeType[nodeType].mGLSLProgram;
+        return true;
+    }
+    const int variant = layeredCube ? 1 : 0;
+    if (script->mBuildState[variant] == EvaluatorScript::NotBuilt)
+    {
+        StartBuild(*script, variant);
+    }
+    if (script->mBuildState[variant] == EvaluatorScript::Building &&
+        (wait || IsShaderBuildComplete(script->mBuilds[variant])))
+    {
+        EndBuild(*script, variant);
+    }
+    program = variant ? script->mLayeredCubeProgram : script->mProgram;
+    return script->mBuildState[variant] == EvaluatorScript::Built;
+}
+
+void Evaluators::UpdatePrograms()
+{
+    // never wait for builder threads
+    std::unique_lock<std::mutex> lock(mProgramMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    int buildingCount = 0;
+    for (auto& script : mEvaluatorScripts)
+    {
+        for (int variant = 0; variant < 2; variant++)
+        {
+            EvaluatorScript& shader = script.second;
+            if (shader.mBuildState[variant] != EvaluatorScript::Building)
+                continue;
+            if (IsShaderBuildComplete(shader.mBuilds[variant]))
+                EndBuild(shader, variant);
+            else
+                buildingCount++;
+        }
+    }
+
+    if (mPrewarmQueue.empty())
+        return;
+    // without parallel compile, a build blocks the frame: 1 per frame
+    const int maxBuildingCount = IsParallelShaderCompileSupported() ? 4 : 1;
+    while (buildingCount < maxBuildingCount && !mPrewarmQueue.empty())
+    {
+        EvaluatorScript* script = mPrewarmQueue.front();
+        mPrewarmQueue.erase(mPrewarmQueue.begin());
+        if (script->mBuildState[0] != EvaluatorScript::NotBuilt)
+            continue;
+        StartBuild(*script, 0);
+        buildingCount++;
+    }
+    if (mPrewarmQueue.empty())
+    {
+        Log("GLSL programs: %d from binary cache, %d compiled\n", int(gProgramCacheStats.mHits), int(gProgramCacheStats.mMisses));
+        TagTime("GLSL pre-warm");
+    }
 }
 
 int Evaluators::GetMask(size_t nodeType)
@@ -681,7 +1346,13 @@ int Evaluators::GetMask(size_t nodeType)
     {
         mask |= EvaluationGLSL;
         iter->second.mType = int(nodeType);
+        std::lock_guard<std::mutex> lock(mProgramMutex);
+        SetGLSLScript(nodeType, &iter->second);
         mEvaluatorPerNodeType[nodeType].mGLSLProgram = iter->second.mProgram;
+        mEvaluatorPerNodeType[nodeType].mGLSLLayeredCubeProgram = iter->second.mLayeredCubeProgram;
+        mEvaluatorPerNodeType[nodeType].mReflection = iter->second.mReflection;
+        mEvaluatorPerNodeType[nodeType].mbTimeDependent = iter->second.mbTimeDependent;
+        mEvaluatorPerNodeType[nodeType].mbCacheable = iter->second.mbCacheable;
     }
     iter = mEvaluatorScripts.find(nodeName + ".glslc");
     if (iter != mEvaluatorScripts.end())
@@ -689,6 +1360,7 @@ int Evaluators::GetMask(size_t nodeType)
         mask |= EvaluationGLSLCompute;
         iter->second.mType = int(nodeType);
         mEvaluatorPerNodeType[nodeType].mGLSLProgram = iter->second.mProgram;
+        mEvaluatorPerNodeType[nodeType].mReflection = iter->second.mReflection;
     }
     iter = mEvaluatorScripts.find(nodeName + ".c");
     if (iter != mEvaluatorScripts.end())
@@ -761,9 +1433,18 @@ void Evaluators::ReloadPlugins()
     #endif
 }
 #if USE_PYTHON
-void Evaluator::RunPython() const
+void Evaluator::RunPython(EvaluationContext* context, const EvaluationInfo& evaluationInfo) const
 {
-    mPyModule.attr("main")(gEvaluators.mImogenModule.attr("accessor_api")());
+    auto accessor = pybind11::dict();
+    accessor["context"] = pybind11::cast(context, pybind11::return_value_policy::reference);
+    accessor["target"] = evaluationInfo.targetIndex;
+    auto inputs = pybind11::list();
+    for (auto input : evaluationInfo.inputIndices)
+    {
+        inputs.append(input);
+    }
+    accessor["inputs"] = inputs;
+    mPyModule.attr("main")(accessor);
 }
 #endif
 namespace EvaluationAPI
@@ -957,7 +1638,8 @@ namespace EvaluationAPI
         // compute total size
         auto img = tgt->mImage;
         unsigned int texelSize = textureFormatSize[img->mFormat];
-        unsigned int texelFormat = glInternalFormats[img->mFormat];
+        unsigned int texelFormat, texelType;
+        GetGLPixelFormat(img->mFormat, texelFormat, texelType);
         uint32_t size = 0; // img.mNumFaces * img.mWidth * img.mHeight * texelSize;
         for (int i = 0; i < img->mNumMips; i++)
             size += img->mNumFaces * (img->mWidth >> i) * (img->mHeight >> i) * texelSize;
@@ -969,13 +1651,15 @@ namespace EvaluationAPI
         image->mFormat = img->mFormat;
         image->mNumFaces = img->mNumFaces;
 #ifdef glGetTexImage
-        unsigned char* ptr = image->GetBits();
+        unsigned char* ptr = image->GetWritableBits();
+        // rows are tightly packed
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
         if (img->mNumFaces == 1)
         {
             glBindTexture(GL_TEXTURE_2D, tgt->mGLTexID);
             for (int i = 0; i < img->mNumMips; i++)
             {
-                glGetTexImage(GL_TEXTURE_2D, i, texelFormat, GL_UNSIGNED_BYTE, ptr);
+                glGetTexImage(GL_TEXTURE_2D, i, texelFormat, texelType, ptr);
                 ptr += (img->mWidth >> i) * (img->mHeight >> i) * texelSize;
             }
         }
@@ -986,7 +1670,7 @@ namespace EvaluationAPI
             {
                 for (int i = 0; i < img->mNumMips; i++)
                 {
-                    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + cube, i, texelFormat, GL_UNSIGNED_BYTE, ptr);
+                    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + cube, i, texelFormat, texelType, ptr);
                     ptr += (img->mWidth >> i) * (img->mHeight >> i) * texelSize;
                 }
             }
@@ -1002,9 +1686,12 @@ namespace EvaluationAPI
         if (!tgt)
             return EVAL_ERR;
         unsigned int texelSize = textureFormatSize[image->mFormat];
-        unsigned int inputFormat = glInputFormats[image->mFormat];
+        unsigned int inputFormat, inputType;
+        GetGLPixelFormat(image->mFormat, inputFormat, inputType);
         unsigned int internalFormat = glInternalFormats[image->mFormat];
-        unsigned char* ptr = image->GetBits();
+        const unsigned char* ptr = image->GetBits();
+        // RGB rows are not 4 bytes aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         if (image->mNumFaces == 1)
         {
             tgt->InitBuffer(image->mWidth, image->mHeight, stage.mbDepthBuffer);
@@ -1020,7 +1707,7 @@ namespace EvaluationAPI
                              image->mHeight >> i,
                              0,
                              inputFormat,
-                             GL_UNSIGNED_BYTE,
+                             inputType,
                              ptr);
                 ptr += (image->mWidth >> i) * (image->mHeight >> i) * texelSize;
             }
@@ -1046,7 +1733,7 @@ namespace EvaluationAPI
                                  image->mWidth >> i,
                                  0,
                                  inputFormat,
-                                 GL_UNSIGNED_BYTE,
+                                 inputType,
                                  ptr);
                     ptr += (image->mWidth >> i) * (image->mWidth >> i) * texelSize;
                 }
@@ -1057,6 +1744,9 @@ namespace EvaluationAPI
             else
                 TexParam(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_TEXTURE_CUBE_MAP);
         }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // the texture now holds the image format, readbacks return it
+        tgt->mImage->mFormat = image->mFormat;
         #if USE_FFMPEG
         if (stage.mDecoder.get() != (FFMPEGCodec::Decoder*)image->mDecoder)
             stage.mDecoder = std::shared_ptr<FFMPEGCodec::Decoder>((FFMPEGCodec::Decoder*)image->mDecoder);
@@ -1194,11 +1884,13 @@ namespace EvaluationAPI
             : TaskSet(), mFunction(function), mBuffer(malloc(size))
         {
             memcpy(mBuffer, ptr, size);
+            gEvaluators.JobStarted();
         }
         virtual void ExecuteRange(TaskSetPartition range, uint32_t threadnum)
         {
             mFunction(mBuffer);
             free(mBuffer);
+            gEvaluators.JobDone();
             delete this;
         }
         jobFunction mFunction;
@@ -1213,11 +1905,13 @@ namespace EvaluationAPI
             , mBuffer(malloc(size))
         {
             memcpy(mBuffer, ptr, size);
+            gEvaluators.JobStarted();
         }
         virtual void Execute()
         {
             mFunction(mBuffer);
             free(mBuffer);
+            gEvaluators.JobDone();
             delete this;
         }
         jobFunction mFunction;
@@ -1228,6 +1922,10 @@ namespace EvaluationAPI
     {
         if (evaluationContext->IsSynchronous())
         {
+            if (evaluationContext->AddParallelJob(jobFunction, ptr, size))
+            {
+                return EVAL_OK;
+            }
             return jobFunction(ptr);
         }
         else
@@ -1241,6 +1939,10 @@ namespace EvaluationAPI
     {
         if (evaluationContext->IsSynchronous())
         {
+            if (evaluationContext->AddParallelMainJob(jobMainFunction, ptr, size))
+            {
+                return EVAL_OK;
+            }
             return jobMainFunction(ptr);
         }
         else
@@ -1272,7 +1974,7 @@ namespace EvaluationAPI
             FFMPEGCodec::Encoder* encoder =
                 evaluationContext->GetEncoder(std::string(filename), image->mWidth, image->mHeight);
             std::string fn(filename);
-            encoder->AddFrame(image->GetBits(), image->mWidth, image->mHeight);
+            encoder->AddFrame((unsigned char*)image->GetBits(), image->mWidth, image->mHeight);
             #endif
             return EVAL_OK;
         }
@@ -1280,9 +1982,10 @@ namespace EvaluationAPI
         return Image::Write(filename, image, format, quality);
     }
 
-    int Evaluate(EvaluationContext* evaluationContext, int target, int width, int height, Image* image)
+    static int EvaluateWhole(EvaluationContext* evaluationContext, int target, int width, int height, Image* image)
     {
         EvaluationContext context(evaluationContext->mEvaluationStages, true, width, height);
+        context.EnableParallelJobs(true);
         context.SetCurrentTime(evaluationContext->GetCurrentTime());
         // set all nodes as dirty so that evaluation (in build) will not bypass most nodes
         context.DirtyAll();
@@ -1294,6 +1997,103 @@ namespace EvaluationAPI
         return EVAL_OK;
     }
 
+    int Evaluate(EvaluationContext* evaluationContext, int target, int width, int height, Image* image)
+    {
+        int halo = TiledEvaluation::GetHalo(evaluationContext->mEvaluationStages, target, width, height);
+        if (halo >= 0)
+        {
+            int res = TiledEvaluation::Evaluate(
+                evaluationContext, target, width, height, halo, [&](const unsigned char* rows, int firstRow, int rowCount) {
+                    const size_t rowSize = size_t(width) * 4;
+                    if (!firstRow)
+                    {
+                        // only the result is full size
+                        image->mWidth = width;
+                        image->mHeight = height;
+                        image->mNumMips = 1;
+                        image->mNumFaces = 1;
+                        image->mFormat = TextureFormat::RGBA8;
+                        image->Allocate(rowSize * height);
+                    }
+                    memcpy(image->GetWritableBits() + rowSize * firstRow, rows, rowSize * rowCount);
+                    return int(EVAL_OK);
+                });
+            if (res != TiledEvaluation::NotTileable)
+            {
+                return res;
+            }
+        }
+        return EvaluateWhole(evaluationContext, target, width, height, image);
+    }
+
+    static int EvaluateToFileNow(EvaluationContext* evaluationContext,
+                                 int target,
+                                 int width,
+                                 int height,
+                                 const char* filename,
+                                 int format,
+                                 int quality,
+                                 int halo)
+    {
+        if (halo >= 0 && format == 7)
+        {
+            // video frames are encoded from memory
+            Image image;
+            if (Evaluate(evaluationContext, target, width, height, &image) != EVAL_OK)
+            {
+                return EVAL_ERR;
+            }
+            return Write(evaluationContext, filename, &image, format, quality);
+        }
+        if (halo >= 0)
+        {
+            // opened with the first band: nothing is written when the graph isn't tileable
+            ImageBandWriter writer;
+            int res = TiledEvaluation::Evaluate(
+                evaluationContext, target, width, height, halo, [&](const unsigned char* rows, int firstRow, int rowCount) {
+                    if (!firstRow && writer.Open(filename, format, quality, width, height) != EVAL_OK)
+                    {
+                        return int(EVAL_ERR);
+                    }
+                    return writer.WriteRows(rows, rowCount);
+                });
+            if (res != TiledEvaluation::NotTileable)
+            {
+                int closeRes = writer.Close();
+                return (res == EVAL_OK) ? closeRes : res;
+            }
+        }
+        Image image;
+        if (EvaluateWhole(evaluationContext, target, width, height, &image) != EVAL_OK)
+        {
+            return EVAL_ERR;
+        }
+        return Write(evaluationContext, filename, &image, format, quality);
+    }
+
+    int EvaluateToFile(EvaluationContext* evaluationContext,
+                       int target,
+                       int width,
+                       int height,
+                       const char* filename,
+                       int format,
+                       int quality)
+    {
+        int halo = TiledEvaluation::GetHalo(evaluationContext->mEvaluationStages, target, width, height);
+        if (halo < 0 && evaluationContext->mFramePipeline)
+        {
+            // written later, the pipeline reports it
+            return evaluationContext->mFramePipeline->EvaluateToFile(
+                evaluationContext, target, width, height, filename, format, quality);
+        }
+        int res = EvaluateToFileNow(evaluationContext, target, width, height, filename, format, quality, halo);
+        if (res == EVAL_OK)
+        {
+            Log("Image %s saved.\n", filename);
+        }
+        return res;
+    }
+
     inline char* ReadFile(const char* szFileName, int& bufSize)
     {
         FILE* fp = fopen(szFileName, "rb");
@@ -27,7 +27,12 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <mutex>
+#include <future>
+#include <atomic>
 #include "Imogen.h"
+#include "Utils.h"
+#include "FileWatcher.h"
 #if USE_PYTHON
 #include "pybind11/embed.h"
 #endif
@@ -40,18 +45,44 @@ enum EvaluationMask
     EvaluationGLSLCompute = 1 << 3,
 };
 
+// uniforms reflected once when the program is linked
+struct ProgramReflection
+{
+    ProgramReflection() : mParameterBlockIndex(-1), mEvaluationBlockIndex(-1)
+    {
+        memset(mSamplerTypes, 0, sizeof(mSamplerTypes));
+    }
+    // GL_SAMPLER_2D, GL_SAMPLER_CUBE or 0 when input is not sampled. Sampler i uses texture unit i.
+    unsigned int mSamplerTypes[8];
+    int mParameterBlockIndex;
+    int mEvaluationBlockIndex;
+};
+
+struct EvaluationContext;
+struct EvaluationInfo;
+
 struct Evaluator
 {
-    Evaluator() : mGLSLProgram(0), mCFunction(0), mMem(0)
+    Evaluator()
+        : mGLSLProgram(0), mGLSLLayeredCubeProgram(0), mCFunction(0), mMem(0), mbTimeDependent(false), mbCacheable(false)
     {
     }
     unsigned int mGLSLProgram;
+    // renders the 6 faces of a cubemap mip in 1 draw, 0 if the node doesn't use viewRot
+    unsigned int mGLSLLayeredCubeProgram;
+    ProgramReflection mReflection;
     int (*mCFunction)(void* parameters, void* evaluationInfo, void* context);
     void* mMem;
+    // GLSL reads frame/localFrame
+    bool mbTimeDependent;
+    // GLSL result only depends on parameters, inputs and time (no mouse, no dirty flag)
+    bool mbCacheable;
+    // incremented when the evaluator is reloaded, part of the result cache hash
+    uint32_t mRevision = 0;
 #if USE_PYTHON    
     pybind11::module mPyModule;
 
-    void RunPython() const;
+    void RunPython(EvaluationContext* context, const EvaluationInfo& evaluationInfo) const;
 #endif
 
 #ifdef _DEBUG
@@ -74,6 +105,18 @@ struct Evaluators
     {
         return mEvaluatorPerNodeType[nodeType];
     }
+    // GLSL programs are built on first use. Return false while the program builds, unless wait is set.
+    // layeredCube: LAYERED_CUBE variant, 0 when the node has none
+    bool GetProgram(size_t nodeType, bool layeredCube, bool wait, unsigned int& program);
+    // GL thread, once per frame: ends completed builds and pre-warms the programs not used yet
+    void UpdatePrograms();
+    // GL thread, between frames: recompiles the evaluators whose file changed on disk.
+    // nodeTypes receives the types swapped, their stages need to be evaluated again
+    void ReloadChangedEvaluators(std::vector<size_t>& nodeTypes);
+
+    // C jobs queued or running on g_TS. Code replaced by a reload is kept until none is left
+    void JobStarted() { mRunningJobs++; }
+    void JobDone() { mRunningJobs--; }
 
     void InitPythonModules();
 #if USE_PYTHON    
@@ -83,17 +126,53 @@ struct Evaluators
     protected:
         struct EvaluatorScript
     {
-        EvaluatorScript() : mProgram(0), mCFunction(0), mMem(0), mType(-1)
+        EvaluatorScript()
+            : mProgram(0)
+            , mLayeredCubeProgram(0)
+            , mCFunction(0)
+            , mMem(0)
+            , mNativeLibrary(0)
+            , mType(-1)
+            , mbTimeDependent(false)
+            , mbCacheable(false)
         {
         }
-        EvaluatorScript(const std::string& text) : mText(text), mProgram(0), mCFunction(0), mMem(0), mType(-1)
+        EvaluatorScript(const std::string& text)
+            : mText(text)
+            , mProgram(0)
+            , mLayeredCubeProgram(0)
+            , mCFunction(0)
+            , mMem(0)
+            , mNativeLibrary(0)
+            , mType(-1)
+            , mbTimeDependent(false)
+            , mbCacheable(false)
         {
         }
+        enum BuildState
+        {
+            NotBuilt,
+            Building,
+            Built,
+        };
+
         std::string mText;
         unsigned int mProgram;
+        unsigned int mLayeredCubeProgram;
+        // GLSL: Shader.glsl with the node spliced in. Program and LAYERED_CUBE variant builds
+        std::string mShaderText;
+        std::string mNodeName;
+        bool mbHasLayeredCube = false;
+        BuildState mBuildState[2] = {NotBuilt, NotBuilt};
+        ShaderBuild mBuilds[2];
+        ProgramReflection mReflection;
         int (*mCFunction)(void* parameters, void* evaluationInfo, void* context);
         void* mMem;
+        // C node built with the host compiler, libtcc when NULL
+        void* mNativeLibrary;
         int mType;
+        bool mbTimeDependent;
+        bool mbCacheable;
 #if USE_PYTHON        
         pybind11::module mPyModule;
 #endif
@@ -101,6 +180,45 @@ struct Evaluators
 
     std::map<std::string, EvaluatorScript> mEvaluatorScripts;
     std::vector<Evaluator> mEvaluatorPerNodeType;
+
+    std::vector<EvaluatorFile> mEvaluatorFiles;
+    FileWatcher mFileWatcher;
+    bool mbWatchingFiles = false;
+    bool ReadScript(const EvaluatorFile& file);
+    void SpliceGLSL(EvaluatorScript& shader, const std::string& filename);
+    unsigned int LoadGLSLCompute(EvaluatorScript& shader, const std::string& filename);
+#if USE_LIBTCC
+    bool LoadC(const EvaluatorFile& file, bool hotEdit);
+#endif
+    // returns the node type or -1 when the previous evaluator is kept
+    int ReloadEvaluator(const EvaluatorFile& file);
+
+    // C code replaced by a reload. Builder workers and g_TS jobs may still run it
+    struct RetiredCode
+    {
+        void* mMem;
+        void* mNativeLibrary;
+    };
+    std::vector<RetiredCode> mRetiredCode;
+    std::atomic<int> mRunningJobs{0};
+    // force: at clear, when every evaluator is freed anyway
+    void ReleaseRetiredCode(bool force);
+
+    // guards GLSL builds, builder threads wait for their programs
+    std::mutex mProgramMutex;
+    std::vector<EvaluatorScript*> mGLSLScriptPerNodeType;
+    std::vector<EvaluatorScript*> mPrewarmQueue;
+    void SetGLSLScript(size_t nodeType, EvaluatorScript* script);
+    // with mProgramMutex locked. variant 1 is the LAYERED_CUBE program
+    void StartBuild(EvaluatorScript& script, int variant);
+    void EndBuild(EvaluatorScript& script, int variant);
+
+#if USE_NATIVE_C
+    // cached or compiled native library for the C node. false to use libtcc
+    bool LoadNativeC(const std::string& directory, const std::string& filename, EvaluatorScript& script, bool hotEdit);
+    // libraries compiled in the background for hot edited nodes
+    std::map<std::string, std::future<bool>> mNativeBuilds;
+#endif
 };
 
 extern Evaluators gEvaluators;
@@ -148,6 +266,14 @@ namespace EvaluationAPI
     int Read(EvaluationContext* evaluationContext, const char* filename, Image* image);
     int Write(EvaluationContext* evaluationContext, const char* filename, Image* image, int format, int quality);
     int Evaluate(EvaluationContext* evaluationContext, int target, int width, int height, Image* image);
+    // big outputs are evaluated by tiles and streamed to the file when the format allows it
+    int EvaluateToFile(EvaluationContext* evaluationContext,
+                       int target,
+                       int width,
+                       int height,
+                       const char* filename,
+                       int format,
+                       int quality);
 
     int ReadGLTF(EvaluationContext* evaluationContext, const char* filename, Scene** scene);
 } // namespace EvaluationAPI
\ No newline at end of file
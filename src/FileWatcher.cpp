@@ -0,0 +1,105 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "FileWatcher.h"
+#include "Utils.h"
+#include <algorithm>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+FileWatcher::FileWatcher() : mFd(-1)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (mFd != -1)
+    {
+        close(mFd);
+    }
+#endif
+}
+
+bool FileWatcher::Watch(const std::string& directory)
+{
+#ifdef __linux__
+    for (auto& watched : mDirectories)
+    {
+        if (watched.second == directory)
+            return true;
+    }
+    if (mFd == -1)
+    {
+        mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (mFd == -1)
+            return false;
+    }
+    // editors either write in place or rename a temporary file
+    int wd = inotify_add_watch(mFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd == -1)
+    {
+        Log("Unable to watch %s\n", directory.c_str());
+        return false;
+    }
+    mDirectories[wd] = directory;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FileWatcher::Poll(std::vector<std::string>& changedFiles)
+{
+    changedFiles.clear();
+#ifdef __linux__
+    if (mFd == -1)
+        return;
+    alignas(inotify_event) char buffer[4096];
+    while (true)
+    {
+        ssize_t length = read(mFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char* ptr = buffer; ptr < buffer + length;)
+        {
+            const inotify_event* event = (const inotify_event*)ptr;
+            ptr += sizeof(inotify_event) + event->len;
+            auto directory = mDirectories.find(event->wd);
+            if (!event->len || directory == mDirectories.end())
+                continue;
+            std::string path = directory->second + event->name;
+            if (std::find(changedFiles.begin(), changedFiles.end(), path) == changedFiles.end())
+            {
+                changedFiles.push_back(path);
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,184 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "FramePipeline.h"
+#include "EvaluationContext.h"
+#include "Evaluators.h"
+
+FramePipeline::FramePipeline(int depth, int encoderCount)
+    : mDepth(depth)
+    , mEncoderCount(encoderCount)
+    , mContextStages(nullptr)
+    , mContextWidth(0)
+    , mContextHeight(0)
+    , mActiveEncodings(0)
+    , mFailedWrites(0)
+    , mbQuit(false)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+    Finish();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mbQuit = true;
+    }
+    mCondition.notify_all();
+    for (auto& encoder : mEncoders)
+    {
+        encoder.join();
+    }
+    mContext.reset();
+}
+
+int FramePipeline::EvaluateToFile(EvaluationContext* evaluationContext,
+                                  int target,
+                                  int width,
+                                  int height,
+                                  const char* filename,
+                                  int format,
+                                  int quality)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (TakeFailedWrites())
+        {
+            return EVAL_ERR;
+        }
+    }
+    if (format != 7 && mEncoders.empty())
+    {
+        for (int i = 0; i < mEncoderCount; i++)
+        {
+            mEncoders.emplace_back([this]() { EncodeLoop(); });
+        }
+    }
+    if (!mContext || mContextStages != &evaluationContext->mEvaluationStages || mContextWidth != width ||
+        mContextHeight != height)
+    {
+        mReadback.Finish();
+        mContext = std::make_unique<EvaluationContext>(evaluationContext->mEvaluationStages, true, width, height);
+        mContextStages = &evaluationContext->mEvaluationStages;
+        mContextWidth = width;
+        mContextHeight = height;
+    }
+    mContext->SetCurrentTime(evaluationContext->GetCurrentTime());
+    mContext->DirtyAll();
+    while (mContext->RunBackward(target))
+    {
+        // processing... maybe good on next run
+    }
+
+    std::string file(filename);
+    int handle = mReadback.Request(mContext.get(), target, [this, evaluationContext, file, format, quality](Image& image) {
+        if (format == 7)
+        {
+            // video encoders are stateful: frames go in order, from this thread
+            if (EvaluationAPI::Write(evaluationContext, file.c_str(), &image, format, quality) == EVAL_OK)
+            {
+                Log("Image %s saved.\n", file.c_str());
+            }
+            else
+            {
+                Log("Unable to write image : %s\n", file.c_str());
+                std::lock_guard<std::mutex> lock(mMutex);
+                mFailedWrites++;
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back({std::make_unique<Image>(image), file, format, quality});
+        }
+        mCondition.notify_one();
+    });
+    return (handle == -1) ? EVAL_ERR : EVAL_OK;
+}
+
+void FramePipeline::Update()
+{
+    mReadback.Update();
+    mReadback.Wait(mDepth);
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return int(mQueue.size()) + mActiveEncodings <= mDepth; });
+}
+
+int FramePipeline::Finish()
+{
+    mReadback.Finish();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return mQueue.empty() && !mActiveEncodings; });
+    return TakeFailedWrites() ? EVAL_ERR : EVAL_OK;
+}
+
+int FramePipeline::TakeFailedWrites()
+{
+    int failedWrites = mFailedWrites;
+    mFailedWrites = 0;
+    return failedWrites;
+}
+
+void FramePipeline::EncodeLoop()
+{
+    while (true)
+    {
+        Encoding encoding;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this]() { return mbQuit || !mQueue.empty(); });
+            if (mQueue.empty())
+            {
+                return;
+            }
+            encoding = std::move(mQueue.front());
+            mQueue.pop_front();
+            mActiveEncodings++;
+        }
+
+        const bool written = Image::Write(encoding.mFilename.c_str(),
+                                          encoding.mImage.get(),
+                                          encoding.mFormat,
+                                          encoding.mQuality) == EVAL_OK;
+        if (written)
+        {
+            Log("Image %s saved.\n", encoding.mFilename.c_str());
+        }
+        else
+        {
+            Log("Unable to write image : %s\n", encoding.mFilename.c_str());
+        }
+        encoding.mImage.reset();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mActiveEncodings--;
+            mFailedWrites += written ? 0 : 1;
+        }
+        // wakes Update/Finish waiting for room
+        mCondition.notify_all();
+    }
+}
@@ -0,0 +1,88 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <string>
+#include "ImageReadback.h"
+
+struct EvaluationContext;
+struct EvaluationStages;
+
+// Pipelined file writes for animation bakes.
+// EvaluateToFile renders the target then returns: the result is read back through a pixel pack buffer while the
+// next frame renders, then encoded by encoder threads. Video frames are encoded in order on the GL thread.
+// At most mDepth readbacks and mDepth encodings are in flight. Encoder threads start with the first image file.
+// A failed write is logged when it happens and returned by the next EvaluateToFile or by Finish.
+struct FramePipeline
+{
+    FramePipeline(int depth = 3, int encoderCount = 2);
+    ~FramePipeline();
+
+    int EvaluateToFile(EvaluationContext* evaluationContext,
+                       int target,
+                       int width,
+                       int height,
+                       const char* filename,
+                       int format,
+                       int quality);
+    // once per frame, GL thread: delivers finished readbacks and waits when too many frames are in flight
+    void Update();
+    // wait for every readback and encoding. EVAL_ERR if a write failed since the last EvaluateToFile
+    int Finish();
+
+protected:
+    struct Encoding
+    {
+        std::unique_ptr<Image> mImage;
+        std::string mFilename;
+        int mFormat;
+        int mQuality;
+    };
+    void EncodeLoop();
+    // with mMutex locked
+    int TakeFailedWrites();
+
+    int mDepth;
+    int mEncoderCount;
+    ImageReadback mReadback;
+    // evaluation context kept between frames so render targets are not allocated every frame
+    std::unique_ptr<EvaluationContext> mContext;
+    const EvaluationStages* mContextStages;
+    int mContextWidth;
+    int mContextHeight;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<Encoding> mQueue;
+    int mActiveEncodings;
+    int mFailedWrites;
+    bool mbQuit;
+    std::vector<std::thread> mEncoders;
+};
@@ -0,0 +1,676 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ImageKernels.h"
+#include "PixelOps.h"
+#include "Utils.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace ImageKernels
+{
+    static const int RowChunk = 1024;
+
+    using PixelOps::HalfToFloat;
+    using PixelOps::FloatToHalf;
+
+    static inline unsigned char ToUnorm8(float value)
+    {
+        value = value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+        return (unsigned char)(value * 255.f + 0.5f);
+    }
+
+    static inline uint16_t ToUnorm16(float value)
+    {
+        value = value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+        return uint16_t(value * 65535.f + 0.5f);
+    }
+
+    // RGBM: rgb * m * RGBMRange
+    static const float RGBMRange = 6.f;
+
+    void LoadRow(const unsigned char* source, int format, int count, float* rgba)
+    {
+        static const float toUnit8 = 1.f / 255.f;
+        static const float toUnit16 = 1.f / 65535.f;
+        const uint16_t* source16 = (const uint16_t*)source;
+        const float* source32 = (const float*)source;
+        int i = 0;
+        switch (format)
+        {
+            case TextureFormat::BGR8:
+            case TextureFormat::RGB8:
+            {
+                const int red = (format == TextureFormat::BGR8) ? 2 : 0;
+                for (; i < count; i++, source += 3, rgba += 4)
+                {
+                    rgba[0] = source[red] * toUnit8;
+                    rgba[1] = source[1] * toUnit8;
+                    rgba[2] = source[2 - red] * toUnit8;
+                    rgba[3] = 1.f;
+                }
+                break;
+            }
+            case TextureFormat::RGB16:
+                for (; i < count; i++, source16 += 3, rgba += 4)
+                {
+                    rgba[0] = source16[0] * toUnit16;
+                    rgba[1] = source16[1] * toUnit16;
+                    rgba[2] = source16[2] * toUnit16;
+                    rgba[3] = 1.f;
+                }
+                break;
+            case TextureFormat::RGB16F:
+                for (; i < count; i++, source16 += 3, rgba += 4)
+                {
+                    rgba[0] = HalfToFloat(source16[0]);
+                    rgba[1] = HalfToFloat(source16[1]);
+                    rgba[2] = HalfToFloat(source16[2]);
+                    rgba[3] = 1.f;
+                }
+                break;
+            case TextureFormat::RGB32F:
+                for (; i < count; i++, source32 += 3, rgba += 4)
+                {
+                    rgba[0] = source32[0];
+                    rgba[1] = source32[1];
+                    rgba[2] = source32[2];
+                    rgba[3] = 1.f;
+                }
+                break;
+            case TextureFormat::RGBE:
+                for (; i < count; i++, source += 4, rgba += 4)
+                {
+                    const float scale = source[3] ? ldexpf(1.f, int(source[3]) - (128 + 8)) : 0.f;
+                    rgba[0] = source[0] * scale;
+                    rgba[1] = source[1] * scale;
+                    rgba[2] = source[2] * scale;
+                    rgba[3] = 1.f;
+                }
+                break;
+            case TextureFormat::BGRA8:
+            case TextureFormat::RGBA8:
+            {
+                const bool bgra = format == TextureFormat::BGRA8;
+#if USE_SSE2
+                const __m128i zero = _mm_setzero_si128();
+                const __m128 scale = _mm_set1_ps(toUnit8);
+                for (; i + 4 <= count; i += 4, source += 16, rgba += 16)
+                {
+                    __m128i texels = _mm_loadu_si128((const __m128i*)source);
+                    __m128i low = _mm_unpacklo_epi8(texels, zero);
+                    __m128i high = _mm_unpackhi_epi8(texels, zero);
+                    __m128 pixels[4] = {_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)),
+                                        _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)),
+                                        _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)),
+                                        _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero))};
+                    for (int j = 0; j < 4; j++)
+                    {
+                        __m128 pixel = _mm_mul_ps(pixels[j], scale);
+                        if (bgra)
+                            pixel = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 0, 1, 2));
+                        _mm_storeu_ps(rgba + j * 4, pixel);
+                    }
+                }
+#endif
+                const int red = bgra ? 2 : 0;
+                for (; i < count; i++, source += 4, rgba += 4)
+                {
+                    rgba[0] = source[red] * toUnit8;
+                    rgba[1] = source[1] * toUnit8;
+                    rgba[2] = source[2 - red] * toUnit8;
+                    rgba[3] = source[3] * toUnit8;
+                }
+                break;
+            }
+            case TextureFormat::RGBA16:
+                for (i = 0; i < count * 4; i++)
+                    rgba[i] = source16[i] * toUnit16;
+                break;
+            case TextureFormat::RGBA16F:
+                HalfToFloat(source16, rgba, size_t(count) * 4);
+                break;
+            case TextureFormat::RGBA32F:
+                memcpy(rgba, source, count * 4 * sizeof(float));
+                break;
+            case TextureFormat::RGBM:
+                for (; i < count; i++, source += 4, rgba += 4)
+                {
+                    const float scale = source[3] * (RGBMRange * toUnit8 * toUnit8);
+                    rgba[0] = source[0] * scale;
+                    rgba[1] = source[1] * scale;
+                    rgba[2] = source[2] * scale;
+                    rgba[3] = 1.f;
+                }
+                break;
+        }
+    }
+
+    void StoreRow(const float* rgba, int format, int count, unsigned char* destination)
+    {
+        uint16_t* destination16 = (uint16_t*)destination;
+        float* destination32 = (float*)destination;
+        int i = 0;
+        switch (format)
+        {
+            case TextureFormat::BGR8:
+            case TextureFormat::RGB8:
+            {
+                const int red = (format == TextureFormat::BGR8) ? 2 : 0;
+                for (; i < count; i++, destination += 3, rgba += 4)
+                {
+                    destination[red] = ToUnorm8(rgba[0]);
+                    destination[1] = ToUnorm8(rgba[1]);
+                    destination[2 - red] = ToUnorm8(rgba[2]);
+                }
+                break;
+            }
+            case TextureFormat::RGB16:
+                for (; i < count; i++, destination16 += 3, rgba += 4)
+                {
+                    destination16[0] = ToUnorm16(rgba[0]);
+                    destination16[1] = ToUnorm16(rgba[1]);
+                    destination16[2] = ToUnorm16(rgba[2]);
+                }
+                break;
+            case TextureFormat::RGB16F:
+                for (; i < count; i++, destination16 += 3, rgba += 4)
+                {
+                    destination16[0] = FloatToHalf(rgba[0]);
+                    destination16[1] = FloatToHalf(rgba[1]);
+                    destination16[2] = FloatToHalf(rgba[2]);
+                }
+                break;
+            case TextureFormat::RGB32F:
+                for (; i < count; i++, destination32 += 3, rgba += 4)
+                {
+                    destination32[0] = rgba[0];
+                    destination32[1] = rgba[1];
+                    destination32[2] = rgba[2];
+                }
+                break;
+            case TextureFormat::RGBE:
+                for (; i < count; i++, destination += 4, rgba += 4)
+                {
+                    const float maximum = std::max(std::max(rgba[0], rgba[1]), rgba[2]);
+                    if (maximum < 1e-32f)
+                    {
+                        memset(destination, 0, 4);
+                        continue;
+                    }
+                    int exponent;
+                    const float scale = frexpf(maximum, &exponent) * 256.f / maximum;
+                    destination[0] = (unsigned char)std::max(rgba[0] * scale, 0.f);
+                    destination[1] = (unsigned char)std::max(rgba[1] * scale, 0.f);
+                    destination[2] = (unsigned char)std::max(rgba[2] * scale, 0.f);
+                    destination[3] = (unsigned char)(exponent + 128);
+                }
+                break;
+            case TextureFormat::BGRA8:
+            case TextureFormat::RGBA8:
+            {
+                const bool bgra = format == TextureFormat::BGRA8;
+#if USE_SSE2
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 one = _mm_set1_ps(1.f);
+                const __m128 scale = _mm_set1_ps(255.f);
+                for (; i + 4 <= count; i += 4, destination += 16, rgba += 16)
+                {
+                    __m128i texels[4];
+                    for (int j = 0; j < 4; j++)
+                    {
+                        __m128 pixel = _mm_loadu_ps(rgba + j * 4);
+                        if (bgra)
+                            pixel = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 0, 1, 2));
+                        pixel = _mm_min_ps(_mm_max_ps(pixel, zero), one);
+                        texels[j] = _mm_cvtps_epi32(_mm_mul_ps(pixel, scale));
+                    }
+                    __m128i low = _mm_packs_epi32(texels[0], texels[1]);
+                    __m128i high = _mm_packs_epi32(texels[2], texels[3]);
+                    _mm_storeu_si128((__m128i*)destination, _mm_packus_epi16(low, high));
+                }
+#endif
+                const int red = bgra ? 2 : 0;
+                for (; i < count; i++, destination += 4, rgba += 4)
+                {
+                    destination[red] = ToUnorm8(rgba[0]);
+                    destination[1] = ToUnorm8(rgba[1]);
+                    destination[2 - red] = ToUnorm8(rgba[2]);
+                    destination[3] = ToUnorm8(rgba[3]);
+                }
+                break;
+            }
+            case TextureFormat::RGBA16:
+                for (i = 0; i < count * 4; i++)
+                    destination16[i] = ToUnorm16(rgba[i]);
+                break;
+            case TextureFormat::RGBA16F:
+                FloatToHalf(rgba, destination16, size_t(count) * 4);
+                break;
+            case TextureFormat::RGBA32F:
+                memcpy(destination, rgba, count * 4 * sizeof(float));
+                break;
+            case TextureFormat::RGBM:
+                for (; i < count; i++, destination += 4, rgba += 4)
+                {
+                    float maximum = std::max(std::max(rgba[0], rgba[1]), std::max(rgba[2], 1e-6f)) / RGBMRange;
+                    const float m = ceilf(std::min(maximum, 1.f) * 255.f) / 255.f;
+                    const float scale = 1.f / (m * RGBMRange);
+                    destination[0] = ToUnorm8(rgba[0] * scale);
+                    destination[1] = ToUnorm8(rgba[1] * scale);
+                    destination[2] = ToUnorm8(rgba[2] * scale);
+                    destination[3] = ToUnorm8(m);
+                }
+                break;
+        }
+    }
+
+    static bool IsValid(const Image* image)
+    {
+        return image && image->GetBits() && image->mFormat < TextureFormat::Count && image->mWidth > 0 &&
+               image->mHeight > 0;
+    }
+
+    static size_t GetTexelCount(const Image* image)
+    {
+        return image->mDataSize / textureFormatSize[image->mFormat];
+    }
+
+    // calls function on chunks of RGBA float pixels. write: store the chunk back
+    template<typename Function>
+    static void ForEachChunk(Image* image, bool write, Function function)
+    {
+        const int format = image->mFormat;
+        const size_t texelSize = textureFormatSize[format];
+        const size_t texelCount = GetTexelCount(image);
+        std::vector<float> rgba(RowChunk * 4);
+        unsigned char* bits = write ? image->GetWritableBits() : NULL;
+        const unsigned char* source = image->GetBits();
+        for (size_t first = 0; first < texelCount; first += RowChunk)
+        {
+            const int count = int(std::min(texelCount - first, size_t(RowChunk)));
+            LoadRow(source + first * texelSize, format, count, rgba.data());
+            function(rgba.data(), count);
+            if (write)
+            {
+                StoreRow(rgba.data(), format, count, bits + first * texelSize);
+            }
+        }
+    }
+
+    static void SetImage(Image* image, int width, int height, int format, const std::vector<unsigned char>& bits)
+    {
+        image->SetBits(bits.data(), bits.size());
+        image->mWidth = width;
+        image->mHeight = height;
+        image->mFormat = uint8_t(format);
+        image->mNumMips = 1;
+        image->mNumFaces = 1;
+        image->mDecoder = NULL;
+    }
+
+    // 1D filter, the same tap count for every destination texel. Indices are clamped to the source
+    struct Filter1D
+    {
+        int mTaps;
+        std::vector<int> mIndices;
+        std::vector<float> mWeights;
+    };
+
+    static float FilterWeight(int filter, float x)
+    {
+        x = fabsf(x);
+        switch (filter)
+        {
+            case Box:
+                return (x < 0.5f) ? 1.f : 0.f;
+            case Bilinear:
+                return (x < 1.f) ? 1.f - x : 0.f;
+            default:
+            {
+                if (x < 1e-5f)
+                    return 1.f;
+                if (x >= 3.f)
+                    return 0.f;
+                const float px = PI * x;
+                return 3.f * sinf(px) * sinf(px / 3.f) / (px * px);
+            }
+        }
+    }
+
+    static void BuildResizeFilter(int sourceSize, int destinationSize, int filter, Filter1D& result)
+    {
+        static const float supports[] = {0.5f, 1.f, 3.f};
+        const float scale = float(sourceSize) / float(destinationSize);
+        // minification widens the filter
+        const float filterScale = std::max(scale, 1.f);
+        const float support = supports[filter] * filterScale;
+        result.mTaps = int(ceilf(support * 2.f)) + 1;
+        result.mIndices.resize(destinationSize * result.mTaps);
+        result.mWeights.resize(destinationSize * result.mTaps);
+        for (int i = 0; i < destinationSize; i++)
+        {
+            const float center = (i + 0.5f) * scale - 0.5f;
+            const int first = int(floorf(center - support + 0.5f));
+            int* indices = &result.mIndices[i * result.mTaps];
+            float* weights = &result.mWeights[i * result.mTaps];
+            float total = 0.f;
+            for (int tap = 0; tap < result.mTaps; tap++)
+            {
+                indices[tap] = std::min(std::max(first + tap, 0), sourceSize - 1);
+                weights[tap] = FilterWeight(filter, (first + tap - center) / filterScale);
+                total += weights[tap];
+            }
+            if (total <= 0.f)
+            {
+                // nearest: the other taps are unused
+                std::fill(weights, weights + result.mTaps, 0.f);
+                indices[0] = std::min(std::max(int(floorf(center + 0.5f)), 0), sourceSize - 1);
+                weights[0] = total = 1.f;
+            }
+            for (int tap = 0; tap < result.mTaps; tap++)
+            {
+                weights[tap] /= total;
+            }
+        }
+    }
+
+    static void BuildKernelFilter(int size, const float* kernel, int radius, Filter1D& result)
+    {
+        result.mTaps = radius * 2 + 1;
+        result.mIndices.resize(size * result.mTaps);
+        result.mWeights.resize(size * result.mTaps);
+        for (int i = 0; i < size; i++)
+        {
+            for (int tap = 0; tap < result.mTaps; tap++)
+            {
+                result.mIndices[i * result.mTaps + tap] = std::min(std::max(i + tap - radius, 0), size - 1);
+                result.mWeights[i * result.mTaps + tap] = kernel[tap];
+            }
+        }
+    }
+
+    // destination pixels = weighted sums of source pixels
+    static void FilterRow(const float* source, const Filter1D& filter, int count, float* destination)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            const int* indices = &filter.mIndices[i * filter.mTaps];
+            const float* weights = &filter.mWeights[i * filter.mTaps];
+#if USE_SSE2
+            __m128 sum = _mm_setzero_ps();
+            for (int tap = 0; tap < filter.mTaps; tap++)
+            {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + indices[tap] * 4), _mm_set1_ps(weights[tap])));
+            }
+            _mm_storeu_ps(destination + i * 4, sum);
+#else
+            float sum[4] = {0.f, 0.f, 0.f, 0.f};
+            for (int tap = 0; tap < filter.mTaps; tap++)
+            {
+                for (int c = 0; c < 4; c++)
+                    sum[c] += source[indices[tap] * 4 + c] * weights[tap];
+            }
+            memcpy(destination + i * 4, sum, sizeof(sum));
+#endif
+        }
+    }
+
+#if USE_SSE2
+    TARGET_AVX2 static void AccumulateRowAVX2(float* destination, const float* source, float weight, int count)
+    {
+        const __m256 weights = _mm256_set1_ps(weight);
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 sum = _mm256_add_ps(_mm256_loadu_ps(destination + i), _mm256_mul_ps(_mm256_loadu_ps(source + i), weights));
+            _mm256_storeu_ps(destination + i, sum);
+        }
+        for (; i < count; i++)
+            destination[i] += source[i] * weight;
+    }
+#endif
+
+    // destination += source * weight, count floats
+    static void AccumulateRow(float* destination, const float* source, float weight, int count)
+    {
+        int i = 0;
+#if USE_SSE2
+        static const bool avx2 = PixelOps::HasAVX2();
+        if (avx2)
+        {
+            AccumulateRowAVX2(destination, source, weight, count);
+            return;
+        }
+        const __m128 weights = _mm_set1_ps(weight);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 sum = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), weights));
+            _mm_storeu_ps(destination + i, sum);
+        }
+#endif
+        for (; i < count; i++)
+            destination[i] += source[i] * weight;
+    }
+
+    // horizontal pass on the source rows needed by the vertical taps, kept in a ring of mTaps rows
+    static void FilterSeparable(const Image* source,
+                                const Filter1D& horizontal,
+                                const Filter1D& vertical,
+                                int width,
+                                int height,
+                                int format,
+                                std::vector<unsigned char>& destination)
+    {
+        const size_t sourceTexelSize = textureFormatSize[source->mFormat];
+        const size_t sourceStride = source->mWidth * sourceTexelSize;
+        const size_t destinationStride = width * textureFormatSize[format];
+        destination.resize(destinationStride * height);
+
+        std::vector<float> sourceRow(source->mWidth * 4);
+        std::vector<float> ring(vertical.mTaps * width * 4);
+        std::vector<int> ringRows(vertical.mTaps, -1);
+        std::vector<float> row(width * 4);
+        for (int y = 0; y < height; y++)
+        {
+            std::fill(row.begin(), row.end(), 0.f);
+            for (int tap = 0; tap < vertical.mTaps; tap++)
+            {
+                const float weight = vertical.mWeights[y * vertical.mTaps + tap];
+                if (weight == 0.f)
+                    continue;
+                const int sourceY = vertical.mIndices[y * vertical.mTaps + tap];
+                const int slot = sourceY % vertical.mTaps;
+                float* filtered = &ring[slot * width * 4];
+                if (ringRows[slot] != sourceY)
+                {
+                    LoadRow(source->GetBits() + sourceY * sourceStride, source->mFormat, source->mWidth, sourceRow.data());
+                    FilterRow(sourceRow.data(), horizontal, width, filtered);
+                    ringRows[slot] = sourceY;
+                }
+                AccumulateRow(row.data(), filtered, weight, width * 4);
+            }
+            StoreRow(row.data(), format, width, destination.data() + y * destinationStride);
+        }
+    }
+
+    int Resize(Image* source, Image* destination, int width, int height, int filter)
+    {
+        if (!IsValid(source) || !destination || width <= 0 || height <= 0 || filter < Box || filter > Lanczos)
+            return EVAL_ERR;
+        Filter1D horizontal, vertical;
+        BuildResizeFilter(source->mWidth, width, filter, horizontal);
+        BuildResizeFilter(source->mHeight, height, filter, vertical);
+        std::vector<unsigned char> bits;
+        FilterSeparable(source, horizontal, vertical, width, height, source->mFormat, bits);
+        SetImage(destination, width, height, source->mFormat, bits);
+        return EVAL_OK;
+    }
+
+    int Convolve(Image* image, const float* kernel, int radius)
+    {
+        if (!IsValid(image) || !kernel || radius < 0)
+            return EVAL_ERR;
+        Filter1D horizontal, vertical;
+        BuildKernelFilter(image->mWidth, kernel, radius, horizontal);
+        BuildKernelFilter(image->mHeight, kernel, radius, vertical);
+        std::vector<unsigned char> bits;
+        FilterSeparable(image, horizontal, vertical, image->mWidth, image->mHeight, image->mFormat, bits);
+        SetImage(image, image->mWidth, image->mHeight, image->mFormat, bits);
+        return EVAL_OK;
+    }
+
+    int Convert(Image* source, Image* destination, int format)
+    {
+        if (!IsValid(source) || !destination || format < 0 || format >= TextureFormat::Count)
+            return EVAL_ERR;
+        // keeps faces and mips
+        const size_t texelCount = GetTexelCount(source);
+        std::vector<unsigned char> bits(texelCount * textureFormatSize[format]);
+        PixelOps::Convert(source->GetBits(), source->mFormat, bits.data(), format, texelCount);
+        const uint8_t numMips = source->mNumMips;
+        const uint8_t numFaces = source->mNumFaces;
+        SetImage(destination, source->mWidth, source->mHeight, format, bits);
+        destination->mNumMips = numMips;
+        destination->mNumFaces = numFaces;
+        return EVAL_OK;
+    }
+
+    int Premultiply(Image* image)
+    {
+        if (!IsValid(image))
+            return EVAL_ERR;
+        ForEachChunk(image, true, [](float* rgba, int count) {
+            for (int i = 0; i < count; i++, rgba += 4)
+            {
+#if USE_SSE2
+                __m128 pixel = _mm_loadu_ps(rgba);
+                __m128 alpha = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+                // alpha itself is restored after the multiply
+                _mm_storeu_ps(rgba, _mm_mul_ps(pixel, alpha));
+                rgba[3] = _mm_cvtss_f32(alpha);
+#else
+                rgba[0] *= rgba[3];
+                rgba[1] *= rgba[3];
+                rgba[2] *= rgba[3];
+#endif
+            }
+        });
+        return EVAL_OK;
+    }
+
+    int Unpremultiply(Image* image)
+    {
+        if (!IsValid(image))
+            return EVAL_ERR;
+        ForEachChunk(image, true, [](float* rgba, int count) {
+            for (int i = 0; i < count; i++, rgba += 4)
+            {
+                if (rgba[3] <= 0.f)
+                    continue;
+                const float inverse = 1.f / rgba[3];
+                rgba[0] *= inverse;
+                rgba[1] *= inverse;
+                rgba[2] *= inverse;
+            }
+        });
+        return EVAL_OK;
+    }
+
+    int Swizzle(Image* image, int red, int green, int blue, int alpha)
+    {
+        const int channels[4] = {red, green, blue, alpha};
+        for (int channel : channels)
+        {
+            if (channel < 0 || channel > SwizzleOne)
+                return EVAL_ERR;
+        }
+        if (!IsValid(image))
+            return EVAL_ERR;
+        ForEachChunk(image, true, [&channels](float* rgba, int count) {
+            for (int i = 0; i < count; i++, rgba += 4)
+            {
+                const float values[6] = {rgba[0], rgba[1], rgba[2], rgba[3], 0.f, 1.f};
+                for (int c = 0; c < 4; c++)
+                    rgba[c] = values[channels[c]];
+            }
+        });
+        return EVAL_OK;
+    }
+
+    int Histogram(Image* image, int channel, int binCount, unsigned int* bins)
+    {
+        if (!IsValid(image) || channel < 0 || channel > 3 || binCount <= 0 || !bins)
+            return EVAL_ERR;
+        memset(bins, 0, binCount * sizeof(unsigned int));
+        const float scale = float(binCount);
+        ForEachChunk(image, false, [&](float* rgba, int count) {
+            for (int i = 0; i < count; i++)
+            {
+                const float value = rgba[i * 4 + channel] * scale;
+                const int bin = (value > 0.f) ? std::min(int(value), binCount - 1) : 0;
+                bins[bin]++;
+            }
+        });
+        return EVAL_OK;
+    }
+
+    int MinMax(Image* image, float* minimum, float* maximum)
+    {
+        if (!IsValid(image) || !minimum || !maximum)
+            return EVAL_ERR;
+#if USE_SSE2
+        __m128 lowest = _mm_set1_ps(FLT_MAX);
+        __m128 highest = _mm_set1_ps(-FLT_MAX);
+        ForEachChunk(image, false, [&](float* rgba, int count) {
+            for (int i = 0; i < count; i++)
+            {
+                const __m128 pixel = _mm_loadu_ps(rgba + i * 4);
+                lowest = _mm_min_ps(lowest, pixel);
+                highest = _mm_max_ps(highest, pixel);
+            }
+        });
+        _mm_storeu_ps(minimum, lowest);
+        _mm_storeu_ps(maximum, highest);
+#else
+        for (int c = 0; c < 4; c++)
+        {
+            minimum[c] = FLT_MAX;
+            maximum[c] = -FLT_MAX;
+        }
+        ForEachChunk(image, false, [&](float* rgba, int count) {
+            for (int i = 0; i < count * 4; i++)
+            {
+                minimum[i & 3] = std::min(minimum[i & 3], rgba[i]);
+                maximum[i & 3] = std::max(maximum[i & 3], rgba[i]);
+            }
+        });
+#endif
+        return EVAL_OK;
+    }
+} // namespace ImageKernels
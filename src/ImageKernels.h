@@ -0,0 +1,62 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include "Bitmap.h"
+
+// Image kernels for C nodes, registered in evaluationFunctions.
+// Pixels are processed as rows of RGBA floats with SSE2, rows accumulations use AVX2 when the CPU has it.
+// Resize and Convolve work on the first face and mip, other kernels on every pixel of the image.
+namespace ImageKernels
+{
+    enum ResizeFilter
+    {
+        Box,
+        Bilinear,
+        Lanczos,
+    };
+    // Swizzle channel values besides 0 to 3
+    enum SwizzleValue
+    {
+        SwizzleZero = 4,
+        SwizzleOne = 5,
+    };
+
+    int Resize(Image* source, Image* destination, int width, int height, int filter);
+    // separable: kernel has 2 * radius + 1 weights, applied horizontally then vertically. Edges are clamped
+    int Convolve(Image* image, const float* kernel, int radius);
+    int Convert(Image* source, Image* destination, int format);
+    int Premultiply(Image* image);
+    int Unpremultiply(Image* image);
+    int Swizzle(Image* image, int red, int green, int blue, int alpha);
+    // binCount bins over [0, 1] for a channel (0 to 3)
+    int Histogram(Image* image, int channel, int binCount, unsigned int* bins);
+    // 4 floats, per channel
+    int MinMax(Image* image, float* minimum, float* maximum);
+
+    // count texels of format to/from RGBA floats
+    void LoadRow(const unsigned char* source, int format, int count, float* rgba);
+    void StoreRow(const float* rgba, int format, int count, unsigned char* destination);
+}
@@ -0,0 +1,164 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "ImageReadback.h"
+#include "EvaluationContext.h"
+#include "Evaluators.h"
+
+ImageReadback gImageReadback;
+
+int ImageReadback::Request(EvaluationContext* evaluationContext, int target, Completion completion)
+{
+    if (target < 0 || target >= int(evaluationContext->mEvaluationStages.GetStagesCount()))
+    {
+        return -1;
+    }
+    auto tgt = evaluationContext->GetRenderTarget(target);
+    if (!tgt || !tgt->mGLTexID)
+    {
+        return -1;
+    }
+#ifndef glGetTexImage
+    // no pixel pack readback of textures. Synchronous fallback.
+    Image image;
+    if (EvaluationAPI::GetEvaluationImage(evaluationContext, target, &image) != EVAL_OK)
+        return -1;
+    completion(image);
+    return mNextHandle++;
+#else
+    auto img = tgt->mImage;
+    const unsigned int texelSize = textureFormatSize[img->mFormat];
+    unsigned int texelFormat, texelType;
+    GetGLPixelFormat(img->mFormat, texelFormat, texelType);
+    size_t size = 0;
+    for (int i = 0; i < img->mNumMips; i++)
+        size += img->mNumFaces * (img->mWidth >> i) * (img->mHeight >> i) * texelSize;
+    if (!size)
+    {
+        return -1;
+    }
+
+    Pending pending;
+    pending.mHandle = mNextHandle++;
+    pending.mCompletion = completion;
+    pending.mImage.mWidth = img->mWidth;
+    pending.mImage.mHeight = img->mHeight;
+    pending.mImage.mNumMips = img->mNumMips;
+    pending.mImage.mNumFaces = img->mNumFaces;
+    pending.mImage.mFormat = img->mFormat;
+    pending.mSize = size;
+
+    glGenBuffers(1, &pending.mBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.mBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+
+    // same layout as GetEvaluationImage: faces, then mips
+    size_t offset = 0;
+    const GLenum textureTarget = (img->mNumFaces == 1) ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+    glBindTexture(textureTarget, tgt->mGLTexID);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int face = 0; face < img->mNumFaces; face++)
+    {
+        const GLenum faceTarget = (img->mNumFaces == 1) ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+        for (int i = 0; i < img->mNumMips; i++)
+        {
+            glGetTexImage(faceTarget, i, texelFormat, texelType, (void*)offset);
+            offset += (img->mWidth >> i) * (img->mHeight >> i) * texelSize;
+        }
+    }
+    glBindTexture(textureTarget, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pending.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // make sure the fence gets to the GPU even if nothing else is submitted
+    glFlush();
+    const int handle = pending.mHandle;
+    mPending.push_back(std::move(pending));
+    return handle;
+#endif
+}
+
+bool ImageReadback::IsPending(int handle) const
+{
+    for (auto& pending : mPending)
+    {
+        if (pending.mHandle == handle)
+            return true;
+    }
+    return false;
+}
+
+void ImageReadback::Deliver(Pending& pending)
+{
+    glDeleteSync((GLsync)pending.mFence);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.mBuffer);
+    const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pending.mSize, GL_MAP_READ_BIT);
+    if (ptr)
+    {
+        pending.mImage.Allocate(pending.mSize);
+        memcpy(pending.mImage.GetWritableBits(), ptr, pending.mSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(1, &pending.mBuffer);
+    if (ptr)
+    {
+        pending.mCompletion(pending.mImage);
+    }
+    else
+    {
+        Log("Readback %d failed\n", pending.mHandle);
+    }
+}
+
+void ImageReadback::Update()
+{
+    for (size_t i = 0; i < mPending.size();)
+    {
+        GLenum res = glClientWaitSync((GLsync)mPending[i].mFence, 0, 0);
+        if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED || res == GL_WAIT_FAILED)
+        {
+            Pending pending = std::move(mPending[i]);
+            mPending.erase(mPending.begin() + i);
+            Deliver(pending);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void ImageReadback::Wait(size_t maxPending)
+{
+    while (mPending.size() > maxPending)
+    {
+        Pending pending = std::move(mPending.front());
+        mPending.erase(mPending.begin());
+        glClientWaitSync((GLsync)pending.mFence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+        Deliver(pending);
+    }
+}
@@ -0,0 +1,73 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <vector>
+#include <functional>
+#include "Bitmap.h"
+
+struct EvaluationContext;
+
+// Asynchronous readback of node results.
+// Request copies the render target into a pixel pack buffer and puts a fence.
+// Update (once per frame, GL thread) maps the buffers whose fence is signaled and calls the completion
+// with the pixels, a frame or more later. Completions run on the GL thread: heavy work (encoding) goes to g_TS.
+struct ImageReadback
+{
+    typedef std::function<void(Image& image)> Completion;
+
+    // returns a handle or -1 if the target has nothing to read
+    int Request(EvaluationContext* evaluationContext, int target, Completion completion);
+    bool IsPending(int handle) const;
+    void Update();
+    // wait for the oldest readbacks and deliver them until no more than maxPending are left
+    void Wait(size_t maxPending);
+    // wait for all pending readbacks and deliver them
+    void Finish()
+    {
+        Wait(0);
+    }
+    size_t GetPendingCount() const
+    {
+        return mPending.size();
+    }
+
+protected:
+    struct Pending
+    {
+        int mHandle;
+        unsigned int mBuffer;
+        void* mFence;
+        size_t mSize;
+        Image mImage; // allocated when the pixels are copied, keeps pending cheap to move
+        Completion mCompletion;
+    };
+    void Deliver(Pending& pending);
+
+    std::vector<Pending> mPending;
+    int mNextHandle = 1;
+};
+
+extern ImageReadback gImageReadback;
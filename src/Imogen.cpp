@@ -41,9 +41,11 @@
 #include "imgui_markdown/imgui_markdown.h"
 #include "imHotKey.h"
 #include "imgInspect.h"
+#include "ResultCache.h"
+#include "TextureContainer.h"
+#include "ImageReadback.h"
 
 Imogen* Imogen::instance = nullptr;
-unsigned char* stbi_write_png_to_mem(unsigned char* pixels, int stride_bytes, int x, int y, int n, int* out_len);
 
 extern TaskScheduler g_TS;
 
@@ -343,9 +345,9 @@ struct PinnedTaskUploadImage : PinnedTask
 
     virtual void Execute()
     {
-        unsigned int textureId = Image::Upload(mImage, 0);
         if (mbIsThumbnail)
         {
+            unsigned int textureId = Image::Upload(mImage, 0);
             Material* material = library.Get(mIdentifier);
             if (material)
                 material->mThumbnailTextureId = textureId;
@@ -378,19 +380,11 @@ struct DecodeThumbnailTaskSet : TaskSet
     virtual void ExecuteRange(TaskSetPartition range, uint32_t threadnum)
     {
         Image image;
-        int components;
-        unsigned char* data =
-            stbi_load_from_memory(mSrc->data(), int(mSrc->size()), &image.mWidth, &image.mHeight, &components, 0);
-        if (data)
-        {
-            image.SetBits(data, image.mWidth * image.mHeight * components);
-            image.mNumFaces = 1;
-            image.mNumMips = 1;
-            image.mFormat = (components == 4) ? TextureFormat::RGBA8 : TextureFormat::RGB8;
+        if (Image::ReadMem(mSrc->data(), mSrc->size(), &image) == EVAL_OK)
+        {
             PinnedTaskUploadImage uploadTexTask(&image, mIdentifier, true, mNodeGraphControler);
             g_TS.AddPinnedTask(&uploadTexTask);
             g_TS.WaitforTask(&uploadTexTask);
-            stbi_image_free(data);
             Image::Free(&image);
         }
         delete this;
@@ -408,15 +402,9 @@ struct EncodeImageTaskSet : TaskSet
     }
     virtual void ExecuteRange(TaskSetPartition range, uint32_t threadnum)
     {
-        int outlen;
-        int components = 4;
-        unsigned char* bits = stbi_write_png_to_mem((unsigned char*)mImage.GetBits(),
-                                                    mImage.mWidth * components,
-                                                    mImage.mWidth,
-                                                    mImage.mHeight,
-                                                    components,
-                                                    &outlen);
-        if (bits)
+        // all faces and mips, decoded and uploaded as is when the material is opened
+        std::vector<uint8_t> container;
+        if (TextureContainer::Encode(&mImage, TextureContainer::Compress, container) == EVAL_OK)
         {
             Material* material = library.Get(mMaterialIdentifier);
             if (material)
@@ -424,8 +412,7 @@ struct EncodeImageTaskSet : TaskSet
                 MaterialNode* node = material->Get(mNodeIdentifier);
                 if (node)
                 {
-                    node->mImage.resize(outlen);
-                    memcpy(node->mImage.data(), bits, outlen);
+                    node->mImage.swap(container);
                 }
             }
         }
@@ -445,19 +432,15 @@ struct DecodeImageTaskSet : TaskSet
     virtual void ExecuteRange(TaskSetPartition range, uint32_t threadnum)
     {
         Image image;
-        int components;
-        unsigned char* data =
-            stbi_load_from_memory(mSrc->data(), int(mSrc->size()), &image.mWidth, &image.mHeight, &components, 0);
-        if (data)
-        {
-            image.SetBits(data, image.mWidth * image.mHeight * components);
-            image.mNumFaces = 1;
-            image.mNumMips = 1;
-            image.mFormat = (components == 3) ? TextureFormat::RGB8 : TextureFormat::RGBA8;
+        // PNG in libraries saved before the texture container
+        const int result = TextureContainer::IsContainer(mSrc->data(), mSrc->size())
+                               ? TextureContainer::Decode(mSrc->data(), mSrc->size(), &image)
+                               : Image::ReadMem(mSrc->data(), mSrc->size(), &image);
+        if (result == EVAL_OK)
+        {
             PinnedTaskUploadImage uploadTexTask(&image, mIdentifier, false, mNodeGraphControler);
             g_TS.AddPinnedTask(&uploadTexTask);
             g_TS.WaitforTask(&uploadTexTask);
-            stbi_image_free(data);
         }
         delete this;
     }
@@ -468,7 +451,7 @@ struct DecodeImageTaskSet : TaskSet
 
 void Imogen::DecodeThumbnailAsync(Material* material)
 {
-    static unsigned int defaultTextureId = gImageCache.GetTexture("Stock/thumbnail-icon.png");
+    static unsigned int defaultTextureId = gImageCache.GetTexture("Stock/thumbnail-icon.png", true);
     if (!material->mThumbnailTextureId)
     {
         material->mThumbnailTextureId = defaultTextureId;
@@ -598,13 +581,13 @@ void ValidateMaterial(Library& library, NodeGraphControler& nodeGraphControler,
         dstNode.mRuntimeUniqueId = GetRuntimeId();
         if (metaNode.mbSaveTexture)
         {
-            Image image;
-            if (EvaluationAPI::GetEvaluationImage(&nodeGraphControler.mEditingContext, int(i), &image) == EVAL_OK)
-            {
-                g_TS.AddTaskSetToPipe(new EncodeImageTaskSet(image,
-                                                             std::make_pair(materialIndex, material.mRuntimeUniqueId),
-                                                             std::make_pair(i, dstNode.mRuntimeUniqueId)));
-            }
+            // pixels come back a frame or more later, encoding runs on a worker
+            ASyncId materialIdentifier = std::make_pair(materialIndex, material.mRuntimeUniqueId);
+            ASyncId nodeIdentifier = std::make_pair(i, dstNode.mRuntimeUniqueId);
+            gImageReadback.Request(
+                &nodeGraphControler.mEditingContext, int(i), [materialIdentifier, nodeIdentifier](Image& image) {
+                    g_TS.AddTaskSetToPipe(new EncodeImageTaskSet(image, materialIdentifier, nodeIdentifier));
+                });
         }
 
         dstNode.mType = uint32_t(srcNode.mType);
@@ -1397,6 +1380,7 @@ void Imogen::Init()
         {"ToggleLogger", "Show or hide Logger window", [&]() { mbShowLog = !mbShowLog; }},
         {"ToggleSequencer", "Show or hide Sequencer window", [&]() { mbShowTimeline = !mbShowTimeline; }},
         {"ToggleParameters", "Show or hide Parameters window", [&]() { mbShowParameters = !mbShowParameters; }},
+        {"ToggleProfiler", "Show or hide Profiler window", [&]() { mbShowProfiler = !mbShowProfiler; }},
         {"MaterialNew", "Create a new graph", [&]() { NewMaterial(); }},
         {"ReloadShaders",
          "Reload them",
@@ -1536,6 +1520,7 @@ void Imogen::ShowAppMainMenuBar()
         ImGui::Checkbox(GetShortCutLib("ToggleLogger"), &mbShowLog);
         ImGui::Checkbox(GetShortCutLib("ToggleSequencer"), &mbShowTimeline);
         ImGui::Checkbox(GetShortCutLib("ToggleParameters"), &mbShowParameters);
+        ImGui::Checkbox(GetShortCutLib("ToggleProfiler"), &mbShowProfiler);
     }
 
     ImRect windowRect(ImVec2(0, 32), ImVec2(440, io.DisplaySize.y - 32));
@@ -1556,7 +1541,8 @@ void Imogen::BuildCurrentMaterial(Builder* builder)
     if (mSelectedMaterial != -1)
     {
         Material& material = library.mMaterials[mSelectedMaterial];
-        builder->Add(material.mName.c_str(), mNodeGraphControler->mEvaluationStages);
+        // before batch builds from plugins
+        builder->Add(material.mName.c_str(), mNodeGraphControler->mEvaluationStages, 1);
     }
 }
 
@@ -1680,6 +1666,11 @@ void Imogen::ShowTitleBar(Builder* builder)
     {
         auto& bi = buildInfos[0];
         ImGui::Text("Processing %s", bi.mName.c_str());
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Cancel"))
+        {
+            builder->Cancel(bi.mId);
+        }
         ImGui::ProgressBar(bi.mProgress);
     }
     ImGui::EndChildFrame();
@@ -1879,6 +1870,102 @@ void Imogen::DeleteCurrentMaterial()
     UpdateNewlySelectedGraph();
 }
 
+void Imogen::ShowProfiler()
+{
+    Profiler& profiler = mNodeGraphControler->mEditingContext.mProfiler;
+    bool enabled = profiler.IsEnabled();
+    if (ImGui::Checkbox("Enabled", &enabled))
+    {
+        profiler.Enable(enabled);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+    {
+        profiler.Clear();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Trace"))
+    {
+#ifndef EMSCRIPTEN
+        nfdchar_t* outPath = NULL;
+        if (NFD_SaveDialog("json", NULL, &outPath) == NFD_OKAY)
+        {
+            profiler.ExportChromeTrace(outPath);
+            free(outPath);
+        }
+#else
+        profiler.ExportChromeTrace("trace.json");
+#endif
+    }
+    ImGui::Text("Result cache: %d entries, %d MB, %d hits, %d misses",
+                int(gResultCache.GetEntryCount()),
+                int(gResultCache.GetUsage() >> 20),
+                int(gResultCache.GetHitCount()),
+                int(gResultCache.GetMissCount()));
+    const ImageCacheStats imageCacheStats = gImageCache.GetStats();
+    ImGui::Text("Image cache: %d images, %d/%d MB, %d textures, %d/%d MB",
+                int(imageCacheStats.mImageCount),
+                int(imageCacheStats.mCPUUsage >> 20),
+                int(imageCacheStats.mCPUBudget >> 20),
+                int(imageCacheStats.mTextureCount),
+                int(imageCacheStats.mGPUUsage >> 20),
+                int(imageCacheStats.mGPUBudget >> 20));
+    ImGui::Text("%d hits, %d misses, %d evictions, %d reloads",
+                int(imageCacheStats.mHitCount),
+                int(imageCacheStats.mMissCount),
+                int(imageCacheStats.mEvictionCount),
+                int(imageCacheStats.mInvalidationCount));
+    ImGui::Separator();
+
+    // most expensive nodes first
+    const auto& timings = profiler.GetNodeTimings();
+    std::vector<int> sortedNodes;
+    for (size_t i = 0; i < timings.size(); i++)
+    {
+        if (timings[i].mNodeType >= 0 && timings[i].mNodeType < int(gMetaNodes.size()))
+            sortedNodes.push_back(int(i));
+    }
+    std::sort(sortedNodes.begin(), sortedNodes.end(), [&timings](int a, int b) {
+        return (timings[a].mCPUAverage + timings[a].mGPUAverage) > (timings[b].mCPUAverage + timings[b].mGPUAverage);
+    });
+
+    ImGui::Columns(5, "profilerColumns");
+    ImGui::Text("Node");
+    ImGui::NextColumn();
+    ImGui::Text("CPU ms");
+    ImGui::NextColumn();
+    ImGui::Text("GPU ms");
+    ImGui::NextColumn();
+    ImGui::Text("CPU avg");
+    ImGui::NextColumn();
+    ImGui::Text("GPU avg");
+    ImGui::NextColumn();
+    ImGui::Separator();
+    for (auto nodeIndex : sortedNodes)
+    {
+        const auto& timing = timings[nodeIndex];
+        char tmps[512];
+        sprintf(tmps, "%s %d", gMetaNodes[timing.mNodeType].mName.c_str(), nodeIndex);
+        if (ImGui::Selectable(
+                tmps, mNodeGraphControler->mSelectedNodeIndex == nodeIndex, ImGuiSelectableFlags_SpanAllColumns) &&
+            nodeIndex < int(mNodeGraphControler->mEvaluationStages.GetStagesCount()))
+        {
+            mNodeGraphControler->mSelectedNodeIndex = nodeIndex;
+            NodeGraphSelectNode(nodeIndex);
+        }
+        ImGui::NextColumn();
+        ImGui::Text("%5.3f", timing.mCPU);
+        ImGui::NextColumn();
+        ImGui::Text("%5.3f", timing.mGPU);
+        ImGui::NextColumn();
+        ImGui::Text("%5.3f", timing.mCPUAverage);
+        ImGui::NextColumn();
+        ImGui::Text("%5.3f", timing.mGPUAverage);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+}
+
 void Imogen::ShowNodeGraph()
 {
     if (mSelectedMaterial != -1)
@@ -2001,6 +2088,16 @@ void Imogen::Show(Builder* builder, Library& library, bool capturing)
             ImGui::End();
         }
 
+        if (mbShowProfiler)
+        {
+            if (ImGui::Begin("Profiler", &mbShowProfiler))
+            {
+                ShowProfiler();
+            }
+            interfacesRect["Profiler"] = ImRect(ImGui::GetWindowPos(), ImGui::GetWindowPos() + ImGui::GetWindowSize());
+            ImGui::End();
+        }
+
         // view extraction
         int index = 0;
         int removeExtractedView = -1;
@@ -2146,6 +2243,10 @@ void Imogen::ReadLine(ImGuiContext* ctx, ImGuiSettingsHandler* handler, void* en
         {
             userdata->imogen->mbShowParameters = active != 0;
         }
+        else if (sscanf(line_start, "ShowProfiler=%d", &active) == 1)
+        {
+            userdata->imogen->mbShowProfiler = active != 0;
+        }
         else if (sscanf(line_start, "LibraryViewMode=%d", &active) == 1)
         {
             userdata->imogen->mLibraryViewMode = active;
@@ -2178,6 +2279,7 @@ void Imogen::WriteAll(ImGuiContext* ctx, ImGuiSettingsHandler* handler, ImGuiTex
     buf->appendf("ShowNodes=%d\n", instance->mbShowNodes ? 1 : 0);
     buf->appendf("ShowLog=%d\n", instance->mbShowLog ? 1 : 0);
     buf->appendf("ShowParameters=%d\n", instance->mbShowParameters ? 1 : 0);
+    buf->appendf("ShowProfiler=%d\n", instance->mbShowProfiler ? 1 : 0);
     buf->appendf("ShowMouseState=%d\n", instance->mbShowMouseState ? 1 : 0);
     buf->appendf("LibraryViewMode=%d\n", instance->mLibraryViewMode);
 
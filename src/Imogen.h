@@ -72,10 +72,10 @@ struct Imogen
 
     void Show(Builder* builder, Library& library, bool capturing);
     void ValidateCurrentMaterial(Library& library);
-    void DiscoverNodes(const char* extension,
-                       const char* directory,
-                       EVALUATOR_TYPE evaluatorType,
-                       std::vector<EvaluatorFile>& files);
+    static void DiscoverNodes(const char* extension,
+                              const char* directory,
+                              EVALUATOR_TYPE evaluatorType,
+                              std::vector<EvaluatorFile>& files);
 
     std::vector<EvaluatorFile> mEvaluatorFiles;
 
@@ -111,6 +111,7 @@ protected:
     void UpdateNewlySelectedGraph();
     void ShowTimeLine();
     void ShowNodeGraph();
+    void ShowProfiler();
     void BuildCurrentMaterial(Builder* builder);
     void PlayPause();
 
@@ -135,6 +136,7 @@ protected:
     bool mbShowNodes = false;
     bool mbShowLog = false;
     bool mbShowParameters = false;
+    bool mbShowProfiler = false;
     bool mbShowMouseState = false;
     int mLibraryViewMode = 1;
 
@@ -760,6 +760,32 @@ void SaveMetaNodes(const char* filename)
             nodeValue.AddMember("hasUI", rapidjson::Value().SetBool(node.mbHasUI), allocator);
         if (node.mbSaveTexture)
             nodeValue.AddMember("saveTexture", rapidjson::Value().SetBool(node.mbSaveTexture), allocator);
+        if (node.mFootprint >= 0.f)
+        {
+            rapidjson::Value footprintValue;
+            footprintValue.SetObject();
+            footprintValue.AddMember("uv", rapidjson::Value().SetFloat(node.mFootprint), allocator);
+            if (node.mFootprintPixels > FLT_EPSILON)
+                footprintValue.AddMember("pixels", rapidjson::Value().SetFloat(node.mFootprintPixels), allocator);
+            if (!node.mFootprintParameter.empty())
+            {
+                footprintValue.AddMember(
+                    "parameter", rapidjson::Value(node.mFootprintParameter.c_str(), allocator), allocator);
+                footprintValue.AddMember("scale", rapidjson::Value().SetFloat(node.mFootprintScale), allocator);
+            }
+            if (!node.mFootprintPasses.empty())
+                footprintValue.AddMember(
+                    "passes", rapidjson::Value(node.mFootprintPasses.c_str(), allocator), allocator);
+            nodeValue.AddMember("footprint", footprintValue, allocator);
+        }
+        if (node.mConvergencePeriod > 0)
+        {
+            rapidjson::Value convergenceValue;
+            convergenceValue.SetObject();
+            convergenceValue.AddMember("period", rapidjson::Value().SetInt(node.mConvergencePeriod), allocator);
+            convergenceValue.AddMember("epsilon", rapidjson::Value().SetFloat(node.mConvergenceEpsilon), allocator);
+            nodeValue.AddMember("convergence", convergenceValue, allocator);
+        }
 
         nodelist.PushBack(nodeValue, allocator);
     }
@@ -889,6 +915,35 @@ std::vector<MetaNode> ReadMetaNodes(const char* filename)
         else
             curNode.mbSaveTexture = false;
 
+        if (node.HasMember("footprint"))
+        {
+            rapidjson::Value& footprint = node["footprint"];
+            if (footprint.IsNumber())
+            {
+                curNode.mFootprint = footprint.GetFloat();
+            }
+            else if (footprint.IsObject())
+            {
+                curNode.mFootprint = footprint.HasMember("uv") ? footprint["uv"].GetFloat() : 0.f;
+                if (footprint.HasMember("pixels"))
+                    curNode.mFootprintPixels = footprint["pixels"].GetFloat();
+                if (footprint.HasMember("parameter"))
+                    curNode.mFootprintParameter = footprint["parameter"].GetString();
+                if (footprint.HasMember("scale"))
+                    curNode.mFootprintScale = footprint["scale"].GetFloat();
+                if (footprint.HasMember("passes"))
+                    curNode.mFootprintPasses = footprint["passes"].GetString();
+            }
+        }
+
+        if (node.HasMember("convergence"))
+        {
+            rapidjson::Value& convergence = node["convergence"];
+            curNode.mConvergencePeriod = convergence.HasMember("period") ? convergence["period"].GetInt() : 1;
+            if (convergence.HasMember("epsilon"))
+                curNode.mConvergenceEpsilon = convergence["epsilon"].GetFloat();
+        }
+
         if (!node.HasMember("color"))
         {
             // error
@@ -554,6 +554,20 @@ struct MetaNode
     bool mbHasUI;
     bool mbSaveTexture;
 
+    // tiled evaluation: texels read around each output texel are
+    // (mFootprint + mFootprintScale * parameter) * image size + mFootprintPixels, times passes.
+    // negative mFootprint: inputs can be read anywhere, the node can't be tiled
+    float mFootprint = -1.f;
+    float mFootprintPixels = 0.f;
+    float mFootprintScale = 0.f;
+    std::string mFootprintParameter;
+    std::string mFootprintPasses;
+
+    // multi-pass early-out: passes stop when the result equals, within mConvergenceEpsilon, the one
+    // mConvergencePeriod passes before. The converged result is used as the last pass result.
+    int mConvergencePeriod = 0;
+    float mConvergenceEpsilon = 0.f;
+
     bool operator==(const MetaNode& other) const
     {
         if (mName != other.mName)
@@ -572,6 +586,12 @@ struct MetaNode
             return false;
         if (mbSaveTexture != other.mbSaveTexture)
             return false;
+        if (mFootprint != other.mFootprint || mFootprintPixels != other.mFootprintPixels ||
+            mFootprintScale != other.mFootprintScale || mFootprintParameter != other.mFootprintParameter ||
+            mFootprintPasses != other.mFootprintPasses)
+            return false;
+        if (mConvergencePeriod != other.mConvergencePeriod || mConvergenceEpsilon != other.mConvergenceEpsilon)
+            return false;
         return true;
     }
 
@@ -35,6 +35,7 @@
 #include "imgui_stdlib.h"
 #include "NodeGraphControler.h"
 #include <array>
+#include <chrono>
 #include "imgui_markdown/imgui_markdown.h"
 #include "UI.h"
 
@@ -66,52 +67,124 @@ struct NodeOrder
     }
 };
 
-size_t PickBestNode(const std::vector<NodeOrder>& orders)
+// Evaluation order graph
+// A node priority is 1 + the longest path to a sink (final node). Evaluation goes from highest priority to lowest.
+// Adjacency is kept per node so the priorities are built in O(V+E) (Kahn from the sinks)
+// and maintained incrementally when a single link or node is added. Node deletion shifts indices and rebuilds.
+struct EvaluationOrderGraph
 {
-    for (auto& order : orders)
+    void Build(const std::vector<NodeLink>& links, size_t nodeCount)
     {
-        if (order.mNodePriority == 0)
-            return order.mNodeIndex;
+        mPriorities.assign(nodeCount, 1);
+        mProducers.assign(nodeCount, std::vector<size_t>());
+        mConsumers.assign(nodeCount, std::vector<size_t>());
+        for (auto& link : links)
+        {
+            mProducers[link.OutputIdx].push_back(link.InputIdx);
+            mConsumers[link.InputIdx].push_back(link.OutputIdx);
+        }
+
+        std::vector<size_t> remainingConsumers(nodeCount);
+        std::vector<size_t> sinks;
+        for (size_t i = 0; i < nodeCount; i++)
+        {
+            remainingConsumers[i] = mConsumers[i].size();
+            if (!remainingConsumers[i])
+                sinks.push_back(i);
+        }
+        while (!sinks.empty())
+        {
+            size_t nodeIndex = sinks.back();
+            sinks.pop_back();
+            for (auto producer : mProducers[nodeIndex])
+            {
+                mPriorities[producer] = std::max(mPriorities[producer], mPriorities[nodeIndex] + 1);
+                if (!--remainingConsumers[producer])
+                    sinks.push_back(producer);
+            }
+        }
     }
-    // issue!
-    assert(0);
-    return -1;
-}
 
-void RecurseSetPriority(std::vector<NodeOrder>& orders,
-                        const std::vector<NodeLink>& links,
-                        size_t currentIndex,
-                        size_t currentPriority,
-                        size_t& undeterminedNodeCount)
-{
-    if (!orders[currentIndex].mNodePriority)
-        undeterminedNodeCount--;
+    void AddNode()
+    {
+        mPriorities.push_back(1);
+        mProducers.push_back(std::vector<size_t>());
+        mConsumers.push_back(std::vector<size_t>());
+    }
 
-    orders[currentIndex].mNodePriority = std::max(orders[currentIndex].mNodePriority, currentPriority + 1);
-    for (auto& link : links)
+    void AddLink(size_t producer, size_t consumer)
+    {
+        mProducers[consumer].push_back(producer);
+        mConsumers[producer].push_back(consumer);
+        Propagate(producer);
+    }
+
+    void DelLink(size_t producer, size_t consumer)
     {
-        if (link.OutputIdx == currentIndex)
+        auto& producers = mProducers[consumer];
+        auto iter = std::find(producers.begin(), producers.end(), producer);
+        if (iter != producers.end())
+            producers.erase(iter);
+        auto& consumers = mConsumers[producer];
+        iter = std::find(consumers.begin(), consumers.end(), consumer);
+        if (iter != consumers.end())
+            consumers.erase(iter);
+        Propagate(producer);
+    }
+
+    size_t GetNodeCount() const
+    {
+        return mPriorities.size();
+    }
+
+    // counting sort, highest priority first, node index for equal priorities
+    void GetOrders(std::vector<NodeOrder>& orders) const
+    {
+        size_t maxPriority = 0;
+        for (auto priority : mPriorities)
+            maxPriority = std::max(maxPriority, priority);
+        std::vector<size_t> offsets(maxPriority + 2, 0);
+        for (auto priority : mPriorities)
+            offsets[maxPriority - priority + 1]++;
+        for (size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+        orders.resize(mPriorities.size());
+        for (size_t i = 0; i < mPriorities.size(); i++)
         {
-            RecurseSetPriority(orders, links, link.InputIdx, currentPriority + 1, undeterminedNodeCount);
+            orders[offsets[maxPriority - mPriorities[i]]++] = {i, mPriorities[i]};
         }
     }
-}
 
-std::vector<NodeOrder> ComputeEvaluationOrder(const std::vector<NodeLink>& links, size_t nodeCount)
-{
-    std::vector<NodeOrder> orders(nodeCount);
-    for (size_t i = 0; i < nodeCount; i++)
+protected:
+    // recompute the priority of a node and of its producers when it changes
+    void Propagate(size_t nodeIndex)
     {
-        orders[i].mNodeIndex = i;
-        orders[i].mNodePriority = 0;
+        std::vector<size_t> nodesToUpdate(1, nodeIndex);
+        while (!nodesToUpdate.empty())
+        {
+            size_t currentIndex = nodesToUpdate.back();
+            nodesToUpdate.pop_back();
+            size_t priority = 1;
+            for (auto consumer : mConsumers[currentIndex])
+                priority = std::max(priority, mPriorities[consumer] + 1);
+            if (priority == mPriorities[currentIndex])
+                continue;
+            mPriorities[currentIndex] = priority;
+            nodesToUpdate.insert(nodesToUpdate.end(), mProducers[currentIndex].begin(), mProducers[currentIndex].end());
+        }
     }
-    size_t undeterminedNodeCount = nodeCount;
-    while (undeterminedNodeCount)
-    {
-        size_t currentIndex = PickBestNode(orders);
-        RecurseSetPriority(orders, links, currentIndex, orders[currentIndex].mNodePriority, undeterminedNodeCount);
-    };
-    //
+
+    std::vector<size_t> mPriorities;
+    std::vector<std::vector<size_t>> mProducers;
+    std::vector<std::vector<size_t>> mConsumers;
+};
+
+std::vector<NodeOrder> ComputeEvaluationOrder(const std::vector<NodeLink>& links, size_t nodeCount)
+{
+    EvaluationOrderGraph graph;
+    graph.Build(links, nodeCount);
+    std::vector<NodeOrder> orders;
+    graph.GetOrders(orders);
     return orders;
 }
 
@@ -119,6 +192,7 @@ const float NODE_SLOT_RADIUS = 8.0f;
 const ImVec2 NODE_WINDOW_PADDING(8.0f, 8.0f);
 
 static std::vector<NodeOrder> mOrders;
+static EvaluationOrderGraph mOrderGraph;
 static std::vector<Node> nodes;
 static std::vector<Node> mNodesClipboard;
 static std::vector<NodeLink> links;
@@ -391,19 +465,108 @@ bool RecurseIsLinked(int from, int to)
     return false;
 }
 
-void NodeGraphUpdateEvaluationOrder(NodeGraphControlerBase* controler)
+static void PublishEvaluationOrder(NodeGraphControlerBase* controler)
 {
-    mOrders = ComputeEvaluationOrder(links, nodes.size());
-    std::sort(mOrders.begin(), mOrders.end());
-    std::vector<size_t> nodeOrderList(mOrders.size());
-    for (size_t i = 0; i < mOrders.size(); i++)
-        nodeOrderList[i] = mOrders[i].mNodeIndex;
+    mOrderGraph.GetOrders(mOrders);
     if (controler)
     {
+        std::vector<size_t> nodeOrderList(mOrders.size());
+        for (size_t i = 0; i < mOrders.size(); i++)
+            nodeOrderList[i] = mOrders[i].mNodeIndex;
         controler->UpdateEvaluationList(nodeOrderList);
     }
 }
 
+void NodeGraphUpdateEvaluationOrder(NodeGraphControlerBase* controler)
+{
+    mOrderGraph.Build(links, nodes.size());
+    PublishEvaluationOrder(controler);
+}
+
+// incremental updates. Fallback to a full build if the graph is out of sync with the nodes
+static void NodeGraphUpdateEvaluationOrderAddLink(NodeGraphControlerBase* controler, const NodeLink& link)
+{
+    if (mOrderGraph.GetNodeCount() != nodes.size())
+    {
+        NodeGraphUpdateEvaluationOrder(controler);
+        return;
+    }
+    mOrderGraph.AddLink(link.InputIdx, link.OutputIdx);
+    PublishEvaluationOrder(controler);
+}
+
+static void NodeGraphUpdateEvaluationOrderDelLink(NodeGraphControlerBase* controler, const NodeLink& link)
+{
+    if (mOrderGraph.GetNodeCount() != nodes.size())
+    {
+        NodeGraphUpdateEvaluationOrder(controler);
+        return;
+    }
+    mOrderGraph.DelLink(link.InputIdx, link.OutputIdx);
+    PublishEvaluationOrder(controler);
+}
+
+static void NodeGraphUpdateEvaluationOrderAddNode(NodeGraphControlerBase* controler)
+{
+    if (mOrderGraph.GetNodeCount() + 1 != nodes.size())
+    {
+        NodeGraphUpdateEvaluationOrder(controler);
+        return;
+    }
+    mOrderGraph.AddNode();
+    PublishEvaluationOrder(controler);
+}
+
+void NodeGraphBenchmarkEvaluationOrder()
+{
+    static const size_t nodeCounts[] = {100, 1000, 10000};
+    static const int runCount = 10;
+    srand(0);
+    for (auto nodeCount : nodeCounts)
+    {
+        // random DAG, producers always have a lower index. up to 3 inputs per node.
+        std::vector<NodeLink> benchLinks;
+        for (size_t i = 1; i < nodeCount; i++)
+        {
+            int inputCount = rand() % 4;
+            for (int slot = 0; slot < inputCount; slot++)
+            {
+                size_t window = std::min(i, size_t(32));
+                benchLinks.push_back(NodeLink(int(i - 1 - rand() % window), 0, int(i), slot));
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<NodeOrder> orders;
+        for (int run = 0; run < runCount; run++)
+        {
+            orders = ComputeEvaluationOrder(benchLinks, nodeCount);
+        }
+        auto fullBuild = std::chrono::high_resolution_clock::now();
+
+        EvaluationOrderGraph graph;
+        graph.Build(benchLinks, nodeCount);
+        for (int run = 0; run < runCount; run++)
+        {
+            const NodeLink& link = benchLinks[rand() % benchLinks.size()];
+            graph.DelLink(link.InputIdx, link.OutputIdx);
+            graph.GetOrders(orders);
+            graph.AddLink(link.InputIdx, link.OutputIdx);
+            graph.GetOrders(orders);
+        }
+        auto incremental = std::chrono::high_resolution_clock::now();
+
+        double fullMs = std::chrono::duration<double, std::milli>(fullBuild - start).count() / runCount;
+        double incrementalMs =
+            std::chrono::duration<double, std::milli>(incremental - fullBuild).count() / (runCount * 2);
+        Log("Evaluation order : %d nodes, %d links. Full build %5.3f ms, link edit %5.3f ms\n",
+            int(nodeCount),
+            int(benchLinks.size()),
+            fullMs,
+            incrementalMs);
+    }
+}
+
 size_t NodeGraphAddNode(NodeGraphControlerBase* controler,
                         int type,
                         const std::vector<unsigned char>* parameters,
@@ -594,7 +757,8 @@ static void ContextMenu(ImVec2 offset, int nodeHovered, NodeGraphControlerBase*
 
                 nodes.push_back(Node(i, scene_pos));
                 controler->UserAddNode(i);
-                addDelNodeLambda(0);
+                NodeGraphUpdateEvaluationOrderAddNode(controler);
+                controler->mSelectedNodeIndex = -1;
             };
 
             static char inputText[64] = {0};
@@ -908,12 +1072,12 @@ bool HandleConnections(ImDrawList* drawList,
     auto deleteLink = [controler](int index) {
         NodeLink& link = links[index];
         controler->DelLink(link.OutputIdx, link.OutputSlot);
-        NodeGraphUpdateEvaluationOrder(controler);
+        NodeGraphUpdateEvaluationOrderDelLink(controler, link);
     };
     auto addLink = [controler](int index) {
         NodeLink& link = links[index];
         controler->AddLink(link.InputIdx, link.InputSlot, link.OutputIdx, link.OutputSlot);
-        NodeGraphUpdateEvaluationOrder(controler);
+        NodeGraphUpdateEvaluationOrderAddLink(controler, link);
     };
 
     size_t metaNodeCount = gMetaNodes.size();
@@ -1006,8 +1170,8 @@ bool HandleConnections(ImDrawList* drawList,
                         {
                             URDel<NodeLink> undoRedoDel(linkIndex, []() { return &links; }, deleteLink, addLink);
                             controler->DelLink(link.OutputIdx, link.OutputSlot);
+                            NodeGraphUpdateEvaluationOrderDelLink(controler, link);
                             links.erase(links.begin() + linkIndex);
-                            NodeGraphUpdateEvaluationOrder(controler);
                             break;
                         }
                     }
@@ -1018,7 +1182,7 @@ bool HandleConnections(ImDrawList* drawList,
 
                         links.push_back(nl);
                         controler->AddLink(nl.InputIdx, nl.InputSlot, nl.OutputIdx, nl.OutputSlot);
-                        NodeGraphUpdateEvaluationOrder(controler);
+                        NodeGraphUpdateEvaluationOrderAddLink(controler, nl);
                     }
                 }
             }
@@ -1042,8 +1206,8 @@ bool HandleConnections(ImDrawList* drawList,
                         {
                             URDel<NodeLink> undoRedoDel(linkIndex, []() { return &links; }, deleteLink, addLink);
                             controler->DelLink(link.OutputIdx, link.OutputSlot);
+                            NodeGraphUpdateEvaluationOrderDelLink(controler, link);
                             links.erase(links.begin() + linkIndex);
-                            NodeGraphUpdateEvaluationOrder(controler);
                             break;
                         }
                     }
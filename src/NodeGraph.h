@@ -184,6 +184,7 @@ void NodeGraphAddRug(
     int32_t posX, int32_t posY, int32_t sizeX, int32_t sizeY, uint32_t color, const std::string comment);
 void NodeGraphAddLink(NodeGraphControlerBase* delegate, int InputIdx, int InputSlot, int OutputIdx, int OutputSlot);
 void NodeGraphUpdateEvaluationOrder(NodeGraphControlerBase* delegate);
+void NodeGraphBenchmarkEvaluationOrder();
 void NodeGraphUpdateScrolling();
 void NodeGraphSelectNode(int selectedNodeIndex);
 void NodeGraphLayout();
@@ -36,6 +36,9 @@ NodeGraphControler::NodeGraphControler()
     : mbMouseDragging(false), mEditingContext(mEvaluationStages, false, 1024, 1024), mUndoRedoParamSetMouse(nullptr)
 {
     mCategories = &MetaNode::mCategories;
+    mEditingContext.EnableResultCache(true);
+    mEditingContext.mProfiler.Enable(true);
+    mEditingContext.EnableProgressivePreview(true);
 }
 
 void NodeGraphControler::Clear()
@@ -324,6 +327,11 @@ void NodeGraphControler::UpdateDirtyParameter(int index)
     auto& stage = mEvaluationStages.mStages[index];
     mEvaluationStages.SetEvaluationParameters(index, stage.mParameters);
     mEditingContext.SetTargetDirty(index, Dirty::Parameter);
+    // value dragged with the mouse: preview at low resolution until it settles
+    if (ImGui::IsMouseDown(0))
+    {
+        mEditingContext.NotifyInteraction();
+    }
 }
 
 void NodeGraphControler::PinnedEdit()
@@ -0,0 +1,414 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "PixelOps.h"
+#include "ImageKernels.h"
+#include "Utils.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace PixelOps
+{
+    static const size_t RowChunk = 1024;
+
+    enum CPUFeature
+    {
+        FeatureSSSE3 = 1 << 0,
+        FeatureAVX2 = 1 << 1,
+        FeatureF16C = 1 << 2,
+    };
+
+    static int GetCPUFeatures()
+    {
+        static int features = -1;
+        if (features != -1)
+            return features;
+        int result = 0;
+#if USE_SSE2
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = osxsave && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        if (info[2] & (1 << 9))
+            result |= FeatureSSSE3;
+        if (avx && (info[2] & (1 << 29)))
+            result |= FeatureF16C;
+        __cpuidex(info, 7, 0);
+        if (avx && (info[1] & (1 << 5)))
+            result |= FeatureAVX2;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+            result |= FeatureSSSE3;
+        if (__builtin_cpu_supports("avx2"))
+            result |= FeatureAVX2;
+        // no f16c test in __builtin_cpu_supports, cpuid leaf 1 ecx bit 29
+        unsigned int eax, ebx, ecx, edx;
+        __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+        if (__builtin_cpu_supports("avx") && (ecx & (1 << 29)))
+            result |= FeatureF16C;
+#endif
+#endif
+        features = result;
+        return features;
+    }
+
+    bool HasSSSE3()
+    {
+        return (GetCPUFeatures() & FeatureSSSE3) != 0;
+    }
+
+    bool HasAVX2()
+    {
+        return (GetCPUFeatures() & FeatureAVX2) != 0;
+    }
+
+    bool HasF16C()
+    {
+        return (GetCPUFeatures() & FeatureF16C) != 0;
+    }
+
+    void FlipRows(unsigned char* bits, size_t stride, int height)
+    {
+        std::vector<unsigned char> row(stride);
+        unsigned char* top = bits;
+        unsigned char* bottom = bits + (height - 1) * stride;
+        for (int y = 0; y < height / 2; y++, top += stride, bottom -= stride)
+        {
+            memcpy(row.data(), top, stride);
+            memcpy(top, bottom, stride);
+            memcpy(bottom, row.data(), stride);
+        }
+    }
+
+    void CopyFlipRows(const unsigned char* source, unsigned char* destination, size_t stride, int height)
+    {
+        source += (height - 1) * stride;
+        for (int y = 0; y < height; y++, source -= stride, destination += stride)
+        {
+            memcpy(destination, source, stride);
+        }
+    }
+
+    void VFlip(Image* image)
+    {
+        if (!image || !image->GetBits() || image->mFormat >= TextureFormat::Count)
+            return;
+        const size_t texelSize = textureFormatSize[image->mFormat];
+        const int numFaces = std::max(int(image->mNumFaces), 1);
+        const int numMips = std::max(int(image->mNumMips), 1);
+        unsigned char* bits = image->GetWritableBits();
+        unsigned char* end = bits + image->mDataSize;
+        for (int face = 0; face < numFaces; face++)
+        {
+            for (int mip = 0; mip < numMips; mip++)
+            {
+                const int width = std::max(image->mWidth >> mip, 1);
+                const int height = std::max(image->mHeight >> mip, 1);
+                const size_t stride = width * texelSize;
+                if (bits + stride * height > end)
+                    return;
+                FlipRows(bits, stride, height);
+                bits += stride * height;
+            }
+        }
+    }
+
+#if USE_SSE2
+    // from the last texel so source and destination can be the same buffer. 16 bytes loads read 4 bytes past
+    // the 4 texels of a block, the last texels are done by the scalar loop.
+    TARGET_SSSE3 static void ExpandRGBToRGBASSSE3(const unsigned char* source,
+                                                  unsigned char* destination,
+                                                  size_t blockCount,
+                                                  bool swapRedBlue)
+    {
+        const __m128i shuffle = swapRedBlue
+                                    ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+                                    : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+        for (size_t block = blockCount; block--;)
+        {
+            __m128i texels = _mm_loadu_si128((const __m128i*)(source + block * 12));
+            texels = _mm_or_si128(_mm_shuffle_epi8(texels, shuffle), alpha);
+            _mm_storeu_si128((__m128i*)(destination + block * 16), texels);
+        }
+    }
+#endif
+
+    void ExpandRGBToRGBA(const unsigned char* source, unsigned char* destination, size_t count, bool swapRedBlue)
+    {
+        const int red = swapRedBlue ? 2 : 0;
+        size_t blockTexels = 0;
+#if USE_SSE2
+        static const bool ssse3 = HasSSSE3();
+        if (ssse3 && count >= 6)
+            blockTexels = ((count - 6) / 4 + 1) * 4;
+#endif
+        // from the end, before the blocks
+        for (size_t i = count; i-- > blockTexels;)
+        {
+            const unsigned char* rgb = source + i * 3;
+            unsigned char* rgba = destination + i * 4;
+            const unsigned char r = rgb[red], g = rgb[1], b = rgb[2 - red];
+            rgba[0] = r;
+            rgba[1] = g;
+            rgba[2] = b;
+            rgba[3] = 255;
+        }
+#if USE_SSE2
+        if (blockTexels)
+            ExpandRGBToRGBASSSE3(source, destination, blockTexels / 4, swapRedBlue);
+#endif
+    }
+
+    void ExpandRGBToRGBA(Image* image)
+    {
+        if (!image || !image->GetBits() || (image->mFormat != TextureFormat::RGB8 && image->mFormat != TextureFormat::BGR8))
+            return;
+        const size_t count = image->mDataSize / 3;
+        const bool bgr = image->mFormat == TextureFormat::BGR8;
+        image->Reallocate(count * 4);
+        unsigned char* bits = image->GetWritableBits();
+        ExpandRGBToRGBA(bits, bits, count, bgr);
+        image->mFormat = TextureFormat::RGBA8;
+    }
+
+    void SwapRedBlue(unsigned char* bits, size_t count, int texelSize)
+    {
+        size_t i = 0;
+        if (texelSize == 4)
+        {
+#if USE_SSE2
+            const __m128i redBlue = _mm_set1_epi32(0x00FF00FF);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i texels = _mm_loadu_si128((const __m128i*)(bits + i * 4));
+                __m128i rb = _mm_and_si128(texels, redBlue);
+                __m128i ga = _mm_andnot_si128(redBlue, texels);
+                rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+                _mm_storeu_si128((__m128i*)(bits + i * 4), _mm_or_si128(rb, ga));
+            }
+#endif
+        }
+        for (; i < count; i++)
+        {
+            Swap(bits[i * texelSize], bits[i * texelSize + 2]);
+        }
+    }
+
+    float HalfToFloat(uint16_t half)
+    {
+        const uint32_t sign = uint32_t(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F)
+        {
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        }
+        else if (exponent)
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa)
+        {
+            // denormal
+            exponent = 113;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        else
+        {
+            bits = sign;
+        }
+        float value;
+        memcpy(&value, &bits, sizeof(float));
+        return value;
+    }
+
+    uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(float));
+        const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+        const int exponent = int((bits >> 23) & 0xFF) - 112;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent >= 0x1F)
+        {
+            // overflow to infinity, keep NaN
+            return sign | 0x7C00 | ((((bits >> 23) & 0xFF) == 0xFF && mantissa) ? 0x200 : 0);
+        }
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return sign;
+            mantissa |= 0x800000;
+            const int shift = 14 - exponent;
+            return sign | uint16_t((mantissa + (1 << (shift - 1))) >> shift);
+        }
+        // round to nearest, a carry goes to the exponent
+        return sign | uint16_t(((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+    }
+
+#if USE_SSE2
+    TARGET_F16C static size_t HalfToFloatF16C(const uint16_t* source, float* destination, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(destination + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(source + i))));
+        }
+        return i;
+    }
+
+    TARGET_F16C static size_t FloatToHalfF16C(const float* source, uint16_t* destination, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm_storeu_si128((__m128i*)(destination + i),
+                             _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        return i;
+    }
+#endif
+
+    void HalfToFloat(const uint16_t* source, float* destination, size_t count)
+    {
+        size_t i = 0;
+#if USE_SSE2
+        static const bool f16c = HasF16C();
+        if (f16c)
+            i = HalfToFloatF16C(source, destination, count);
+#endif
+        for (; i < count; i++)
+        {
+            destination[i] = HalfToFloat(source[i]);
+        }
+    }
+
+    void FloatToHalf(const float* source, uint16_t* destination, size_t count)
+    {
+        size_t i = 0;
+#if USE_SSE2
+        static const bool f16c = HasF16C();
+        if (f16c)
+            i = FloatToHalfF16C(source, destination, count);
+#endif
+        for (; i < count; i++)
+        {
+            destination[i] = FloatToHalf(source[i]);
+        }
+    }
+
+    static bool IsRGB8(int format)
+    {
+        return format == TextureFormat::RGB8 || format == TextureFormat::BGR8;
+    }
+
+    static bool IsRGBA8(int format)
+    {
+        return format == TextureFormat::RGBA8 || format == TextureFormat::BGRA8;
+    }
+
+    static bool IsBlueFirst(int format)
+    {
+        return format == TextureFormat::BGR8 || format == TextureFormat::BGRA8;
+    }
+
+    void Convert(const unsigned char* source, int sourceFormat, unsigned char* destination, int format, size_t count)
+    {
+        const bool swapRedBlue = IsBlueFirst(sourceFormat) != IsBlueFirst(format);
+        if (sourceFormat == format)
+        {
+            memcpy(destination, source, count * textureFormatSize[format]);
+        }
+        else if (IsRGB8(sourceFormat) && IsRGBA8(format))
+        {
+            ExpandRGBToRGBA(source, destination, count, swapRedBlue);
+        }
+        else if ((IsRGB8(sourceFormat) && IsRGB8(format)) || (IsRGBA8(sourceFormat) && IsRGBA8(format)))
+        {
+            const int texelSize = textureFormatSize[format];
+            memcpy(destination, source, count * texelSize);
+            SwapRedBlue(destination, count, texelSize);
+        }
+        else if (sourceFormat == TextureFormat::RGBA16F && format == TextureFormat::RGBA32F)
+        {
+            HalfToFloat((const uint16_t*)source, (float*)destination, count * 4);
+        }
+        else if (sourceFormat == TextureFormat::RGBA32F && format == TextureFormat::RGBA16F)
+        {
+            FloatToHalf((const float*)source, (uint16_t*)destination, count * 4);
+        }
+        else
+        {
+            const size_t sourceTexelSize = textureFormatSize[sourceFormat];
+            const size_t destinationTexelSize = textureFormatSize[format];
+            std::vector<float> rgba(RowChunk * 4);
+            for (size_t first = 0; first < count; first += RowChunk)
+            {
+                const int chunk = int(std::min(count - first, RowChunk));
+                ImageKernels::LoadRow(source + first * sourceTexelSize, sourceFormat, chunk, rgba.data());
+                ImageKernels::StoreRow(rgba.data(), format, chunk, destination + first * destinationTexelSize);
+            }
+        }
+    }
+
+    int Convert(Image* image, int format)
+    {
+        if (!image || !image->GetBits() || image->mFormat >= TextureFormat::Count || format < 0 ||
+            format >= TextureFormat::Count)
+        {
+            return EVAL_ERR;
+        }
+        if (image->mFormat == format)
+            return EVAL_OK;
+        if (IsRGB8(image->mFormat) && format == TextureFormat::RGBA8)
+        {
+            ExpandRGBToRGBA(image);
+            return EVAL_OK;
+        }
+        const size_t count = image->mDataSize / textureFormatSize[image->mFormat];
+        if ((IsRGB8(image->mFormat) && IsRGB8(format)) || (IsRGBA8(image->mFormat) && IsRGBA8(format)))
+        {
+            SwapRedBlue(image->GetWritableBits(), count, textureFormatSize[format]);
+            image->mFormat = uint8_t(format);
+            return EVAL_OK;
+        }
+        Image converted;
+        converted.Allocate(count * textureFormatSize[format]);
+        Convert(image->GetBits(), image->mFormat, converted.GetWritableBits(), format, count);
+        image->ShareBits(converted);
+        image->mFormat = uint8_t(format);
+        return EVAL_OK;
+    }
+} // namespace PixelOps
@@ -0,0 +1,78 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#define TARGET_F16C
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_F16C __attribute__((target("avx,f16c")))
+#endif
+#endif
+
+struct Image;
+
+// Pixel format conversions and flips on image buffers.
+// SSE2 by default, SSSE3/AVX2/F16C paths are picked at runtime.
+namespace PixelOps
+{
+    bool HasSSSE3();
+    bool HasAVX2();
+    bool HasF16C();
+
+    // rows swapped with memcpy, for every face and mip
+    void VFlip(Image* image);
+    void FlipRows(unsigned char* bits, size_t stride, int height);
+    // destination rows in reverse order
+    void CopyFlipRows(const unsigned char* source, unsigned char* destination, size_t stride, int height);
+
+    // RGB8/BGR8 to RGBA8 with 255 alpha. swapRedBlue for BGR8. source and destination can be the same buffer
+    void ExpandRGBToRGBA(const unsigned char* source, unsigned char* destination, size_t count, bool swapRedBlue);
+    // RGB8 image to RGBA8, the buffer is reallocated
+    void ExpandRGBToRGBA(Image* image);
+    // RGBA8 <-> BGRA8 (texelSize 4), RGB8 <-> BGR8 (texelSize 3)
+    void SwapRedBlue(unsigned char* bits, size_t count, int texelSize);
+
+    float HalfToFloat(uint16_t half);
+    uint16_t FloatToHalf(float value);
+    // F16C rows
+    void HalfToFloat(const uint16_t* source, float* destination, size_t count);
+    void FloatToHalf(const float* source, uint16_t* destination, size_t count);
+
+    // count texels between any TextureFormat values
+    void Convert(const unsigned char* source, int sourceFormat, unsigned char* destination, int format, size_t count);
+    // in place, keeps faces and mips
+    int Convert(Image* image, int format);
+}
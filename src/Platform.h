@@ -87,6 +87,25 @@ typedef enki::ITaskSet TaskSet;
 typedef enki::TaskSetPartition TaskSetPartition;
 typedef enki::TaskScheduler TaskScheduler;
 
+#elif __linux__
+
+#include <SDL.h>
+#include <GL/gl3w.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include "libtcc/libtcc.h"
+#include "TaskScheduler.h"
+#include "nfd.h"
+
+#define USE_LIBTCC 1
+// USE_NATIVE_C is set by the IMOGEN_NATIVE_C cmake option
+
+typedef enki::IPinnedTask PinnedTask;
+typedef enki::ITaskSet TaskSet;
+typedef enki::TaskSetPartition TaskSetPartition;
+typedef enki::TaskScheduler TaskScheduler;
+
 #else
     
 #error unknown platform
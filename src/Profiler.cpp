@@ -0,0 +1,217 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "Profiler.h"
+#include "Library.h"
+#include "Utils.h"
+#include <stdio.h>
+#include <algorithm>
+
+static const size_t MaxEvents = 8192;
+
+#ifndef EMSCRIPTEN
+#define USE_GPU_TIMER 1
+#endif
+
+void Profiler::Enable(bool enable)
+{
+    if (enable && !mStartTime)
+    {
+        mStartTime = SDL_GetPerformanceCounter();
+    }
+    mbEnabled = enable;
+}
+
+void Profiler::Clear()
+{
+    mNodeTimings.clear();
+    mEvents.clear();
+    mEventHead = 0;
+}
+
+void Profiler::Finish()
+{
+#if USE_GPU_TIMER
+    for (auto& queries : mQueries)
+    {
+        if (!queries.empty())
+            glDeleteQueries(GLsizei(queries.size()), queries.data());
+        queries.clear();
+    }
+#endif
+    mPendingQueries[0].clear();
+    mPendingQueries[1].clear();
+}
+
+uint64_t Profiler::GetTime() const
+{
+    return mbEnabled ? SDL_GetPerformanceCounter() : 0;
+}
+
+double Profiler::ToMs(uint64_t time) const
+{
+    return double(time - mStartTime) * 1000.0 / double(SDL_GetPerformanceFrequency());
+}
+
+void Profiler::AddEvent(const Event& event)
+{
+    if (event.mNodeIndex >= int(mNodeTimings.size()))
+    {
+        mNodeTimings.resize(event.mNodeIndex + 1, {-1, 0.f, 0.f, 0.f, 0.f, false, false});
+    }
+    NodeTiming& timing = mNodeTimings[event.mNodeIndex];
+    const float duration = float(event.mDuration);
+    if (timing.mNodeType != event.mNodeType)
+    {
+        // index reused by another node
+        timing = {event.mNodeType, 0.f, 0.f, 0.f, 0.f, false, false};
+    }
+    if (event.mbGPU)
+    {
+        timing.mGPU = duration;
+        timing.mGPUAverage = timing.mbHasGPU ? timing.mGPUAverage + (duration - timing.mGPUAverage) * 0.1f : duration;
+        timing.mbHasGPU = true;
+    }
+    else
+    {
+        timing.mCPU = duration;
+        timing.mCPUAverage = timing.mbHasCPU ? timing.mCPUAverage + (duration - timing.mCPUAverage) * 0.1f : duration;
+        timing.mbHasCPU = true;
+    }
+
+    if (mEvents.size() < MaxEvents)
+    {
+        mEvents.push_back(event);
+    }
+    else
+    {
+        mEvents[mEventHead] = event;
+        mEventHead = (mEventHead + 1) % MaxEvents;
+    }
+}
+
+void Profiler::Resolve(int buffer)
+{
+#if USE_GPU_TIMER
+    auto& queries = mQueries[buffer];
+    auto& pendingQueries = mPendingQueries[buffer];
+    // queries not available yet stay pending, moved in front of the free ones
+    size_t pendingCount = 0;
+    for (size_t i = 0; i < pendingQueries.size(); i++)
+    {
+        unsigned int query = queries[i];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            std::swap(queries[pendingCount], queries[i]);
+            pendingQueries[pendingCount++] = pendingQueries[i];
+            continue;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        const PendingQuery& pending = pendingQueries[i];
+        AddEvent({pending.mNodeIndex, pending.mNodeType, true, pending.mStart, double(elapsed) / 1000000.0});
+    }
+    pendingQueries.resize(pendingCount);
+#endif
+}
+
+void Profiler::BeginEvaluation()
+{
+    mEvaluationIndex++;
+    Resolve(int(mEvaluationIndex & 1));
+}
+
+void Profiler::BeginGPU(size_t nodeIndex, int nodeType)
+{
+#if USE_GPU_TIMER
+    if (!mbEnabled || mbQueryActive)
+        return;
+    const int buffer = int(mEvaluationIndex & 1);
+    auto& queries = mQueries[buffer];
+    auto& pendingQueries = mPendingQueries[buffer];
+    if (pendingQueries.size() == queries.size())
+    {
+        unsigned int query;
+        glGenQueries(1, &query);
+        queries.push_back(query);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[pendingQueries.size()]);
+    pendingQueries.push_back({int(nodeIndex), nodeType, ToMs(SDL_GetPerformanceCounter())});
+    mbQueryActive = true;
+#endif
+}
+
+void Profiler::EndGPU()
+{
+#if USE_GPU_TIMER
+    if (!mbQueryActive)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    mbQueryActive = false;
+#endif
+}
+
+void Profiler::AddCPU(size_t nodeIndex, int nodeType, uint64_t start)
+{
+    if (!mbEnabled || !start)
+        return;
+    const double startMs = ToMs(start);
+    AddEvent({int(nodeIndex), nodeType, false, startMs, ToMs(SDL_GetPerformanceCounter()) - startMs});
+}
+
+bool Profiler::ExportChromeTrace(const std::string& filename) const
+{
+    FILE* fp = fopen(filename.c_str(), "wt");
+    if (!fp)
+    {
+        Log("Unable to write trace %s\n", filename.c_str());
+        return false;
+    }
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}");
+    // oldest first
+    for (size_t i = 0; i < mEvents.size(); i++)
+    {
+        const Event& event = mEvents[(mEventHead + i) % mEvents.size()];
+        const bool validType = event.mNodeType >= 0 && event.mNodeType < int(gMetaNodes.size());
+        const char* nodeName = validType ? gMetaNodes[event.mNodeType].mName.c_str() : "";
+        fprintf(fp,
+                ",\n{\"name\":\"%s %d\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}",
+                nodeName,
+                event.mNodeIndex,
+                event.mbGPU ? "GPU" : "CPU",
+                event.mStart * 1000.0,
+                event.mDuration * 1000.0,
+                event.mbGPU ? 1 : 0);
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    Log("Trace saved at %s\n", filename.c_str());
+    return true;
+}
@@ -0,0 +1,106 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// Per node CPU and GPU timings of an evaluation context.
+// GPU timings use GL_TIME_ELAPSED queries, double buffered: results of an evaluation are read 2 evaluations later
+// so reading them never stalls. Results still not available are read on the following turns.
+struct Profiler
+{
+    Profiler() : mbEnabled(false), mbQueryActive(false), mEvaluationIndex(0), mStartTime(0), mEventHead(0)
+    {
+    }
+
+    struct Event
+    {
+        int mNodeIndex;
+        int mNodeType;
+        bool mbGPU;
+        double mStart;    // ms since profiler start
+        double mDuration; // ms
+    };
+    struct NodeTiming
+    {
+        int mNodeType;
+        float mCPU; // last evaluation, ms
+        float mGPU;
+        float mCPUAverage;
+        float mGPUAverage;
+        // averages start from the first measure
+        bool mbHasCPU;
+        bool mbHasGPU;
+    };
+
+    void Enable(bool enable);
+    bool IsEnabled() const
+    {
+        return mbEnabled;
+    }
+    void Clear();
+    void Finish();
+
+    // called before running a node list
+    void BeginEvaluation();
+    void BeginGPU(size_t nodeIndex, int nodeType);
+    void EndGPU();
+    // start time from GetTime()
+    void AddCPU(size_t nodeIndex, int nodeType, uint64_t start);
+    uint64_t GetTime() const;
+
+    const std::vector<NodeTiming>& GetNodeTimings() const
+    {
+        return mNodeTimings;
+    }
+    const std::vector<Event>& GetEvents() const
+    {
+        return mEvents;
+    }
+    bool ExportChromeTrace(const std::string& filename) const;
+
+protected:
+    struct PendingQuery
+    {
+        int mNodeIndex;
+        int mNodeType;
+        double mStart;
+    };
+    void Resolve(int buffer);
+    void AddEvent(const Event& event);
+    double ToMs(uint64_t time) const;
+
+    bool mbEnabled;
+    bool mbQueryActive;
+    uint64_t mEvaluationIndex;
+    uint64_t mStartTime;
+    std::vector<unsigned int> mQueries[2];
+    std::vector<PendingQuery> mPendingQueries[2];
+    std::vector<NodeTiming> mNodeTimings;
+    std::vector<Event> mEvents; // ring buffer, last events
+    size_t mEventHead;
+};
@@ -0,0 +1,116 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "ResultCache.h"
+#include "Bitmap.h"
+
+ResultCache gResultCache;
+
+static size_t GetTargetSize(const RenderTarget& target)
+{
+    const Image* image = target.mImage.get();
+    if (!image || image->mFormat >= TextureFormat::Count)
+        return 0;
+    size_t size = 0;
+    for (int i = 0; i < image->mNumMips; i++)
+        size += image->mNumFaces * (image->mWidth >> i) * (image->mHeight >> i) * textureFormatSize[image->mFormat];
+    return size;
+}
+
+std::shared_ptr<RenderTarget> ResultCache::Get(uint64_t hash)
+{
+    auto iter = mEntries.find(hash);
+    if (iter == mEntries.end())
+    {
+        mMissCount++;
+        return nullptr;
+    }
+    mHitCount++;
+    mLRU.splice(mLRU.begin(), mLRU, iter->second.mLRU);
+    return iter->second.mTarget;
+}
+
+void ResultCache::Add(uint64_t hash, std::shared_ptr<RenderTarget> target)
+{
+    if (!target || !target->mGLTexID)
+        return;
+    auto iter = mEntries.find(hash);
+    if (iter != mEntries.end())
+    {
+        if (iter->second.mTarget == target)
+            return;
+        Remove(iter);
+    }
+    size_t size = GetTargetSize(*target);
+    if (size > mBudget)
+        return;
+    Evict(mBudget - size);
+    mLRU.push_front(hash);
+    mEntries[hash] = {target, size, mLRU.begin()};
+    mTargets.insert(target.get());
+    mUsage += size;
+}
+
+void ResultCache::Detach(std::shared_ptr<RenderTarget>& target) const
+{
+    if (target && Contains(target.get()))
+    {
+        target = std::make_shared<RenderTarget>();
+    }
+}
+
+void ResultCache::SetBudget(size_t budget)
+{
+    mBudget = budget;
+    Evict(mBudget);
+}
+
+void ResultCache::Clear()
+{
+    Evict(0);
+}
+
+void ResultCache::Remove(std::map<uint64_t, Entry>::iterator iter)
+{
+    auto& target = iter->second.mTarget;
+    mTargets.erase(target.get());
+    // still used by a stage : the stage owns it now
+    if (target.use_count() == 1)
+        target->Destroy();
+    mUsage -= iter->second.mSize;
+    mLRU.erase(iter->second.mLRU);
+    mEntries.erase(iter);
+}
+
+void ResultCache::Evict(size_t budget)
+{
+    while (mUsage > budget && !mLRU.empty())
+    {
+        Remove(mEntries.find(mLRU.back()));
+    }
+    if (mEntries.empty())
+        mUsage = 0;
+}
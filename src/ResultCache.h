@@ -0,0 +1,96 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <map>
+#include <set>
+#include <list>
+#include <memory>
+#include <stdint.h>
+
+class RenderTarget;
+
+// Content addressed cache of node results.
+// Key is the stage hash computed by the evaluation context (type, parameters, samplers, inputs hashes, time)
+// Targets are shared with the stages that produced them. GL resources are released once evicted and unused.
+struct ResultCache
+{
+    ResultCache() : mBudget(256 * 1024 * 1024), mUsage(0), mHitCount(0), mMissCount(0)
+    {
+    }
+
+    std::shared_ptr<RenderTarget> Get(uint64_t hash);
+    void Add(uint64_t hash, std::shared_ptr<RenderTarget> target);
+    bool Contains(const RenderTarget* target) const
+    {
+        return mTargets.find(target) != mTargets.end();
+    }
+    // replaces a cached target with a new one, before a stage renders in place in it
+    void Detach(std::shared_ptr<RenderTarget>& target) const;
+    void Clear();
+
+    void SetBudget(size_t budget);
+    size_t GetBudget() const
+    {
+        return mBudget;
+    }
+    size_t GetUsage() const
+    {
+        return mUsage;
+    }
+    size_t GetEntryCount() const
+    {
+        return mEntries.size();
+    }
+    uint64_t GetHitCount() const
+    {
+        return mHitCount;
+    }
+    uint64_t GetMissCount() const
+    {
+        return mMissCount;
+    }
+
+protected:
+    struct Entry
+    {
+        std::shared_ptr<RenderTarget> mTarget;
+        size_t mSize;
+        std::list<uint64_t>::iterator mLRU;
+    };
+    void Evict(size_t budget);
+    void Remove(std::map<uint64_t, Entry>::iterator iter);
+
+    std::map<uint64_t, Entry> mEntries;
+    // hashes, most recently used first
+    std::list<uint64_t> mLRU;
+    std::set<const RenderTarget*> mTargets;
+    size_t mBudget;
+    size_t mUsage;
+    uint64_t mHitCount;
+    uint64_t mMissCount;
+};
+
+extern ResultCache gResultCache;
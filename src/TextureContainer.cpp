@@ -0,0 +1,489 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "TextureContainer.h"
+#include "Bitmap.h"
+#include "ImageKernels.h"
+#include "Utils.h"
+#include <string.h>
+#include <algorithm>
+#if !defined(WIN32) && !defined(EMSCRIPTEN)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace TextureContainer
+{
+    static const uint32_t Magic = 0x58544D49; // IMTX
+    static const uint16_t Version = 1;
+    static const size_t Alignment = 16;
+
+    static_assert(sizeof(Header) == 32, "container header is written as is");
+    static_assert(sizeof(Level) == 16, "container levels are written as is");
+
+    static size_t Align(size_t offset)
+    {
+        return (offset + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    static size_t GetLevelSize(int width, int height, int format, int mip)
+    {
+        return size_t(width >> mip) * size_t(height >> mip) * textureFormatSize[format];
+    }
+
+    // LZ4 block format: sequences of a token (literal count, match length - 4), literals,
+    // 2 bytes match offset. The last 5 bytes are literals and the last match starts 12 bytes before the end.
+    static const size_t MinMatch = 4;
+    static const size_t LastLiterals = 5;
+    static const size_t MatchLimit = 12;
+    static const int HashBits = 16;
+
+    static size_t GetCompressBound(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    static inline uint32_t Read32(const uint8_t* ptr)
+    {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(uint32_t));
+        return value;
+    }
+
+    static inline uint32_t Hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761U) >> (32 - HashBits);
+    }
+
+    static uint8_t* WriteLength(uint8_t* op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+            *op++ = 255;
+        *op++ = uint8_t(length);
+        return op;
+    }
+
+    static uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+    {
+        uint8_t* token = op++;
+        *token = uint8_t(std::min(literalCount, size_t(15)) << 4);
+        if (literalCount >= 15)
+            op = WriteLength(op, literalCount - 15);
+        memcpy(op, literals, literalCount);
+        op += literalCount;
+        if (!matchLength)
+            return op;
+        *op++ = uint8_t(offset);
+        *op++ = uint8_t(offset >> 8);
+        matchLength -= MinMatch;
+        *token |= uint8_t(std::min(matchLength, size_t(15)));
+        if (matchLength >= 15)
+            op = WriteLength(op, matchLength - 15);
+        return op;
+    }
+
+    // greedy, single probe. destination holds GetCompressBound(size) bytes
+    static size_t CompressLZ4(const uint8_t* source, size_t size, uint8_t* destination)
+    {
+        std::vector<uint32_t> table(size_t(1) << HashBits, 0);
+        uint8_t* op = destination;
+        size_t anchor = 0;
+        if (size > MatchLimit)
+        {
+            const size_t matchStartLimit = size - MatchLimit;
+            const size_t matchEndLimit = size - LastLiterals;
+            size_t ip = 0;
+            while (ip < matchStartLimit)
+            {
+                const uint32_t sequence = Read32(source + ip);
+                uint32_t& entry = table[Hash(sequence)];
+                const size_t candidate = entry;
+                entry = uint32_t(ip);
+                if (candidate >= ip || ip - candidate > 0xFFFF || Read32(source + candidate) != sequence)
+                {
+                    // skip faster through data that does not compress
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+                size_t length = MinMatch;
+                while (ip + length < matchEndLimit && source[candidate + length] == source[ip + length])
+                    length++;
+                op = WriteSequence(op, source + anchor, ip - anchor, ip - candidate, length);
+                ip += length;
+                anchor = ip;
+                if (ip - 2 < matchStartLimit)
+                    table[Hash(Read32(source + ip - 2))] = uint32_t(ip - 2);
+            }
+        }
+        op = WriteSequence(op, source + anchor, size - anchor, 0, 0);
+        return op - destination;
+    }
+
+    static bool ReadLength(const uint8_t*& ip, const uint8_t* end, size_t& length)
+    {
+        uint8_t value;
+        do
+        {
+            if (ip >= end)
+                return false;
+            value = *ip++;
+            length += value;
+        } while (value == 255);
+        return true;
+    }
+
+    // checks every length and offset against the buffers
+    static bool DecompressLZ4(const uint8_t* source, size_t size, uint8_t* destination, size_t destinationSize)
+    {
+        const uint8_t* ip = source;
+        const uint8_t* end = source + size;
+        uint8_t* op = destination;
+        uint8_t* outputEnd = destination + destinationSize;
+        while (ip < end)
+        {
+            const uint8_t token = *ip++;
+            size_t literalCount = token >> 4;
+            if (literalCount == 15 && !ReadLength(ip, end, literalCount))
+                return false;
+            if (literalCount > size_t(end - ip) || literalCount > size_t(outputEnd - op))
+                return false;
+            // short copies are fixed 16 bytes when both buffers have room
+            if (literalCount <= 16 && end - ip >= 16 && outputEnd - op >= 16)
+                memcpy(op, ip, 16);
+            else
+                memcpy(op, ip, literalCount);
+            op += literalCount;
+            ip += literalCount;
+            if (ip == end)
+                break;
+
+            if (end - ip < 2)
+                return false;
+            const size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(ip, end, matchLength))
+                return false;
+            matchLength += MinMatch;
+            if (!offset || offset > size_t(op - destination) || matchLength > size_t(outputEnd - op))
+                return false;
+            const uint8_t* match = op - offset;
+            if (offset >= 16 && matchLength <= 16 && outputEnd - op >= 16)
+            {
+                memcpy(op, match, 16);
+                op += matchLength;
+            }
+            else if (offset >= matchLength)
+            {
+                memcpy(op, match, matchLength);
+                op += matchLength;
+            }
+            else
+            {
+                // overlapping: the match repeats its first offset bytes. Copies are at most the distance
+                // and the distance stays a multiple of offset, doubled each copy
+                uint8_t* matchEnd = op + matchLength;
+                for (size_t distance = offset; op < matchEnd; distance *= 2)
+                {
+                    const size_t count = std::min(distance, size_t(matchEnd - op));
+                    memcpy(op, op - distance, count);
+                    op += count;
+                }
+            }
+        }
+        return op == outputEnd;
+    }
+
+    static void GenerateMipChain(const Image* image, Image& mipmapped)
+    {
+        int numMips = 1;
+        while ((image->mWidth >> numMips) && (image->mHeight >> numMips))
+            numMips++;
+        std::vector<unsigned char> bits(image->GetBits(), image->GetBits() + image->mDataSize);
+        Image level = *image;
+        for (int mip = 1; mip < numMips; mip++)
+        {
+            Image smaller;
+            if (ImageKernels::Resize(&level, &smaller, image->mWidth >> mip, image->mHeight >> mip, ImageKernels::Box) != EVAL_OK)
+                break;
+            bits.insert(bits.end(), smaller.GetBits(), smaller.GetBits() + smaller.mDataSize);
+            level = smaller;
+        }
+        mipmapped = *image;
+        mipmapped.SetBits(bits.data(), bits.size());
+        mipmapped.mNumMips = uint8_t(numMips);
+    }
+
+    int Encode(const Image* image, int flags, std::vector<uint8_t>& container)
+    {
+        if (!image || !image->GetBits() || image->mFormat >= TextureFormat::Count || image->mWidth <= 0 ||
+            image->mHeight <= 0)
+        {
+            return EVAL_ERR;
+        }
+        Image mipmapped;
+        if ((flags & GenerateMips) && image->mNumMips <= 1 && image->mNumFaces <= 1)
+        {
+            GenerateMipChain(image, mipmapped);
+            image = &mipmapped;
+        }
+        const int numMips = std::max(int(image->mNumMips), 1);
+        const int numFaces = std::max(int(image->mNumFaces), 1);
+        const uint32_t levelCount = uint32_t(numMips * numFaces);
+
+        size_t dataSize = 0;
+        size_t capacity = Align(sizeof(Header) + levelCount * sizeof(Level));
+        for (int face = 0; face < numFaces; face++)
+        {
+            for (int mip = 0; mip < numMips; mip++)
+            {
+                const size_t size = GetLevelSize(image->mWidth, image->mHeight, image->mFormat, mip);
+                dataSize += size;
+                capacity += ((flags & Compress) ? GetCompressBound(size) : size) + Alignment;
+            }
+        }
+        if (dataSize > image->mDataSize)
+        {
+            Log("Texture container: image bits are smaller than its faces and mips\n");
+            return EVAL_ERR;
+        }
+
+        Header header = {};
+        header.mMagic = Magic;
+        header.mVersion = Version;
+        header.mFormat = image->mFormat;
+        header.mNumMips = uint8_t(numMips);
+        header.mNumFaces = uint8_t(numFaces);
+        header.mWidth = uint32_t(image->mWidth);
+        header.mHeight = uint32_t(image->mHeight);
+        header.mLevelCount = levelCount;
+        header.mDataSize = dataSize;
+
+        std::vector<Level> levels(levelCount);
+        size_t offset = Align(sizeof(Header) + levelCount * sizeof(Level));
+        container.resize(capacity);
+
+        const uint8_t* source = image->GetBits();
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            const size_t size = GetLevelSize(image->mWidth, image->mHeight, image->mFormat, int(i % numMips));
+            size_t storedSize = size;
+            if (flags & Compress)
+            {
+                storedSize = CompressLZ4(source, size, container.data() + offset);
+                // raw when it does not compress
+                if (storedSize >= size)
+                    storedSize = size;
+            }
+            if (storedSize == size)
+                memcpy(container.data() + offset, source, size);
+            levels[i] = {offset, uint32_t(storedSize), uint32_t(size)};
+            offset = Align(offset + storedSize);
+            source += size;
+        }
+        container.resize(offset);
+        memcpy(container.data(), &header, sizeof(Header));
+        memcpy(container.data() + sizeof(Header), levels.data(), levelCount * sizeof(Level));
+        return EVAL_OK;
+    }
+
+    bool IsContainer(const uint8_t* data, size_t size)
+    {
+        return size >= sizeof(Header) && Read32(data) == Magic;
+    }
+
+    int Decode(const uint8_t* data, size_t size, Image* image)
+    {
+        if (!IsContainer(data, size))
+            return EVAL_ERR;
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        if (header.mVersion != Version || header.mFormat >= TextureFormat::Count || !header.mNumMips ||
+            !header.mNumFaces || header.mLevelCount != uint32_t(header.mNumMips) * header.mNumFaces ||
+            header.mWidth > 65536 || header.mHeight > 65536 || header.mNumMips > 17 ||
+            sizeof(Header) + size_t(header.mLevelCount) * sizeof(Level) > size)
+        {
+            Log("Texture container: unsupported or corrupted header\n");
+            return EVAL_ERR;
+        }
+        size_t dataSize = 0;
+        for (uint32_t i = 0; i < header.mLevelCount; i++)
+            dataSize += GetLevelSize(header.mWidth, header.mHeight, header.mFormat, int(i % header.mNumMips));
+        if (dataSize != header.mDataSize || dataSize > 0xFFFFFFFF)
+        {
+            Log("Texture container: corrupted header\n");
+            return EVAL_ERR;
+        }
+
+        std::vector<Level> levels(header.mLevelCount);
+        memcpy(levels.data(), data + sizeof(Header), header.mLevelCount * sizeof(Level));
+        Image decoded;
+        decoded.Allocate(size_t(header.mDataSize));
+        uint8_t* destination = decoded.GetWritableBits();
+        for (uint32_t i = 0; i < header.mLevelCount; i++)
+        {
+            const Level& level = levels[i];
+            const size_t levelSize = GetLevelSize(header.mWidth, header.mHeight, header.mFormat, int(i % header.mNumMips));
+            if (level.mSize != levelSize || level.mStoredSize > level.mSize || level.mOffset > size ||
+                level.mStoredSize > size - level.mOffset)
+            {
+                Log("Texture container: corrupted level %d\n", int(i));
+                return EVAL_ERR;
+            }
+            if (level.mStoredSize == level.mSize)
+            {
+                memcpy(destination, data + level.mOffset, level.mSize);
+            }
+            else if (!DecompressLZ4(data + level.mOffset, level.mStoredSize, destination, level.mSize))
+            {
+                Log("Texture container: corrupted level %d\n", int(i));
+                return EVAL_ERR;
+            }
+            destination += level.mSize;
+        }
+
+        decoded.mDecoder = NULL;
+        decoded.mWidth = int(header.mWidth);
+        decoded.mHeight = int(header.mHeight);
+        decoded.mNumMips = header.mNumMips;
+        decoded.mNumFaces = header.mNumFaces;
+        decoded.mFormat = header.mFormat;
+        *image = decoded;
+        return EVAL_OK;
+    }
+
+    // read only view of a whole file
+    struct MappedFile
+    {
+        MappedFile() : mData(NULL), mSize(0)
+        {
+        }
+        ~MappedFile()
+        {
+            Close();
+        }
+        bool Open(const char* filename)
+        {
+#if defined(WIN32)
+            mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (mFile == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(mFile, &fileSize) || !fileSize.QuadPart)
+                return false;
+            mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (!mMapping)
+                return false;
+            mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+            mSize = size_t(fileSize.QuadPart);
+            return mData != NULL;
+#elif defined(EMSCRIPTEN)
+            FILE* fp = fopen(filename, "rb");
+            if (!fp)
+                return false;
+            fseek(fp, 0, SEEK_END);
+            mBuffer.resize(ftell(fp));
+            fseek(fp, 0, SEEK_SET);
+            const bool read = fread(mBuffer.data(), 1, mBuffer.size(), fp) == mBuffer.size();
+            fclose(fp);
+            mData = mBuffer.data();
+            mSize = mBuffer.size();
+            return read && mSize;
+#else
+            const int file = open(filename, O_RDONLY);
+            if (file < 0)
+                return false;
+            struct stat status;
+            if (fstat(file, &status) != 0 || !status.st_size)
+            {
+                close(file);
+                return false;
+            }
+            void* data = mmap(NULL, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            // the mapping stays valid once the file is closed
+            close(file);
+            if (data == MAP_FAILED)
+                return false;
+            madvise(data, size_t(status.st_size), MADV_SEQUENTIAL);
+            mData = (const uint8_t*)data;
+            mSize = size_t(status.st_size);
+            return true;
+#endif
+        }
+        void Close()
+        {
+#if defined(WIN32)
+            if (mData)
+                UnmapViewOfFile(mData);
+            if (mMapping)
+                CloseHandle(mMapping);
+            if (mFile != INVALID_HANDLE_VALUE)
+                CloseHandle(mFile);
+            mMapping = NULL;
+            mFile = INVALID_HANDLE_VALUE;
+#elif defined(EMSCRIPTEN)
+            mBuffer.clear();
+#else
+            if (mData)
+                munmap((void*)mData, mSize);
+#endif
+            mData = NULL;
+            mSize = 0;
+        }
+
+        const uint8_t* mData;
+        size_t mSize;
+#if defined(WIN32)
+        HANDLE mFile = INVALID_HANDLE_VALUE;
+        HANDLE mMapping = NULL;
+#elif defined(EMSCRIPTEN)
+        std::vector<uint8_t> mBuffer;
+#endif
+    };
+
+    int Read(const char* filename, Image* image)
+    {
+        MappedFile file;
+        if (!file.Open(filename))
+            return EVAL_ERR;
+        return Decode(file.mData, file.mSize, image);
+    }
+
+    int Write(const char* filename, const Image* image, int flags)
+    {
+        std::vector<uint8_t> container;
+        if (Encode(image, flags, container) != EVAL_OK)
+            return EVAL_ERR;
+        FILE* fp = fopen(filename, "wb");
+        if (!fp)
+            return EVAL_ERR;
+        const bool written = fwrite(container.data(), 1, container.size(), fp) == container.size();
+        fclose(fp);
+        return written ? EVAL_OK : EVAL_ERR;
+    }
+} // namespace TextureContainer
@@ -0,0 +1,75 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct Image;
+
+// Imogen texture container (.imtx): a fixed header, a level table then the level pixels.
+// Levels are faces then mips, like Image bits. Each level is stored raw or LZ4 block compressed
+// and starts 16 bytes aligned, so a mapped file can be uploaded straight from the mapping.
+namespace TextureContainer
+{
+    enum Flags
+    {
+        Compress = 1 << 0,
+        // box filtered mips down to 1 pixel, for 2D images with a single mip
+        GenerateMips = 1 << 1,
+    };
+
+    struct Header
+    {
+        uint32_t mMagic;
+        uint16_t mVersion;
+        uint8_t mFormat;
+        uint8_t mNumMips;
+        uint8_t mNumFaces;
+        uint8_t mReserved[3];
+        uint32_t mWidth;
+        uint32_t mHeight;
+        uint32_t mLevelCount;
+        // decoded size, all levels
+        uint64_t mDataSize;
+    };
+
+    struct Level
+    {
+        uint64_t mOffset;
+        // mStoredSize == mSize for raw levels
+        uint32_t mStoredSize;
+        uint32_t mSize;
+    };
+
+    int Encode(const Image* image, int flags, std::vector<uint8_t>& container);
+    bool IsContainer(const uint8_t* data, size_t size);
+    int Decode(const uint8_t* data, size_t size, Image* image);
+
+    // the file is memory mapped and decoded in the image
+    int Read(const char* filename, Image* image);
+    int Write(const char* filename, const Image* image, int flags);
+}
@@ -0,0 +1,225 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include <algorithm>
+#include <math.h>
+#include "TiledEvaluation.h"
+#include "EvaluationContext.h"
+#include "EvaluationStages.h"
+#include "Evaluators.h"
+#include "Library.h"
+
+namespace TiledEvaluation
+{
+    // outputs bigger than this in any dimension are tiled
+    static const int TileThreshold = 4096;
+
+    static float GetParameterValue(const EvaluationStage& stage, const std::string& parameterName)
+    {
+        const uint32_t nodeType = uint32_t(stage.mType);
+        int parameterIndex = GetParameterIndex(nodeType, parameterName.c_str());
+        if (parameterIndex < 0)
+        {
+            return 1.f;
+        }
+        const unsigned char* ptr = stage.mParameters.data() + GetParameterOffset(nodeType, parameterIndex);
+        switch (GetParameterType(nodeType, parameterIndex))
+        {
+            case Con_Float:
+            case Con_Angle:
+                return *(const float*)ptr;
+            case Con_Int:
+            case Con_Enum:
+                return float(*(const int*)ptr);
+            default:
+                return 1.f;
+        }
+    }
+
+    // texels read around each output texel, negative when the node can't be tiled
+    static float GetFootprint(const EvaluationStage& stage, int imageSize)
+    {
+        bool hasInputs = false;
+        for (auto input : stage.mInput.mInputs)
+        {
+            hasInputs |= input != -1;
+        }
+        const int mask = stage.gEvaluationMask;
+        if (mask & (EvaluationC | EvaluationPython))
+        {
+            // only sources: they are evaluated at their own size then cropped to the tile
+            return (hasInputs || (mask & (EvaluationGLSL | EvaluationGLSLCompute))) ? -1.f : 0.f;
+        }
+        if ((mask & EvaluationGLSLCompute) || stage.mVertexSpace || stage.mbDepthBuffer || stage.mGScene)
+        {
+            return -1.f;
+        }
+        if (!hasInputs)
+        {
+            return 0.f;
+        }
+        const MetaNode& metaNode = gMetaNodes[stage.mType];
+        if (metaNode.mFootprint < 0.f)
+        {
+            return -1.f;
+        }
+        float footprint = metaNode.mFootprint;
+        if (!metaNode.mFootprintParameter.empty())
+        {
+            footprint += fabsf(GetParameterValue(stage, metaNode.mFootprintParameter)) * metaNode.mFootprintScale;
+        }
+        footprint = footprint * imageSize + metaNode.mFootprintPixels;
+        if (!metaNode.mFootprintPasses.empty())
+        {
+            footprint *= std::max(GetParameterValue(stage, metaNode.mFootprintPasses), 1.f);
+        }
+        return footprint;
+    }
+
+    // longest footprint path from the node to the sources
+    static float RecurseHalo(const EvaluationStages& evaluationStages,
+                             size_t nodeIndex,
+                             int imageSize,
+                             std::vector<float>& halos)
+    {
+        if (halos[nodeIndex] > -2.f)
+        {
+            return halos[nodeIndex];
+        }
+        const EvaluationStage& stage = evaluationStages.mStages[nodeIndex];
+        float halo = GetFootprint(stage, imageSize);
+        if (halo >= 0.f)
+        {
+            float inputHalo = 0.f;
+            for (auto input : stage.mInput.mInputs)
+            {
+                if (input == -1)
+                {
+                    continue;
+                }
+                float nodeHalo = RecurseHalo(evaluationStages, input, imageSize, halos);
+                if (nodeHalo < 0.f)
+                {
+                    inputHalo = -1.f;
+                    break;
+                }
+                inputHalo = std::max(inputHalo, nodeHalo);
+            }
+            halo = (inputHalo < 0.f) ? -1.f : halo + inputHalo;
+        }
+        halos[nodeIndex] = halo;
+        return halo;
+    }
+
+    int GetHalo(const EvaluationStages& evaluationStages, size_t target, int width, int height)
+    {
+        if (width <= TileThreshold && height <= TileThreshold)
+        {
+            return -1;
+        }
+        std::vector<float> halos(evaluationStages.mStages.size(), -2.f);
+        float halo = RecurseHalo(evaluationStages, target, std::max(width, height), halos);
+        if (halo < 0.f || halo > float(TileSize))
+        {
+            return -1;
+        }
+        return int(ceilf(halo));
+    }
+
+    int Evaluate(EvaluationContext* evaluationContext,
+                 size_t target,
+                 int width,
+                 int height,
+                 int halo,
+                 const BandCallback& bandCallback)
+    {
+        // every tile has the same size: render targets are allocated once
+        const int tileSize = TileSize + halo * 2;
+        EvaluationContext context(evaluationContext->mEvaluationStages, true, tileSize, tileSize);
+        context.EnableParallelJobs(true);
+        context.SetCurrentTime(evaluationContext->GetCurrentTime());
+
+        std::vector<unsigned char> band(size_t(width) * TileSize * 4);
+        int res = EVAL_OK;
+        for (int y = 0; y < height && res == EVAL_OK; y += TileSize)
+        {
+            const int bandHeight = std::min(TileSize, height - y);
+            for (int x = 0; x < width; x += TileSize)
+            {
+                const float window[4] = {float(x - halo) / float(width),
+                                         float(y - halo) / float(height),
+                                         float(tileSize) / float(width),
+                                         float(tileSize) / float(height)};
+                context.SetTileWindow(window);
+                context.DirtyAll();
+                while (context.RunBackward(target))
+                {
+                    // processing... maybe good on next run
+                }
+
+                auto renderTarget = context.GetRenderTarget(target);
+                if (context.HasUntileableSource() ||
+                    (renderTarget && (renderTarget->mImage->mNumFaces != 1 ||
+                                      (renderTarget->mImage->mFormat != TextureFormat::RGBA8 &&
+                                       renderTarget->mImage->mFormat != TextureFormat::RGB8))))
+                {
+                    // known from the first tile, bands are only sent once a tile row is done
+                    if (y == 0 && x == 0)
+                    {
+                        return NotTileable;
+                    }
+                    res = EVAL_ERR;
+                    break;
+                }
+                if (!renderTarget || !renderTarget->mFbo || renderTarget->mImage->mWidth != tileSize ||
+                    renderTarget->mImage->mHeight != tileSize)
+                {
+                    Log("Tiled evaluation: node %d result doesn't match the tile.\n", int(target));
+                    res = EVAL_ERR;
+                    break;
+                }
+                // read the tile without its halo, straight in the band
+                glBindFramebuffer(GL_FRAMEBUFFER, renderTarget->mFbo);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glPixelStorei(GL_PACK_ROW_LENGTH, width);
+                glReadPixels(halo,
+                             halo,
+                             std::min(TileSize, width - x),
+                             bandHeight,
+                             GL_RGBA,
+                             GL_UNSIGNED_BYTE,
+                             &band[size_t(x) * 4]);
+                glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+            if (res == EVAL_OK)
+            {
+                res = bandCallback(band.data(), y, bandHeight);
+            }
+        }
+        return res;
+    }
+} // namespace TiledEvaluation
@@ -0,0 +1,57 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stddef.h>
+#include <functional>
+
+struct EvaluationContext;
+struct EvaluationStages;
+
+// Out-of-core evaluation for outputs too big for one render target per node.
+// The output is cut in tiles evaluated independently in a tile sized context: render targets cover the tile
+// plus a halo wide enough for what nodes read around each texel (see MetaNode footprint).
+// Tiles are read back and passed to the caller row band by row band, RGBA8 rows of the image width.
+namespace TiledEvaluation
+{
+    // edge size of the evaluated part of a tile
+    static const int TileSize = 2048;
+
+    // returns the halo in texels or -1 when the output is small enough or the graph can't be tiled
+    int GetHalo(const EvaluationStages& evaluationStages, size_t target, int width, int height);
+
+    // returned by Evaluate, before any band, when results turn out to be cubemaps or not RGBA8.
+    // The output has to be evaluated in one piece
+    static const int NotTileable = -1;
+
+    typedef std::function<int(const unsigned char* rows, int firstRow, int rowCount)> BandCallback;
+
+    int Evaluate(EvaluationContext* evaluationContext,
+                 size_t target,
+                 int width,
+                 int height,
+                 int halo,
+                 const BandCallback& band);
+} // namespace TiledEvaluation
@@ -0,0 +1,178 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "UniformArena.h"
+#include <string.h>
+
+#ifndef EMSCRIPTEN
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void(APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+#endif
+
+void UniformArena::Init(size_t size)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mAlignment = alignment > 0 ? size_t(alignment) : 256;
+    mSize = size;
+    mHead = 0;
+    mCurrentRegion = 0;
+
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+#ifndef EMSCRIPTEN
+    BufferStorageProc bufferStorage =
+        gl3wIsSupported(4, 4) ? (BufferStorageProc)gl3wGetProcAddress("glBufferStorage") : NULL;
+    if (bufferStorage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_UNIFORM_BUFFER, mSize, NULL, flags);
+        mMapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, mSize, flags);
+        if (!mMapped)
+        {
+            // immutable storage can't be respecified
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glDeleteBuffers(1, &mBuffer);
+            glGenBuffers(1, &mBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+        }
+    }
+#endif
+    if (!mMapped)
+    {
+        glBufferData(GL_UNIFORM_BUFFER, mSize, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformArena::Finish()
+{
+    for (auto& fence : mFences)
+    {
+        if (fence)
+            glDeleteSync((GLsync)fence);
+        fence = NULL;
+    }
+    if (mMapped)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        mMapped = NULL;
+    }
+    glDeleteBuffers(1, &mBuffer);
+    mBuffer = 0;
+}
+
+void UniformArena::FenceRegion(int region)
+{
+    if (mFences[region])
+        glDeleteSync((GLsync)mFences[region]);
+    mFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformArena::WaitRegion(int region)
+{
+    GLsync fence = (GLsync)mFences[region];
+    if (!fence)
+        return;
+    GLbitfield waitFlags = 0;
+    while (true)
+    {
+        GLenum res = glClientWaitSync(fence, waitFlags, 1000000);
+        if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED || res == GL_WAIT_FAILED)
+            break;
+        waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    }
+    glDeleteSync(fence);
+    mFences[region] = NULL;
+}
+
+size_t UniformArena::Allocate(size_t size)
+{
+    const size_t alignedSize = (size + mAlignment - 1) / mAlignment * mAlignment;
+    if (mHead + alignedSize > mSize)
+    {
+        mHead = 0;
+        if (!mMapped)
+        {
+            // orphan: the driver gives new storage, previous one is released when the GPU is done with it
+            glBufferData(GL_UNIFORM_BUFFER, mSize, NULL, GL_STREAM_DRAW);
+        }
+    }
+    size_t offset = mHead;
+    mHead += alignedSize;
+
+    if (mMapped)
+    {
+        // entering a new region: fence the one that's done and make sure the GPU is not using the new one
+        const size_t regionSize = mSize / RegionCount;
+        const int lastRegion = int((mHead - 1) / regionSize);
+        for (int region = int(offset / regionSize); region <= lastRegion; region++)
+        {
+            if (region == mCurrentRegion)
+                continue;
+            FenceRegion(mCurrentRegion);
+            WaitRegion(region);
+            mCurrentRegion = region;
+        }
+    }
+    return offset;
+}
+
+void UniformArena::Bind(unsigned int bindingPoint, const void* data, size_t size)
+{
+    // empty blocks still need a valid range
+    const size_t rangeSize = size ? size : mAlignment;
+    glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+    size_t offset = Allocate(rangeSize);
+    if (size)
+    {
+        if (mMapped)
+        {
+            memcpy(mMapped + offset, data, size);
+        }
+        else
+        {
+            void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER,
+                                         offset,
+                                         size,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (ptr)
+            {
+                memcpy(ptr, data, size);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+        }
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, mBuffer, offset, rangeSize);
+}
@@ -0,0 +1,62 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stddef.h>
+
+// Ring buffer for uniform blocks.
+// Every Bind copies the block to a new slice and binds that range: no reallocation and no implicit sync per draw.
+// Uses persistent mapped storage (GL 4.4) with a fence per region to reclaim slices.
+// Falls back to orphaning the buffer on wrap and unsynchronized mapping.
+struct UniformArena
+{
+    UniformArena() : mBuffer(0), mMapped(NULL), mSize(0), mHead(0), mAlignment(256), mCurrentRegion(0)
+    {
+        for (auto& fence : mFences)
+            fence = NULL;
+    }
+
+    void Init(size_t size = 4 * 1024 * 1024);
+    void Finish();
+    // copy data to a new slice and bind it to the uniform block binding point
+    void Bind(unsigned int bindingPoint, const void* data, size_t size);
+
+protected:
+    enum
+    {
+        RegionCount = 4
+    };
+    size_t Allocate(size_t size);
+    void FenceRegion(int region);
+    void WaitRegion(int region);
+
+    unsigned int mBuffer;
+    unsigned char* mMapped;
+    void* mFences[RegionCount];
+    size_t mSize;
+    size_t mHead;
+    size_t mAlignment;
+    int mCurrentRegion;
+};
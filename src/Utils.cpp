@@ -29,6 +29,14 @@
 #include "Utils.h"
 #include "EvaluationStages.h"
 #include "tinydir.h"
+#include <algorithm>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
 
 void TexParam(TextureID MinFilter, TextureID MagFilter, TextureID WrapS, TextureID WrapT, TextureID texMode)
 {
@@ -80,84 +88,341 @@ void FullScreenTriangle::Finish()
     glDeleteVertexArrays(1, &mGLFullScreenVertexArrayName);
 }
 
+ProgramCacheStats gProgramCacheStats;
+
+#ifndef EMSCRIPTEN
+static const char* ProgramCacheDirectory = "ShaderCache";
+static const uint32_t ProgramCacheMagic = 0x31474D49; // 'IMG1'
+// least recently used binaries are removed above it
+static const size_t ProgramCacheBudget = 64 * 1024 * 1024;
+
+// a driver update invalidates every binary
+static uint64_t GetProgramCacheKey(const char* const* strings, size_t count)
+{
+    uint64_t key = HashSeed;
+    const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (auto driverString : driverStrings)
+    {
+        const char* str = (const char*)glGetString(driverString);
+        if (str)
+        {
+            key = Hash(str, strlen(str), key);
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        key = Hash(strings[i], strlen(strings[i]), key);
+    }
+    return key;
+}
+
+static std::string GetProgramCacheFilename(uint64_t key)
+{
+    char filename[64];
+    sprintf(filename, "%s/%016llx.bin", ProgramCacheDirectory, (unsigned long long)key);
+    return filename;
+}
+
+static bool IsProgramCacheSupported()
+{
+    static int formatCount = -1;
+    if (formatCount == -1)
+    {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    }
+    return formatCount > 0;
+}
+
+// return 0 when the binary is missing or rejected by the driver
+static unsigned int LoadProgramBinary(uint64_t key)
+{
+    if (!IsProgramCacheSupported())
+        return 0;
+    FILE* fp = fopen(GetProgramCacheFilename(key).c_str(), "rb");
+    if (!fp)
+        return 0;
+    uint32_t header[2];
+    uint64_t fileKey;
+    std::vector<unsigned char> binary;
+    if (fread(header, sizeof(header), 1, fp) == 1 && fread(&fileKey, sizeof(fileKey), 1, fp) == 1 &&
+        header[0] == ProgramCacheMagic && fileKey == key)
+    {
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp) - long(sizeof(header) + sizeof(fileKey));
+        fseek(fp, long(sizeof(header) + sizeof(fileKey)), SEEK_SET);
+        if (size > 0)
+        {
+            binary.resize(size);
+            if (fread(binary.data(), size, 1, fp) != 1)
+                binary.clear();
+        }
+    }
+    fclose(fp);
+    if (binary.empty())
+        return 0;
+    // modification time is the last use, for pruning
+#ifdef WIN32
+    _utime(GetProgramCacheFilename(key).c_str(), NULL);
+#else
+    utime(GetProgramCacheFilename(key).c_str(), NULL);
+#endif
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header[1], binary.data(), GLsizei(binary.size()));
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// removes the least recently used binaries when the directory is over budget
+static void PruneProgramCache()
+{
+    struct CachedBinary
+    {
+        std::string mPath;
+        time_t mLastUse;
+        size_t mSize;
+    };
+    std::vector<CachedBinary> binaries;
+    size_t totalSize = 0;
+    tinydir_dir dir;
+    if (tinydir_open(&dir, ProgramCacheDirectory) == -1)
+        return;
+    while (dir.has_next)
+    {
+        tinydir_file file;
+        tinydir_readfile(&dir, &file);
+        struct stat status;
+        if (!file.is_dir && stat(file.path, &status) == 0)
+        {
+            binaries.push_back({file.path, status.st_mtime, size_t(status.st_size)});
+            totalSize += size_t(status.st_size);
+        }
+        tinydir_next(&dir);
+    }
+    tinydir_close(&dir);
+    if (totalSize <= ProgramCacheBudget)
+        return;
+
+    std::sort(binaries.begin(), binaries.end(), [](const CachedBinary& a, const CachedBinary& b) {
+        return a.mLastUse < b.mLastUse;
+    });
+    for (auto& binary : binaries)
+    {
+        if (totalSize <= ProgramCacheBudget)
+            break;
+        if (remove(binary.mPath.c_str()) == 0)
+            totalSize -= binary.mSize;
+    }
+}
+
+static void SaveProgramBinary(unsigned int program, uint64_t key)
+{
+    if (!IsProgramCacheSupported())
+        return;
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+    std::vector<unsigned char> binary(size);
+    GLenum binaryFormat;
+    glGetProgramBinary(program, size, NULL, &binaryFormat, binary.data());
+
+    static bool pruned = false;
+    if (!pruned)
+    {
+        PruneProgramCache();
+        pruned = true;
+    }
+
+    // an interrupted write must not leave a truncated binary in the cache
+    const std::string filename = GetProgramCacheFilename(key);
+    const std::string temporaryFilename = filename + ".tmp";
+    FILE* fp = fopen(temporaryFilename.c_str(), "wb");
+    if (!fp)
+    {
+#ifdef WIN32
+        _mkdir(ProgramCacheDirectory);
+#else
+        mkdir(ProgramCacheDirectory, 0755);
+#endif
+        fp = fopen(temporaryFilename.c_str(), "wb");
+        if (!fp)
+            return;
+    }
+    uint32_t header[2] = {ProgramCacheMagic, uint32_t(binaryFormat)};
+    fwrite(header, sizeof(header), 1, fp);
+    fwrite(&key, sizeof(key), 1, fp);
+    fwrite(binary.data(), binary.size(), 1, fp);
+    const bool written = !ferror(fp);
+    fclose(fp);
+#ifdef WIN32
+    // rename doesn't replace a binary rejected by the driver
+    remove(filename.c_str());
+#endif
+    if (!written || rename(temporaryFilename.c_str(), filename.c_str()) != 0)
+    {
+        remove(temporaryFilename.c_str());
+    }
+}
+#endif
+
+static bool HasExtension(const char* extension)
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && !strcmp(name, extension))
+            return true;
+    }
+    return false;
+}
+
+// GL_KHR_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+bool IsParallelShaderCompileSupported()
+{
+    static int supported = -1;
+    if (supported == -1)
+    {
+        supported = (HasExtension("GL_KHR_parallel_shader_compile") || HasExtension("GL_ARB_parallel_shader_compile")) ? 1 : 0;
+#ifndef EMSCRIPTEN
+        typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+            (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (supported && maxShaderCompilerThreads)
+        {
+            // implementation chosen thread count
+            maxShaderCompilerThreads(0xFFFFFFFF);
+        }
+#endif
+    }
+    return supported == 1;
+}
+
 unsigned int LoadShader(const std::string& shaderString, const char* fileName)
 {
-    TextureID programObject = glCreateProgram();
-    if (programObject == 0)
+    ShaderBuild build;
+    if (!BeginLoadShader(shaderString, fileName, build))
         return 0;
+    return EndLoadShader(build);
+}
 
-    GLint compiled;
+bool BeginLoadShader(const std::string& shaderString, const char* fileName, ShaderBuild& build)
+{
     const char* shaderTypeStrings[] = {"#version 300 es\nprecision highp float;\nprecision highp int;\nprecision highp sampler2D;\nprecision highp samplerCube;\n#define VERTEX_SHADER\n",
                                        "#version 300 es\nprecision highp float;\nprecision highp int;\nprecision highp sampler2D;\nprecision highp samplerCube;\n#define FRAGMENT_SHADER\n"};
 
-                                       
-    TextureID shaderTypes[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
-    TextureID compiledShader[2];
+    build = ShaderBuild();
+    build.mFilename = fileName;
+#ifndef EMSCRIPTEN
+    const char* cacheStrings[] = {shaderTypeStrings[0], shaderTypeStrings[1], shaderString.c_str()};
+    build.mCacheKey = GetProgramCacheKey(cacheStrings, 3);
+    build.mProgram = LoadProgramBinary(build.mCacheKey);
+    if (build.mProgram)
+    {
+        gProgramCacheStats.mHits++;
+        return true;
+    }
+    gProgramCacheStats.mMisses++;
+#endif
 
+    build.mProgram = glCreateProgram();
+    if (build.mProgram == 0)
+        return false;
+
+    TextureID shaderTypes[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
     for (int i = 0; i < 2; i++)
     {
         // Create the shader object
         int shader = glCreateShader(shaderTypes[i]);
 
         if (shader == 0)
+        {
+            glDeleteProgram(build.mProgram);
+            build.mProgram = 0;
             return false;
+        }
 
-        int stringsCount = 2;
-        const char** strings = (const char**)malloc(sizeof(char*) * stringsCount); // new const char*[stringsCount];
-        int* stringLength = (int*)malloc(sizeof(int) * stringsCount);              // new int[stringsCount];
-        strings[0] = shaderTypeStrings[i];
-        stringLength[0] = int(strlen(shaderTypeStrings[i]));
-        strings[stringsCount - 1] = shaderString.c_str();
-        stringLength[stringsCount - 1] = int(shaderString.length());
+        const char* strings[2] = {shaderTypeStrings[i], shaderString.c_str()};
+        int stringLength[2] = {int(strlen(shaderTypeStrings[i])), int(shaderString.length())};
 
-        // Load and compile the shader source
-        glShaderSource(shader, stringsCount, strings, stringLength);
+        // Load and compile the shader source. Compile status is checked when the link fails
+        glShaderSource(shader, 2, strings, stringLength);
         glCompileShader(shader);
+        glAttachShader(build.mProgram, shader);
+        build.mShaders[i] = shader;
+    }
 
+#ifndef EMSCRIPTEN
+    glProgramParameteri(build.mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 
-        free(stringLength);
-        free(strings);
+    // Link the program
+    glLinkProgram(build.mProgram);
 
-        // Check the compile status
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (compiled == 0)
+    glBindAttribLocation(build.mProgram, SemUV0, "inUV");
+    // submit now: the build may be ended from another shared context
+    glFlush();
+    return true;
+}
+
+bool IsShaderBuildComplete(const ShaderBuild& build)
+{
+    if (!build.mProgram || !build.mShaders[0] || !IsParallelShaderCompileSupported())
+        return true;
+    GLint completed = 0;
+    glGetProgramiv(build.mProgram, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != 0;
+}
+
+unsigned int EndLoadShader(ShaderBuild& build)
+{
+    unsigned int programObject = build.mProgram;
+    build.mProgram = 0;
+    if (!programObject || !build.mShaders[0])
+    {
+        // loaded from the binary cache
+        return programObject;
+    }
+
+    // Check the link status
+    GLint linked;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
+    if (linked == 0)
+    {
+        bool compiled = true;
+        for (int i = 0; i < 2; i++)
         {
+            GLint shaderCompiled;
+            glGetShaderiv(build.mShaders[i], GL_COMPILE_STATUS, &shaderCompiled);
+            if (shaderCompiled)
+                continue;
+            compiled = false;
             GLint info_len = 0;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_len);
+            glGetShaderiv(build.mShaders[i], GL_INFO_LOG_LENGTH, &info_len);
             if (info_len > 1)
             {
                 char* info_log = (char*)malloc(sizeof(char) * info_len);
-                glGetShaderInfoLog(shader, info_len, NULL, info_log);
-                Log("Error compiling shader: %s \n", fileName);
+                glGetShaderInfoLog(build.mShaders[i], info_len, NULL, info_log);
+                Log("Error compiling shader: %s \n", build.mFilename.c_str());
                 Log(info_log);
                 Log("\n");
                 free(info_log);
             }
-            glDeleteShader(shader);
-            return 0;
         }
-        compiledShader[i] = shader;
-    }
-
-
-    GLint linked;
-
-    for (int i = 0; i < 2; i++)
-        glAttachShader(programObject, compiledShader[i]);
-
-
-    // Link the program
-    glLinkProgram(programObject);
-
-    glBindAttribLocation(programObject, SemUV0, "inUV");
-
-    // Check the link status
-    glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
-    if (linked == 0)
-    {
         GLint info_len = 0;
         glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &info_len);
-        if (info_len > 1)
+        if (compiled && info_len > 1)
         {
             char* info_log = (char*)malloc(sizeof(char) * info_len);
             glGetProgramInfoLog(programObject, info_len, NULL, info_log);
@@ -166,24 +431,46 @@ unsigned int LoadShader(const std::string& shaderString, const char* fileName)
             free(info_log);
         }
         glDeleteProgram(programObject);
-        return 0;
+        programObject = 0;
     }
 
     // Delete these here because they are attached to the program object.
     for (int i = 0; i < 2; i++)
-        glDeleteShader(compiledShader[i]);
+    {
+        glDeleteShader(build.mShaders[i]);
+        build.mShaders[i] = 0;
+    }
+
+#ifndef EMSCRIPTEN
+    if (programObject)
+    {
+        SaveProgramBinary(programObject, build.mCacheKey);
+    }
+#endif
 
     // attributes
     return programObject;
 }
 
-
 unsigned int LoadShaderTransformFeedback(const std::string& shaderString, const char* filename)
 {
+    const char* src[2] = {"#version 430\n", shaderString.c_str()};
+#ifndef EMSCRIPTEN
+    // varyings are part of the binary
+    const char* cacheStrings[] = {"transform feedback", src[0], src[1]};
+    const uint64_t cacheKey = GetProgramCacheKey(cacheStrings, 3);
+    GLuint cachedProgram = LoadProgramBinary(cacheKey);
+    if (cachedProgram)
+    {
+        gProgramCacheStats.mHits++;
+        return cachedProgram;
+    }
+    gProgramCacheStats.mMisses++;
+#endif
+
     GLuint programHandle = glCreateProgram();
     GLuint vsHandle = glCreateShader(GL_VERTEX_SHADER);
 
-    const char* src[2] = {"#version 430\n", shaderString.c_str()};
     int size[2];
     for (int j = 0; j < 2; j++)
         size[j] = int(strlen(src[j]));
@@ -218,8 +505,19 @@ unsigned int LoadShaderTransformFeedback(const std::string& shaderString, const
     glTransformFeedbackVaryings(
         programHandle, sizeof(varyings) / sizeof(const char*), varyings, GL_INTERLEAVED_ATTRIBS);
 
+#ifndef EMSCRIPTEN
+    glProgramParameteri(programHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
     glLinkProgram(programHandle);
 
+#ifndef EMSCRIPTEN
+    GLint linked = 0;
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &linked);
+    if (linked)
+    {
+        SaveProgramBinary(programHandle, cacheKey);
+    }
+#endif
     return programHandle;
 }
 
@@ -476,6 +774,18 @@ void TagTime(const char* tagInfo)
     lastTime = t;
 }
 
+uint64_t Hash(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* ptr = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= ptr[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 void DiscoverFiles(const char* extension, const char* directory, std::vector<std::string>& files)
 {
     tinydir_dir dir;
@@ -28,9 +28,16 @@
 #include <float.h>
 #include <vector>
 #include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
 
 void TagTime(const char* tagInfo);
 
+// 64bits FNV-1a. Pass a previous result as seed to chain blocks.
+static const uint64_t HashSeed = 0xcbf29ce484222325ULL;
+uint64_t Hash(const void* data, size_t size, uint64_t seed = HashSeed);
+
 typedef unsigned int TextureID;
 static const int SemUV0 = 0;
 
@@ -57,9 +64,32 @@ void TexParam(TextureID MinFilter, TextureID MagFilter, TextureID WrapS, Texture
 
 std::string ReplaceAll(std::string str, const std::string& from, const std::string& to);
 
+// programs are first looked up in an on-disk binary cache keyed by the shader text and the driver
 unsigned int LoadShader(const std::string& shaderString, const char* fileName);
 unsigned int LoadShaderTransformFeedback(const std::string& shaderString, const char* fileName);
 
+// LoadShader in 2 steps. With GL_KHR_parallel_shader_compile, compile and link run on driver threads
+// and IsShaderBuildComplete tells when EndLoadShader won't block.
+struct ShaderBuild
+{
+    unsigned int mProgram = 0;
+    unsigned int mShaders[2] = {0, 0}; // 0 when the program comes from the binary cache
+    uint64_t mCacheKey = 0;
+    std::string mFilename;
+};
+bool IsParallelShaderCompileSupported();
+bool BeginLoadShader(const std::string& shaderString, const char* fileName, ShaderBuild& build);
+bool IsShaderBuildComplete(const ShaderBuild& build);
+// logs errors, returns the program or 0
+unsigned int EndLoadShader(ShaderBuild& build);
+
+struct ProgramCacheStats
+{
+    std::atomic<int> mHits{0};
+    std::atomic<int> mMisses{0};
+};
+extern ProgramCacheStats gProgramCacheStats;
+
 
 typedef void (*LogOutput)(const char* szText);
 void AddLogOutput(LogOutput output);
@@ -26,6 +26,7 @@
 #include "Loader.h"
 #include "UI.h"
 #include "imMouseState.h"
+#include "ImageReadback.h"
 
 // Emscripten requires to have full control over the main loop. We're going to store our SDL book-keeping variables globally.
 // Having a single function that acts as a loop prevents us to store state in the stack of said function. So we need some location for this.
@@ -112,12 +113,14 @@ EM_JS(void, HideLoader, (), {
     document.getElementById("loader").style.display = "none";
 });
 #else
+static const int MaxThreadContextCount = 4;
 SDL_Window* glThreadWindow;
-SDL_GLContext glThreadContext;
+SDL_GLContext glThreadContexts[MaxThreadContextCount];
+int gThreadContextCount = 0;
 
-void MakeThreadContext()
+void MakeThreadContext(int contextIndex)
 {
-    SDL_GL_MakeCurrent(glThreadWindow, glThreadContext);
+    SDL_GL_MakeCurrent(glThreadWindow, glThreadContexts[contextIndex]);
 }
 #endif
 
@@ -182,7 +185,15 @@ int main(int, char**)
     loopdata.mWindow = SDL_CreateWindow("Imogen 0.13 Web Edition", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, window_flags);
 #ifndef __EMSCRIPTEN__
     SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
-    glThreadContext = SDL_GL_CreateContext(loopdata.mWindow);
+    // each context is created current: the next one shares with it
+    for (; gThreadContextCount < MaxThreadContextCount; gThreadContextCount++)
+    {
+        glThreadContexts[gThreadContextCount] = SDL_GL_CreateContext(loopdata.mWindow);
+        if (!glThreadContexts[gThreadContextCount])
+        {
+            break;
+        }
+    }
     glThreadWindow = loopdata.mWindow;
 #endif
     loopdata.mGLContext = SDL_GL_CreateContext(loopdata.mWindow);
@@ -278,6 +289,7 @@ int main(int, char**)
         main_loop(&loopdata);
     }
     imogen.ValidateCurrentMaterial(library);
+    gImageReadback.Finish();
 
     g_TS.WaitforAllAndShutdown();
 
@@ -331,6 +343,13 @@ void main_loop(void* arg)
         InitCallbackRects();
         loopdata->mImogen->HandleHotKeys();
 
+        // node files edited on disk, only their stages are evaluated again
+        static std::vector<size_t> reloadedNodeTypes;
+        gEvaluators.ReloadChangedEvaluators(reloadedNodeTypes);
+        for (size_t nodeType : reloadedNodeTypes)
+        {
+            loopdata->mNodeGraphControler->mEditingContext.SetNodeTypeDirty(nodeType);
+        }
         loopdata->mNodeGraphControler->mEditingContext.RunDirty();
         loopdata->mImogen->Show(loopdata->mBuilder, library, capturing);
         if (!capturing && loopdata->mImogen->ShowMouseState())
@@ -351,6 +370,9 @@ void main_loop(void* arg)
         glDisable(GL_DEPTH_TEST);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         g_TS.RunPinnedTasks();
+        gImageReadback.Update();
+        gImageCache.Update();
+        gEvaluators.UpdatePrograms();
     };
 
     renderImogenFrame(false);
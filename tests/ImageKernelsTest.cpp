@@ -0,0 +1,119 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "Bitmap.h"
+#include "ImageKernels.h"
+#include "Utils.h"
+#include "Tests.h"
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static void InitImage(Image& image, int width, int height, TextureFormat::Enum format)
+{
+    image.mWidth = width;
+    image.mHeight = height;
+    image.mNumMips = 1;
+    image.mNumFaces = 1;
+    image.mFormat = format;
+    image.Allocate(size_t(width) * height * textureFormatSize[format]);
+}
+
+// a constant image must stay constant whatever the filter and the scale
+static void TestResizeConstant()
+{
+    Image source;
+    InitImage(source, 37, 23, TextureFormat::RGBA8);
+    unsigned char* bits = source.GetWritableBits();
+    for (int i = 0; i < 37 * 23; i++)
+    {
+        bits[i * 4] = 200;
+        bits[i * 4 + 1] = 100;
+        bits[i * 4 + 2] = 50;
+        bits[i * 4 + 3] = 255;
+    }
+    const int sizes[][2] = {{10, 7}, {80, 50}, {37, 23}, {1, 1}};
+    for (int filter = 0; filter < 3; filter++)
+    {
+        for (auto& size : sizes)
+        {
+            Image destination;
+            CHECK(ImageKernels::Resize(&source, &destination, size[0], size[1], filter) == EVAL_OK);
+            CHECK(destination.mWidth == size[0] && destination.mHeight == size[1]);
+            CHECK(destination.mFormat == TextureFormat::RGBA8);
+            const unsigned char* pixels = destination.GetBits();
+            int bad = 0;
+            for (int i = 0; i < size[0] * size[1]; i++)
+            {
+                if (abs(pixels[i * 4] - 200) > 1 || abs(pixels[i * 4 + 1] - 100) > 1 ||
+                    abs(pixels[i * 4 + 2] - 50) > 1 || pixels[i * 4 + 3] != 255)
+                {
+                    bad++;
+                }
+            }
+            CHECK(bad == 0);
+        }
+    }
+}
+
+// RGBA32F -> format -> RGBA32F, within the precision of the intermediate format
+static void TestConvertRoundTrip()
+{
+    for (int format = 0; format < TextureFormat::Count; format++)
+    {
+        Image source;
+        InitImage(source, 33, 3, TextureFormat::RGBA32F);
+        float* pixels = (float*)source.GetWritableBits();
+        for (int i = 0; i < 33 * 3; i++)
+        {
+            pixels[i * 4] = 0.25f;
+            pixels[i * 4 + 1] = 0.5f;
+            pixels[i * 4 + 2] = 0.75f;
+            pixels[i * 4 + 3] = 1.f;
+        }
+        Image converted, back;
+        CHECK(ImageKernels::Convert(&source, &converted, format) == EVAL_OK);
+        CHECK(converted.mFormat == format);
+        CHECK(ImageKernels::Convert(&converted, &back, TextureFormat::RGBA32F) == EVAL_OK);
+        CHECK(back.mWidth == 33 && back.mHeight == 3);
+
+        const float* result = (const float*)back.GetBits();
+        float error = 0.f;
+        for (int i = 0; i < 33 * 3 * 4; i++)
+        {
+            error = std::max(error, fabsf(result[i] - pixels[i]));
+        }
+        CHECK(error <= 1.f / 255.f);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestResizeConstant();
+    TestConvertRoundTrip();
+    printf("ImageKernels: %d failure(s)\n", gTestFailures);
+    return gTestFailures ? 1 : 0;
+}
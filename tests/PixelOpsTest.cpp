@@ -0,0 +1,105 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "Bitmap.h"
+#include "PixelOps.h"
+#include "Tests.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// odd counts exercise the scalar tails behind the SIMD loops, in place and out of place
+static void TestExpandRGBToRGBA()
+{
+    for (size_t count : {1, 3, 5, 6, 7, 9, 10, 17, 100, 1001})
+    {
+        for (int swapRedBlue = 0; swapRedBlue < 2; swapRedBlue++)
+        {
+            std::vector<unsigned char> source(count * 3), destination(count * 4), inPlace(count * 4);
+            for (size_t i = 0; i < count * 3; i++)
+            {
+                source[i] = inPlace[i] = (unsigned char)(i * 13 + 5);
+            }
+            PixelOps::ExpandRGBToRGBA(source.data(), destination.data(), count, swapRedBlue != 0);
+            PixelOps::ExpandRGBToRGBA(inPlace.data(), inPlace.data(), count, swapRedBlue != 0);
+
+            int bad = 0;
+            const int red = swapRedBlue ? 2 : 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                const unsigned char expected[4] = {
+                    source[i * 3 + red], source[i * 3 + 1], source[i * 3 + 2 - red], 255};
+                for (int c = 0; c < 4; c++)
+                {
+                    if (destination[i * 4 + c] != expected[c] || inPlace[i * 4 + c] != expected[c])
+                    {
+                        bad++;
+                    }
+                }
+            }
+            CHECK(bad == 0);
+        }
+    }
+}
+
+// 5x3 RGB8 with a 2x1 mip: every level is flipped on its own
+static void TestVFlip()
+{
+    Image image;
+    image.mWidth = 5;
+    image.mHeight = 3;
+    image.mNumMips = 2;
+    image.mNumFaces = 1;
+    image.mFormat = TextureFormat::RGB8;
+    image.Allocate(5 * 3 * 3 + 2 * 1 * 3);
+    for (unsigned int i = 0; i < image.mDataSize; i++)
+    {
+        image.GetWritableBits()[i] = (unsigned char)i;
+    }
+    std::vector<unsigned char> original(image.GetBits(), image.GetBits() + image.mDataSize);
+
+    PixelOps::VFlip(&image);
+    CHECK(image.GetBits()[0] == 30);
+    CHECK(image.GetBits()[15] == 15);
+    CHECK(image.GetBits()[30] == 0);
+    CHECK(image.GetBits()[45] == 45);
+
+    PixelOps::VFlip(&image);
+    CHECK(memcmp(image.GetBits(), original.data(), original.size()) == 0);
+
+    PixelOps::ExpandRGBToRGBA(&image);
+    CHECK(image.mFormat == TextureFormat::RGBA8);
+    CHECK(image.mDataSize == (5 * 3 + 2) * 4);
+    CHECK(image.GetBits()[4] == 3 && image.GetBits()[7] == 255);
+}
+
+int main(int argc, char** argv)
+{
+    TestExpandRGBToRGBA();
+    TestVFlip();
+    printf("PixelOps: %d failure(s)\n", gTestFailures);
+    return gTestFailures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "Bitmap.h"
+#include "ResultCache.h"
+#include "Tests.h"
+
+// no GL context in tests: releasing a target only forgets its texture
+void RenderTarget::Destroy()
+{
+    mGLTexID = 0;
+}
+
+static std::shared_ptr<RenderTarget> MakeResult(unsigned int texture)
+{
+    auto target = std::make_shared<RenderTarget>();
+    target->mGLTexID = texture;
+    target->mImage->mWidth = 16;
+    target->mImage->mHeight = 16;
+    target->mImage->mNumMips = 1;
+    target->mImage->mNumFaces = 1;
+    target->mImage->mFormat = TextureFormat::RGBA8;
+    return target;
+}
+
+// two identical stages share the cached target, then one of them is evaluated without a hash
+static void TestUncacheableStageDetaches()
+{
+    ResultCache cache;
+    const uint64_t hash = 0x1234;
+
+    std::shared_ptr<RenderTarget> stageA = MakeResult(1);
+    cache.Add(hash, stageA);
+    std::shared_ptr<RenderTarget> stageB = cache.Get(hash);
+    CHECK(stageB == stageA);
+
+    std::shared_ptr<RenderTarget> shared = stageB;
+    cache.Detach(stageB);
+    CHECK(stageB && stageB != shared);
+    CHECK(!stageB->mGLTexID);
+    CHECK(cache.Get(hash) == shared);
+    CHECK(stageA == shared && stageA->mGLTexID == 1);
+
+    // a target owned by its stage is rendered in place
+    std::shared_ptr<RenderTarget> owned = stageB;
+    cache.Detach(stageB);
+    CHECK(stageB == owned);
+
+    std::shared_ptr<RenderTarget> empty;
+    cache.Detach(empty);
+    CHECK(!empty);
+}
+
+// evicted targets still used by a stage are left to the stage
+static void TestEvictionKeepsUsedTargets()
+{
+    ResultCache cache;
+    std::shared_ptr<RenderTarget> used = MakeResult(1);
+    cache.Add(1, used);
+    cache.Add(2, MakeResult(2));
+    CHECK(cache.GetEntryCount() == 2);
+    CHECK(cache.GetUsage() == 2 * 16 * 16 * 4);
+
+    cache.Clear();
+    CHECK(cache.GetEntryCount() == 0 && cache.GetUsage() == 0);
+    CHECK(used->mGLTexID == 1);
+    CHECK(!cache.Contains(used.get()));
+}
+
+int main(int argc, char** argv)
+{
+    TestUncacheableStageDetaches();
+    TestEvictionKeepsUsedTargets();
+    printf("ResultCache: %d failure(s)\n", gTestFailures);
+    return gTestFailures ? 1 : 0;
+}
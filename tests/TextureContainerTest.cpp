@@ -0,0 +1,244 @@
+// https://github.com/CedricGuillemet/Imogen
+//
+// The MIT License(MIT)
+//
+// Copyright(c) 2019 Cedric Guillemet
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Platform.h"
+#include "Bitmap.h"
+#include "TextureContainer.h"
+#include "Utils.h"
+#include "Tests.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// noise does not compress, the stripes and gradients do
+static void FillImage(Image& image, int width, int kind)
+{
+    image.mWidth = width;
+    image.mHeight = width / 2 + 1;
+    image.mNumMips = 1;
+    image.mNumFaces = 1;
+    image.mFormat = TextureFormat::RGBA8;
+    image.Allocate(size_t(image.mWidth) * image.mHeight * 4);
+    unsigned char* bits = image.GetWritableBits();
+    for (size_t i = 0; i < image.mDataSize; i++)
+    {
+        const size_t texel = i / 4;
+        switch (kind)
+        {
+            case 0:
+                bits[i] = (unsigned char)rand();
+                break;
+            case 1:
+                bits[i] = (unsigned char)(((texel % width) < size_t(width / 2) ? 200 : 30) + (i & 3));
+                break;
+            default:
+                bits[i] = (unsigned char)((texel / width) * 3 + (texel % width) / 7);
+                break;
+        }
+    }
+}
+
+static void TestRoundTrip()
+{
+    for (int kind = 0; kind < 3; kind++)
+    {
+        for (int width : {1, 3, 17, 256})
+        {
+            Image image;
+            FillImage(image, width, kind);
+            for (int flags = 0; flags < 4; flags++)
+            {
+                std::vector<uint8_t> container;
+                CHECK(TextureContainer::Encode(&image, flags, container) == EVAL_OK);
+                CHECK(TextureContainer::IsContainer(container.data(), container.size()));
+
+                Image decoded;
+                CHECK(TextureContainer::Decode(container.data(), container.size(), &decoded) == EVAL_OK);
+                CHECK(decoded.mWidth == image.mWidth && decoded.mHeight == image.mHeight);
+                CHECK(decoded.mFormat == image.mFormat);
+                // the first level is the source, generated mips follow it
+                CHECK(decoded.mDataSize >= image.mDataSize);
+                CHECK(decoded.GetBits() && memcmp(decoded.GetBits(), image.GetBits(), image.mDataSize) == 0);
+                if ((flags & TextureContainer::GenerateMips) && width > 2)
+                {
+                    CHECK(decoded.mNumMips > 1);
+                }
+            }
+        }
+    }
+}
+
+// a failed decode leaves the output image as it was
+static void CheckRejected(const std::vector<uint8_t>& container, size_t size, const char* what)
+{
+    Image output;
+    output.mWidth = 2;
+    output.mHeight = 2;
+    output.mNumMips = 1;
+    output.mNumFaces = 1;
+    output.mFormat = TextureFormat::RGBA8;
+    output.Allocate(16);
+    memset(output.GetWritableBits(), 0xAB, 16);
+    const unsigned char* bits = output.GetBits();
+
+    const int status = TextureContainer::Decode(container.data(), size, &output);
+    if (status != EVAL_ERR)
+    {
+        printf("%s: not rejected\n", what);
+    }
+    CHECK(status == EVAL_ERR);
+    CHECK(output.GetBits() == bits && output.mDataSize == 16);
+    CHECK(output.mWidth == 2 && output.mHeight == 2 && output.mFormat == TextureFormat::RGBA8);
+    for (int i = 0; i < 16; i++)
+    {
+        CHECK(bits[i] == 0xAB);
+    }
+}
+
+static TextureContainer::Level GetLevel(const std::vector<uint8_t>& container, int index)
+{
+    TextureContainer::Level level;
+    memcpy(&level, container.data() + sizeof(TextureContainer::Header) + index * sizeof(level), sizeof(level));
+    return level;
+}
+
+static void SetLevel(std::vector<uint8_t>& container, int index, const TextureContainer::Level& level)
+{
+    memcpy(container.data() + sizeof(TextureContainer::Header) + index * sizeof(level), &level, sizeof(level));
+}
+
+static void TestCorruptInput()
+{
+    Image image;
+    FillImage(image, 64, 2);
+    std::vector<uint8_t> container;
+    CHECK(TextureContainer::Encode(&image, TextureContainer::Compress | TextureContainer::GenerateMips, container) ==
+          EVAL_OK);
+    // the gradient compresses: level 0 is LZ4
+    TextureContainer::Level first = GetLevel(container, 0);
+    CHECK(first.mStoredSize < first.mSize);
+
+    CheckRejected(container, sizeof(TextureContainer::Header) - 1, "truncated header");
+    CheckRejected(container, container.size() / 2, "truncated levels");
+
+    std::vector<uint8_t> badMagic = container;
+    badMagic[0] ^= 0xFF;
+    CheckRejected(badMagic, badMagic.size(), "bad magic");
+
+    std::vector<uint8_t> oversizedMip = container;
+    TextureContainer::Level level = GetLevel(oversizedMip, 1);
+    level.mSize *= 2;
+    SetLevel(oversizedMip, 1, level);
+    CheckRejected(oversizedMip, oversizedMip.size(), "oversized mip length");
+
+    std::vector<uint8_t> pastTheEnd = container;
+    level = GetLevel(pastTheEnd, 1);
+    level.mStoredSize = level.mSize;
+    level.mOffset = pastTheEnd.size() - level.mSize / 2;
+    SetLevel(pastTheEnd, 1, level);
+    CheckRejected(pastTheEnd, pastTheEnd.size(), "level past the end");
+
+    // a well formed single level stream but for its match: 1 literal, then a match 2 bytes back,
+    // before the start of the output, up to the 5 last literals
+    std::vector<uint8_t> backReference;
+    CHECK(TextureContainer::Encode(&image, TextureContainer::Compress, backReference) == EVAL_OK);
+    TextureContainer::Level single = GetLevel(backReference, 0);
+    std::vector<uint8_t> stream = {0x1F, 'x', 2, 0};
+    size_t matchLength = single.mSize - 1 - 5 - 4 - 15;
+    for (; matchLength >= 255; matchLength -= 255)
+        stream.push_back(255);
+    stream.push_back(uint8_t(matchLength));
+    stream.insert(stream.end(), {0x50, 1, 2, 3, 4, 5});
+    backReference.resize(std::max(backReference.size(), size_t(single.mOffset) + stream.size()));
+    memcpy(backReference.data() + single.mOffset, stream.data(), stream.size());
+    single.mStoredSize = uint32_t(stream.size());
+    SetLevel(backReference, 0, single);
+    CheckRejected(backReference, backReference.size(), "LZ4 back-reference before the output");
+
+    // random damage: either rejected without touching the output, or a well formed image
+    srand(1);
+    for (int i = 0; i < 500; i++)
+    {
+        std::vector<uint8_t> damaged = container;
+        damaged[rand() % damaged.size()] ^= uint8_t(1 << (rand() % 8));
+        if (rand() & 1)
+        {
+            damaged.resize(rand() % damaged.size());
+        }
+        Image result;
+        if (TextureContainer::Decode(damaged.data(), damaged.size(), &result) == EVAL_OK)
+        {
+            CHECK(result.mWidth == image.mWidth && result.mHeight == image.mHeight);
+            CHECK(result.GetBits() && result.mDataSize >= image.mDataSize);
+        }
+        else
+        {
+            CHECK(!result.GetBits() && !result.mWidth);
+        }
+    }
+}
+
+// the file holds the encoded container as is and reads back to the same pixels
+static void TestFileRoundTrip()
+{
+    const char* filename = "TextureContainerTest.imtx";
+    Image image;
+    FillImage(image, 97, 1);
+    const int flags = TextureContainer::Compress | TextureContainer::GenerateMips;
+    std::vector<uint8_t> container;
+    CHECK(TextureContainer::Encode(&image, flags, container) == EVAL_OK);
+    CHECK(TextureContainer::Write(filename, &image, flags) == EVAL_OK);
+
+    std::vector<uint8_t> file;
+    FILE* fp = fopen(filename, "rb");
+    CHECK(fp != NULL);
+    if (fp)
+    {
+        fseek(fp, 0, SEEK_END);
+        file.resize(size_t(ftell(fp)));
+        fseek(fp, 0, SEEK_SET);
+        CHECK(fread(file.data(), 1, file.size(), fp) == file.size());
+        fclose(fp);
+    }
+    CHECK(file == container);
+
+    Image fromFile, fromMemory;
+    CHECK(TextureContainer::Read(filename, &fromFile) == EVAL_OK);
+    CHECK(TextureContainer::Decode(container.data(), container.size(), &fromMemory) == EVAL_OK);
+    CHECK(fromFile.mDataSize == fromMemory.mDataSize && fromFile.mNumMips == fromMemory.mNumMips);
+    CHECK(fromFile.GetBits() && memcmp(fromFile.GetBits(), fromMemory.GetBits(), fromFile.mDataSize) == 0);
+    CHECK(memcmp(fromFile.GetBits(), image.GetBits(), image.mDataSize) == 0);
+    remove(filename);
+}
+
+int main(int argc, char** argv)
+{
+    TestRoundTrip();
+    TestCorruptInput();
+    TestFileRoundTrip();
+    printf("TextureContainer: %d failure(s)\n", gTestFailures);
+    return gTestFailures ? 1 : 0;
+}